@@ -0,0 +1,133 @@
+#include "concurrent_hash_multimap.hpp"
+#include "hash_multimap.hpp"
+#include "zipfian_distribution.hpp"
+
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace sse {
+
+// Baseline: an in-memory index behind a single mutex
+class LockedHashMultiMap
+{
+public:
+    void insert(const insecure::Index::keyword_type& keyword,
+                insecure::Index::document_type       document)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_index.insert(keyword, document);
+    }
+
+    void search(const insecure::Index::keyword_type&          keyword,
+                const insecure::Index::document_visitor_type& visitor) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_index.search(keyword, visitor);
+    }
+
+private:
+    mutable std::mutex     m_mutex;
+    insecure::HashMultiMap m_index;
+};
+
+constexpr size_t kKeywordCount = 100000;
+
+static const std::vector<std::string>& keywords()
+{
+    static const std::vector<std::string> kws = []() {
+        std::vector<std::string> result;
+        for (size_t i = 0; i < kKeywordCount; i++) {
+            result.push_back(std::to_string(i));
+        }
+        return result;
+    }();
+    return kws;
+}
+
+// The index shared by the threads of a benchmark, created by the first thread
+// before the measurement, and destroyed after
+template<class MemoryIndex>
+static std::unique_ptr<MemoryIndex>& shared_index()
+{
+    static std::unique_ptr<MemoryIndex> index;
+    return index;
+}
+
+// Every thread inserts pairs with Zipf distributed keywords
+template<class MemoryIndex>
+static void Insert(benchmark::State& state)
+{
+    auto& index = shared_index<MemoryIndex>();
+    if (state.thread_index() == 0) {
+        index.reset(new MemoryIndex());
+    }
+
+    const auto&                         kws = keywords();
+    std::mt19937_64                     rnd_gen(state.thread_index());
+    ZipfianDistribution<size_t, double> kw_dist(1.2, 0, kKeywordCount - 1);
+
+    for (auto _ : state) {
+        index->insert(kws[kw_dist(rnd_gen)], rnd_gen());
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        index.reset(nullptr);
+    }
+}
+
+// The even threads insert, while the odd ones search: the search throughput
+// is the one of a write buffer read during ingestion
+template<class MemoryIndex>
+static void SearchWhileInserting(benchmark::State& state)
+{
+    auto& index = shared_index<MemoryIndex>();
+    if (state.thread_index() == 0) {
+        index.reset(new MemoryIndex());
+    }
+
+    const auto&                         kws = keywords();
+    std::mt19937_64                     rnd_gen(state.thread_index());
+    ZipfianDistribution<size_t, double> kw_dist(1.2, 0, kKeywordCount - 1);
+
+    const bool writer = (state.thread_index() % 2 == 0);
+    size_t     count  = 0;
+
+    for (auto _ : state) {
+        if (writer) {
+            index->insert(kws[kw_dist(rnd_gen)], rnd_gen());
+        } else {
+            index->search(kws[kw_dist(rnd_gen)],
+                          [&count](const uint64_t*, size_t n) { count += n; });
+        }
+    }
+    benchmark::DoNotOptimize(count);
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        index.reset(nullptr);
+    }
+}
+
+BENCHMARK_TEMPLATE(Insert, LockedHashMultiMap)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(Insert, insecure::ConcurrentHashMultiMap)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(SearchWhileInserting, LockedHashMultiMap)
+    ->ThreadRange(2, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(SearchWhileInserting, insecure::ConcurrentHashMultiMap)
+    ->ThreadRange(2, 64)
+    ->UseRealTime();
+
+} // namespace sse
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,170 @@
+#include "hash_multimap.hpp"
+#include "mapped_multimap.hpp"
+#include "std_multimap.hpp"
+#include "utils.hpp"
+#include "zipfian_distribution.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace sse {
+
+// state.range(1) pairs over state.range(0) keywords, with the Zipf
+// distribution of the databases of bench_util
+static std::vector<insecure::Index::entry_type> zipf_entries(
+    const benchmark::State& state)
+{
+    std::mt19937_64                     rnd_gen(0x5eed);
+    ZipfianDistribution<size_t, double> kw_dist(1.2, 0, state.range(0) - 1);
+    std::uniform_int_distribution<insecure::Index::document_type> doc_dist;
+
+    std::vector<insecure::Index::entry_type> entries;
+    entries.reserve(state.range(1));
+    for (int64_t i = 0; i < state.range(1); i++) {
+        entries.emplace_back(std::to_string(kw_dist(rnd_gen)),
+                             doc_dist(rnd_gen));
+    }
+    return entries;
+}
+
+static void set_memory_counters(benchmark::State& state,
+                                size_t            memory_usage,
+                                size_t            n_entries)
+{
+    state.counters["memory_bytes"]      = memory_usage;
+    state.counters["bytes_per_posting"] = static_cast<double>(memory_usage)
+                                          / static_cast<double>(n_entries);
+}
+
+template<class MemoryIndex>
+static void Insert(benchmark::State& state)
+{
+    const auto entries = zipf_entries(state);
+
+    size_t memory_usage = 0;
+    for (auto _ : state) {
+        MemoryIndex index;
+        for (const auto& entry : entries) {
+            index.insert(entry.first, entry.second);
+        }
+
+        state.PauseTiming();
+        memory_usage = index.memory_usage();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+    set_memory_counters(state, memory_usage, entries.size());
+}
+
+// Search every keyword, and read its list
+template<class MemoryIndex>
+static void Search(benchmark::State& state)
+{
+    const auto entries = zipf_entries(state);
+
+    MemoryIndex index;
+    for (const auto& entry : entries) {
+        index.insert(entry.first, entry.second);
+    }
+
+    std::vector<insecure::Index::keyword_type> keywords;
+    for (int64_t k = 0; k < state.range(0); k++) {
+        keywords.push_back(std::to_string(k));
+    }
+
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (const auto& keyword : keywords) {
+            index.search(keyword, [&sum](const uint64_t* docs, size_t n) {
+                for (size_t i = 0; i < n; i++) {
+                    sum += docs[i];
+                }
+            });
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * keywords.size());
+    set_memory_counters(state, index.memory_usage(), entries.size());
+}
+
+// Path of the snapshot of the index of state, that is written by the first
+// call
+static std::string snapshot_path(benchmark::State& state)
+{
+    const std::string path = "bench_memory_index_"
+                             + std::to_string(state.range(0)) + "_"
+                             + std::to_string(state.range(1)) + ".snapshot";
+
+    if (utility::is_file(path)) {
+        return path;
+    }
+
+    insecure::StdMultiMap index;
+    for (const auto& entry : zipf_entries(state)) {
+        index.insert(entry.first, entry.second);
+    }
+    index.save(path);
+    return path;
+}
+
+// Restart from a snapshot: map it, and search a keyword. Compare with the
+// Insert benchmarks, that rebuild the index from the pairs.
+static void MapSnapshot(benchmark::State& state)
+{
+    const std::string path = snapshot_path(state);
+
+    size_t file_size = 0;
+    for (auto _ : state) {
+        insecure::MappedMultiMap index(path);
+        benchmark::DoNotOptimize(index.search("0"));
+        file_size = index.file_size();
+    }
+    set_memory_counters(state, file_size, state.range(1));
+}
+
+static void SearchSnapshot(benchmark::State& state)
+{
+    insecure::MappedMultiMap index(snapshot_path(state));
+
+    std::vector<insecure::Index::keyword_type> keywords;
+    for (int64_t k = 0; k < state.range(0); k++) {
+        keywords.push_back(std::to_string(k));
+    }
+
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (const auto& keyword : keywords) {
+            index.search(keyword, [&sum](const uint64_t* docs, size_t n) {
+                for (size_t i = 0; i < n; i++) {
+                    sum += docs[i];
+                }
+            });
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * keywords.size());
+    set_memory_counters(state, index.file_size(), state.range(1));
+}
+
+// (number of keywords, number of pairs)
+static void index_arguments(benchmark::internal::Benchmark* b)
+{
+    b->Args({1000, 1000000})
+        ->Args({100000, 1000000})
+        ->Args({1000000, 1000000});
+}
+
+BENCHMARK_TEMPLATE(Insert, insecure::StdMultiMap)->Apply(index_arguments);
+BENCHMARK_TEMPLATE(Insert, insecure::HashMultiMap)->Apply(index_arguments);
+BENCHMARK_TEMPLATE(Search, insecure::StdMultiMap)->Apply(index_arguments);
+BENCHMARK_TEMPLATE(Search, insecure::HashMultiMap)->Apply(index_arguments);
+BENCHMARK(MapSnapshot)->Apply(index_arguments);
+BENCHMARK(SearchSnapshot)->Apply(index_arguments);
+
+} // namespace sse
+
+
+BENCHMARK_MAIN();
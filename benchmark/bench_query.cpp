@@ -0,0 +1,140 @@
+#include "query.hpp"
+#include "std_multimap.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+
+#include <benchmark/benchmark.h>
+
+namespace sse {
+
+// Create an index with two keywords: "small" matching state.range(0) random
+// documents, and "large" matching state.range(1) random documents. The
+// documents are inserted in increasing order.
+static void fill_index(const benchmark::State& state,
+                       insecure::StdMultiMap*  index)
+{
+    constexpr uint64_t kDocumentRange = 1ULL << 24;
+
+    std::mt19937_64                         rnd_gen(0x5eed);
+    std::uniform_int_distribution<uint64_t> dist(0, kDocumentRange - 1);
+
+    for (auto kw_size : {std::make_pair("small", state.range(0)),
+                         std::make_pair("large", state.range(1))}) {
+        std::set<uint64_t> docs;
+        while (docs.size() < static_cast<size_t>(kw_size.second)) {
+            docs.insert(dist(rnd_gen));
+        }
+        for (uint64_t doc : docs) {
+            index->insert(kw_size.first, doc);
+        }
+    }
+}
+
+static void Naive_intersection(benchmark::State& state)
+{
+    insecure::StdMultiMap index;
+    fill_index(state, &index);
+
+    for (auto _ : state) {
+        std::vector<uint64_t> small = index.search("small");
+        std::vector<uint64_t> large = index.search("large");
+
+        std::sort(small.begin(), small.end());
+        std::sort(large.begin(), large.end());
+
+        std::vector<uint64_t> result;
+        std::set_intersection(small.begin(),
+                              small.end(),
+                              large.begin(),
+                              large.end(),
+                              std::back_inserter(result));
+        benchmark::DoNotOptimize(result.data());
+    }
+    state.SetItemsProcessed(state.iterations()
+                            * (state.range(0) + state.range(1)));
+}
+
+static void QueryEngine_intersection(benchmark::State& state)
+{
+    insecure::StdMultiMap index;
+    fill_index(state, &index);
+
+    const insecure::QueryEngine engine(index);
+    const insecure::Query       query
+        = insecure::Query::conjunction({insecure::Query::keyword("small"),
+                                        insecure::Query::keyword("large")});
+
+    for (auto _ : state) {
+        size_t count = 0;
+        engine.execute(query, [&count](const uint64_t*, size_t n) {
+            count += n;
+        });
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations()
+                            * (state.range(0) + state.range(1)));
+}
+
+static void Intersection_kernel(benchmark::State& state)
+{
+    insecure::StdMultiMap index;
+    fill_index(state, &index);
+
+    const std::vector<uint64_t> small = index.search("small");
+    const std::vector<uint64_t> large = index.search("large");
+    std::vector<uint64_t>       result(small.size());
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            insecure::intersect_sorted_lists(small.data(),
+                                             small.size(),
+                                             large.data(),
+                                             large.size(),
+                                             result.data()));
+    }
+    state.SetItemsProcessed(state.iterations()
+                            * (state.range(0) + state.range(1)));
+}
+
+static void Naive_kernel(benchmark::State& state)
+{
+    insecure::StdMultiMap index;
+    fill_index(state, &index);
+
+    const std::vector<uint64_t> small = index.search("small");
+    const std::vector<uint64_t> large = index.search("large");
+    std::vector<uint64_t>       result(small.size());
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::set_intersection(small.begin(),
+                                                       small.end(),
+                                                       large.begin(),
+                                                       large.end(),
+                                                       result.begin()));
+    }
+    state.SetItemsProcessed(state.iterations()
+                            * (state.range(0) + state.range(1)));
+}
+
+// (small list size, large list size)
+static void intersection_arguments(benchmark::internal::Benchmark* b)
+{
+    b->Args({1000, 1000})
+        ->Args({10000, 10000})
+        ->Args({100000, 100000})
+        ->Args({1000, 100000})
+        ->Args({100, 1000000});
+}
+
+BENCHMARK(Naive_intersection)->Apply(intersection_arguments);
+BENCHMARK(QueryEngine_intersection)->Apply(intersection_arguments);
+BENCHMARK(Naive_kernel)->Apply(intersection_arguments);
+BENCHMARK(Intersection_kernel)->Apply(intersection_arguments);
+
+} // namespace sse
+
+
+BENCHMARK_MAIN();
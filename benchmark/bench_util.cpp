@@ -1,13 +1,20 @@
+#include "cached_index.hpp"
+#include "external_sorter.hpp"
+#include "frozen_index.hpp"
 #include "index.hpp"
+#include "index_builder.hpp"
 #include "logger.hpp"
 #include "rocksdb_merge_multimap.hpp"
 #include "rocksdb_multimap.hpp"
+#include "segmented_index.hpp"
+#include "sharded_index.hpp"
 #include "utils.hpp"
 #include "wiredtiger_multimap.hpp"
 #include "zipfian_distribution.hpp"
 
 #include <cstdlib>
 
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <map>
@@ -25,6 +32,25 @@ sse::insecure::Index* create_rocksdb_multimap(const std::string& path)
     return new sse::insecure::RocksDBMultiMap(path);
 }
 
+// Number of documents per chunk for the chunked layouts
+constexpr size_t kChunkCapacity = 512;
+
+sse::insecure::Index* create_rocksdb_chunked_multimap(const std::string& path)
+{
+    sse::insecure::RocksDBMultiMap::Options options;
+    options.chunk_capacity = kChunkCapacity;
+    return new sse::insecure::RocksDBMultiMap(path, options);
+}
+
+// Fixed-width hashed keys, in PlainTable files
+sse::insecure::Index* create_rocksdb_hashed_multimap(const std::string& path)
+{
+    sse::insecure::RocksDBMultiMap::Options options;
+    options.key_type    = sse::insecure::KeywordKeyType::Hash64;
+    options.plain_table = true;
+    return new sse::insecure::RocksDBMultiMap(path, options);
+}
+
 sse::insecure::Index* create_rocksdb_merge_multimap(const std::string& path)
 {
     return new sse::insecure::RocksDBMergeMultiMap(path);
@@ -38,6 +64,80 @@ sse::insecure::Index* create_wiredtiger_multimap(const std::string& path)
     return new sse::insecure::WiredTigerMultimap(path);
 }
 
+sse::insecure::Index* create_wiredtiger_chunked_multimap(
+    const std::string& path)
+{
+    // create the directory
+    sse::utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.chunk_capacity = kChunkCapacity;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+// One row per document
+sse::insecure::Index* create_wiredtiger_rows_multimap(const std::string& path)
+{
+    // create the directory
+    sse::utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.document_rows = true;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+// Keys made of the two words of a 128 bits hash of the keyword
+sse::insecure::Index* create_wiredtiger_hashed_multimap(
+    const std::string& path)
+{
+    // create the directory
+    sse::utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.key_type = sse::insecure::KeywordKeyType::Hash128;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+// Append by rewriting the whole list, instead of a partial update
+sse::insecure::Index* create_wiredtiger_rewrite_multimap(
+    const std::string& path)
+{
+    // create the directory
+    sse::utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.append_mode
+        = sse::insecure::WiredTigerMultimap::AppendMode::Rewrite;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+// One shard per core
+size_t shard_count()
+{
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+sse::insecure::Index* create_sharded_rocksdb_multimap(const std::string& path)
+{
+    sse::insecure::ShardedIndex::Options options;
+    options.shard_count = shard_count();
+    return new sse::insecure::ShardedIndex(
+        path, &create_rocksdb_multimap, options);
+}
+
+sse::insecure::Index* create_sharded_wiredtiger_multimap(
+    const std::string& path)
+{
+    sse::insecure::ShardedIndex::Options options;
+    options.shard_count = shard_count();
+    return new sse::insecure::ShardedIndex(
+        path, &create_wiredtiger_multimap, options);
+}
+
+sse::insecure::Index* create_segmented_index(const std::string& path)
+{
+    return new sse::insecure::SegmentedIndex(path);
+}
 
 struct DBCreationBenchmark : public sse::Benchmark
 {
@@ -52,12 +152,25 @@ struct DBCreationBenchmark : public sse::Benchmark
 using database_stats_type        = std::vector<size_t>;
 using database_atomic_stats_type = std::vector<std::atomic<size_t>>;
 
+// The keywords of the test databases. They are formatted once, so that the
+// allocation of the keyword strings is not measured with the index.
+std::vector<std::string> keyword_strings(size_t n_keywords)
+{
+    std::vector<std::string> keywords;
+    keywords.reserve(n_keywords);
+    for (size_t i = 0; i < n_keywords; i++) {
+        keywords.push_back(std::to_string(i));
+    }
+    return keywords;
+}
+
 database_stats_type create_test_database(const std::string& base_path,
                                          const std::string& index_type,
                                          CreateIndexFunc*   index_factory,
                                          const size_t       n_keywords,
                                          const size_t       n_entries,
-                                         const size_t       thread_count)
+                                         const size_t       thread_count,
+                                         const size_t       batch_size)
 {
     if (thread_count < 1) {
         throw std::invalid_argument("thread_count must be >= 1");
@@ -70,12 +183,9 @@ database_stats_type create_test_database(const std::string& base_path,
 
     std::unique_ptr<sse::insecure::Index> index((*index_factory)(path));
 
-    std::random_device rd;
-    std::mt19937       gen(rd());
+    const std::vector<std::string> keywords = keyword_strings(n_keywords);
 
-    sse::ZipfianDistribution<size_t, double> kw_distrib(1.2, 0, n_keywords - 1);
-    std::uniform_int_distribution<sse::insecure::Index::document_type>
-        doc_distrib;
+    std::random_device rd;
 
     std::atomic<size_t> n_entries_processed{0};
     // database_stats_type n_entries_per_kw(n_keywords);
@@ -100,6 +210,11 @@ database_stats_type create_test_database(const std::string& base_path,
         }
     }
 
+    std::vector<std::mt19937::result_type> seeds(thread_count);
+    for (auto& seed : seeds) {
+        seed = rd();
+    }
+
     std::vector<std::thread> threads;
     threads.reserve(thread_count);
     // n_entries_per_kw_vec.reserve(thread_count);
@@ -110,13 +225,38 @@ database_stats_type create_test_database(const std::string& base_path,
             [&](size_t t_id) {
                 n_entries_per_kw_vec[t_id]
                     = database_atomic_stats_type(n_keywords);
+
+                // the generator and the distributions are not thread safe
+                std::mt19937                             gen(seeds[t_id]);
+                sse::ZipfianDistribution<size_t, double> kw_distrib(
+                    1.2, 0, n_keywords - 1);
+                std::uniform_int_distribution<
+                    sse::insecure::Index::document_type>
+                    doc_distrib;
+
+                std::vector<sse::insecure::Index::entry_type> batch;
+                batch.reserve(batch_size);
+
                 for (; n_entries_processed < n_entries; n_entries_processed++) {
                     size_t                              r   = kw_distrib(gen);
                     sse::insecure::Index::document_type doc = doc_distrib(gen);
 
-                    index->insert(std::to_string(r), doc);
+                    if (batch_size <= 1) {
+                        index->insert(keywords[r], doc);
+                    } else {
+                        batch.emplace_back(keywords[r], doc);
+
+                        if (batch.size() >= batch_size) {
+                            index->insert_batch(batch);
+                            batch.clear();
+                        }
+                    }
                     n_entries_per_kw_vec[t_id][r]++;
                 }
+
+                if (!batch.empty()) {
+                    index->insert_batch(batch);
+                }
             },
             i);
     }
@@ -146,6 +286,150 @@ database_stats_type create_test_database(const std::string& base_path,
     return ret;
 }
 
+void print_bulk_load_stats(
+    const std::string&                             index_type,
+    const sse::insecure::RocksDBBulkLoader::Stats& stats)
+{
+    std::cerr << "[" << index_type << "] Bulk load completed: "
+              << stats.keyword_count << " keywords, " << stats.run_count
+              << " sorted runs, " << stats.file_count << " SST files\n";
+}
+
+void print_bulk_load_stats(
+    const std::string&                          index_type,
+    const sse::insecure::ExternalSorter::Stats& stats)
+{
+    std::cerr << "[" << index_type << "] Bulk load completed: "
+              << stats.keyword_count << " keywords, " << stats.run_count
+              << " sorted runs\n";
+}
+
+// Build the database with the bulk load of a backend. The factory must create
+// a BulkIndex.
+template<class BulkIndex, class BulkLoadOptions>
+void bulk_load_test_database(const std::string&     base_path,
+                             const std::string&     index_type,
+                             CreateIndexFunc*       index_factory,
+                             const size_t           n_keywords,
+                             const size_t           n_entries,
+                             const BulkLoadOptions& options)
+{
+    std::string path = base_path + "/" + index_type;
+
+    std::cerr << "[" << index_type << "] Bulk loading the database at " << path
+              << "\n";
+
+    std::unique_ptr<sse::insecure::Index> index((*index_factory)(path));
+    BulkIndex* bulk_index = static_cast<BulkIndex*>(index.get());
+
+    const std::vector<std::string> keywords = keyword_strings(n_keywords);
+
+    // Same distribution as create_test_database
+    std::random_device                       rd;
+    std::mt19937                             gen(rd());
+    sse::ZipfianDistribution<size_t, double> kw_distrib(1.2, 0, n_keywords - 1);
+    std::uniform_int_distribution<sse::insecure::Index::document_type>
+        doc_distrib;
+
+    std::atomic<size_t> n_entries_processed{0};
+
+    // The progress only covers the generation and the sort of the pairs
+    sse::ThroughputBenchmark<size_t> throughput_bench(
+        "[" + index_type + "] {2} entries/s sorted, progress: {4} \%",
+        std::chrono::seconds(1),
+        n_entries_processed,
+        n_entries);
+
+    std::cerr << "[" << index_type << "] Start the bulk load...\n";
+
+    DBCreationBenchmark entire_construction_bench(index_type + " bulk load");
+
+    std::thread throughput_bench_thread = throughput_bench.run_loop_in_thread();
+
+    auto source = [&](sse::insecure::Index::entry_type* entry) {
+        if (n_entries_processed >= n_entries) {
+            return false;
+        }
+        entry->first  = keywords[kw_distrib(gen)];
+        entry->second = doc_distrib(gen);
+        n_entries_processed++;
+        return true;
+    };
+
+    auto stats = bulk_index->bulk_load(source, options);
+
+    throughput_bench.stop();
+    entire_construction_bench.stop(n_entries);
+
+    throughput_bench_thread.join();
+
+    print_bulk_load_stats(index_type, stats);
+}
+
+// Build the database with an IndexBuilder, that passes complete lists to the
+// backend
+void build_test_database(
+    const std::string&                          base_path,
+    const std::string&                          index_type,
+    CreateIndexFunc*                            index_factory,
+    const size_t                                n_keywords,
+    const size_t                                n_entries,
+    const sse::insecure::IndexBuilder::Options& options)
+{
+    std::string path = base_path + "/" + index_type;
+
+    std::cerr << "[" << index_type << "] Building the database at " << path
+              << "\n";
+
+    std::unique_ptr<sse::insecure::Index> index((*index_factory)(path));
+
+    const std::vector<std::string> keywords = keyword_strings(n_keywords);
+
+    // Same distribution as create_test_database
+    std::random_device                       rd;
+    std::mt19937                             gen(rd());
+    sse::ZipfianDistribution<size_t, double> kw_distrib(1.2, 0, n_keywords - 1);
+    std::uniform_int_distribution<sse::insecure::Index::document_type>
+        doc_distrib;
+
+    std::atomic<size_t> n_entries_processed{0};
+
+    // The progress only covers the generation of the pairs
+    sse::ThroughputBenchmark<size_t> throughput_bench(
+        "[" + index_type + "] {2} entries/s generated, progress: {4} \%",
+        std::chrono::seconds(1),
+        n_entries_processed,
+        n_entries);
+
+    std::cerr << "[" << index_type << "] Start the build...\n";
+
+    DBCreationBenchmark entire_construction_bench(index_type + " build");
+
+    std::thread throughput_bench_thread = throughput_bench.run_loop_in_thread();
+
+    auto source = [&](sse::insecure::Index::entry_type* entry) {
+        if (n_entries_processed >= n_entries) {
+            return false;
+        }
+        entry->first  = keywords[kw_distrib(gen)];
+        entry->second = doc_distrib(gen);
+        n_entries_processed++;
+        return true;
+    };
+
+    sse::insecure::IndexBuilder::Stats stats
+        = sse::insecure::IndexBuilder(options).build(source, index.get());
+
+    throughput_bench.stop();
+    entire_construction_bench.stop(n_entries);
+
+    throughput_bench_thread.join();
+
+    std::cerr << "[" << index_type << "] Build completed: "
+              << stats.keyword_count << " keywords, " << stats.bucket_count
+              << " buckets\n";
+}
+
 void search_test_database(const std::string& base_path,
                           const std::string& index_type,
                           CreateIndexFunc*   index_factory,
@@ -158,13 +442,15 @@ void search_test_database(const std::string& base_path,
 
     std::unique_ptr<sse::insecure::Index> index((*index_factory)(path));
 
+    const std::vector<std::string> keywords = keyword_strings(n_keywords);
+
     std::cerr << "[" << index_type << "] Start the search benchmark...\n";
 
 
     for (size_t i = 0; i < n_keywords; i++) {
         sse::SearchBenchmark bench(index_type);
         sse::insecure::rocksdb_merge_counter_ = 0;
-        auto result = index->search(std::to_string(i));
+        auto result = index->search(keywords[i]);
 
         bench.set_count(result.size());
         bench.set_locality(sse::insecure::rocksdb_merge_counter_);
@@ -176,6 +462,101 @@ void search_test_database(const std::string& base_path,
     std::cerr << "[" << index_type << "] Search benchmark completed!\n";
 }
 
+void freeze_test_database(const std::string& base_path,
+                          const std::string& index_type,
+                          CreateIndexFunc*   index_factory,
+                          const size_t       n_keywords,
+                          const bool         direct_io)
+{
+    std::string path        = base_path + "/" + index_type;
+    std::string frozen_path = path + ".frozen";
+
+    {
+        std::cerr << "[" << index_type << "] Freezing the database at "
+                  << path << " in " << frozen_path << "\n";
+
+        std::unique_ptr<sse::insecure::Index> index((*index_factory)(path));
+
+        DBCreationBenchmark bench(index_type + " freeze");
+        const auto          stats
+            = sse::insecure::FrozenIndex::build(*index, frozen_path);
+        bench.stop(stats.document_count);
+
+        std::cerr << "[" << index_type << "] Frozen index: "
+                  << stats.keyword_count << " keywords, "
+                  << stats.document_count << " documents, "
+                  << stats.file_size << " bytes, " << stats.seed_count
+                  << " seed(s)\n";
+    }
+
+    sse::insecure::FrozenIndex::Options options;
+    options.direct_io = direct_io;
+    sse::insecure::FrozenIndex index(frozen_path, options);
+
+    const std::vector<std::string> keywords = keyword_strings(n_keywords);
+
+    const std::string bench_name
+        = index_type + (direct_io ? " frozen direct" : " frozen");
+
+    std::cerr << "[" << index_type
+              << "] Start the frozen search benchmark...\n";
+
+    for (size_t i = 0; i < n_keywords; i++) {
+        sse::SearchBenchmark bench(bench_name);
+        auto                 result = index.search(keywords[i]);
+
+        bench.set_count(result.size());
+        bench.stop_trace();
+    }
+
+    std::cerr << "[" << index_type << "] Frozen search benchmark completed!\n";
+}
+
+void cached_search_test_database(const std::string& base_path,
+                                 const std::string& index_type,
+                                 CreateIndexFunc*   index_factory,
+                                 const size_t       n_keywords,
+                                 const size_t       n_queries,
+                                 const size_t       cache_size)
+{
+    std::string path = base_path + "/" + index_type;
+
+    std::cerr << "[" << index_type << "] Loading the database at " << path
+              << "\n";
+
+    sse::insecure::CachedIndex::Options options;
+    options.capacity_bytes = cache_size;
+
+    sse::insecure::CachedIndex index(
+        std::unique_ptr<sse::insecure::Index>((*index_factory)(path)),
+        options);
+
+    std::cerr << "[" << index_type
+              << "] Start the cached search benchmark...\n";
+
+    const std::vector<std::string> keywords = keyword_strings(n_keywords);
+
+    // Same keyword distribution as the one used to generate the database
+    std::random_device                       rd;
+    std::mt19937                             gen(rd());
+    sse::ZipfianDistribution<size_t, double> kw_distrib(1.2, 0, n_keywords - 1);
+
+    sse::CacheBenchmark bench(index_type + " cached");
+
+    size_t n_results = 0;
+    for (size_t i = 0; i < n_queries; i++) {
+        n_results += index.search(keywords[kw_distrib(gen)]).size();
+    }
+
+    bench.set_count(n_queries);
+    bench.set_cache_stats(index.hits(), index.misses());
+    bench.stop_trace();
+
+    std::cerr << "[" << index_type << "] Cached search benchmark completed: "
+              << n_results << " results, " << index.hits() << " hits, "
+              << index.misses() << " misses\n";
+}
+
 void print_database_stats(const database_stats_type& stats, size_t kw_count)
 {
     std::cout << "Stats of the database: \n";
@@ -200,11 +581,24 @@ void print_usage()
                  "\n\t<index_type> must be "
                  "chosen from the following list:\n"
                  "\t\tRocksDB\n "
+                 "\t\tRocksDBChunked\n "
+                 "\t\tRocksDBHashed\n "
                  "\t\tRocksDBMerge\n "
                  "\t\tWiredTiger\n"
+                 "\t\tWiredTigerChunked\n"
+                 "\t\tWiredTigerHashed\n"
+                 "\t\tWiredTigerRewrite\n"
+                 "\t\tWiredTigerRows\n"
+                 "\t\tShardedRocksDB\n"
+                 "\t\tShardedWiredTiger\n"
+                 "\t\tSegmented\n"
                  "\n\t<action> must be chosen from the following list:\n"
                  "\t\tgenerate\n "
-                 "\t\tsearch\n ";
+                 "\t\tbulk_load\n "
+                 "\t\tbuild\n "
+                 "\t\tsearch\n "
+                 "\t\tcached_search\n "
+                 "\t\tfreeze\n ";
 }
 int main(int argc, char* argv[])
 {
@@ -224,18 +618,54 @@ int main(int argc, char* argv[])
     if (strcasecmp(arg_index_type, "RocksDB") == 0) {
         index_factory = &create_rocksdb_multimap;
         index_type    = "RocksDB";
+    } else if (strcasecmp(arg_index_type, "RocksDBChunked") == 0) {
+        index_factory = &create_rocksdb_chunked_multimap;
+        index_type    = "RocksDBChunked";
+    } else if (strcasecmp(arg_index_type, "RocksDBHashed") == 0) {
+        index_factory = &create_rocksdb_hashed_multimap;
+        index_type    = "RocksDBHashed";
     } else if (strcasecmp(arg_index_type, "RocksDBMerge") == 0) {
         index_factory = &create_rocksdb_merge_multimap;
         index_type    = "RocksDBMerge";
     } else if (strcasecmp(arg_index_type, "WiredTiger") == 0) {
         index_factory = &create_wiredtiger_multimap;
         index_type    = "WiredTiger";
+    } else if (strcasecmp(arg_index_type, "WiredTigerChunked") == 0) {
+        index_factory = &create_wiredtiger_chunked_multimap;
+        index_type    = "WiredTigerChunked";
+    } else if (strcasecmp(arg_index_type, "WiredTigerHashed") == 0) {
+        index_factory = &create_wiredtiger_hashed_multimap;
+        index_type    = "WiredTigerHashed";
+    } else if (strcasecmp(arg_index_type, "WiredTigerRewrite") == 0) {
+        index_factory = &create_wiredtiger_rewrite_multimap;
+        index_type    = "WiredTigerRewrite";
+    } else if (strcasecmp(arg_index_type, "WiredTigerRows") == 0) {
+        index_factory = &create_wiredtiger_rows_multimap;
+        index_type    = "WiredTigerRows";
+    } else if (strcasecmp(arg_index_type, "ShardedRocksDB") == 0) {
+        index_factory = &create_sharded_rocksdb_multimap;
+        index_type    = "ShardedRocksDB";
+    } else if (strcasecmp(arg_index_type, "ShardedWiredTiger") == 0) {
+        index_factory = &create_sharded_wiredtiger_multimap;
+        index_type    = "ShardedWiredTiger";
+    } else if (strcasecmp(arg_index_type, "Segmented") == 0) {
+        index_factory = &create_segmented_index;
+        index_type    = "Segmented";
     } else {
         std::cerr << "Invalid index type. <index_type> must be "
                      "chosen from the following list:\n"
                      "\t\tRocksDB\n "
+                     "\t\tRocksDBChunked\n "
+                     "\t\tRocksDBHashed\n "
                      "\t\tRocksDBMerge\n "
-                     "\t\tWiredTiger\n";
+                     "\t\tWiredTiger\n"
+                     "\t\tWiredTigerChunked\n"
+                     "\t\tWiredTigerHashed\n"
+                     "\t\tWiredTigerRewrite\n"
+                     "\t\tWiredTigerRows\n"
+                     "\t\tShardedRocksDB\n"
+                     "\t\tShardedWiredTiger\n"
+                     "\t\tSegmented\n";
         ;
         return -1;
     }
@@ -247,8 +677,10 @@ int main(int argc, char* argv[])
 
     if (strcasecmp(action, "generate") == 0) {
         if (argc <= 5) {
-            std::cerr << "The \"generate\" action takes two options:\n"
-                         "\t\tgenerate <n_keywords> <n_entries>\n";
+            std::cerr << "The \"generate\" action takes two options, and an "
+                         "optional batch size and thread count:\n"
+                         "\t\tgenerate <n_keywords> <n_entries> "
+                         "[<batch_size> [<n_threads>]]\n";
             return -1;
         }
         if (!sse::utility::is_directory(base_path)
@@ -262,8 +694,22 @@ int main(int argc, char* argv[])
         size_t n_keywords = atoll(argv[4]);
         size_t n_entries  = atoll(argv[5]);
         size_t n_threads  = 1;
+        size_t batch_size = 1;
+
+        if (argc > 6) {
+            batch_size = atoll(argv[6]);
+        }
+        if (argc > 7) {
+            n_threads = std::max<size_t>(atoll(argv[7]), 1);
+        }
 
-        if (index_type == "RocksDBMerge") {
+        // The inserts of RocksDBMultiMap are unsynchronized read-modify-writes
+        if ((index_type == "RocksDB" || index_type == "RocksDBChunked"
+             || index_type == "RocksDBHashed")
+            && n_threads > 1) {
+            std::cerr << index_type
+                      << " does not support concurrent inserts, using a "
+                         "single thread\n";
             n_threads = 1;
         }
 
@@ -272,6 +718,9 @@ int main(int argc, char* argv[])
         std::cerr << "Number of distinct keywords: "
                   << std::to_string(n_keywords) << "\n";
         std::cerr << "Number of entries: " << std::to_string(n_entries) << "\n";
+        std::cerr << "Batch size: " << std::to_string(batch_size) << "\n";
+        std::cerr << "Number of threads: " << std::to_string(n_threads)
+                  << "\n";
 
 
         database_stats_type stats = create_test_database(base_path,
@@ -279,9 +728,116 @@ int main(int argc, char* argv[])
                                                          index_factory,
                                                          n_keywords,
                                                          n_entries,
-                                                         n_threads);
+                                                         n_threads,
+                                                         batch_size);
 
         // print_database_stats(stats);
+    } else if (strcasecmp(action, "bulk_load") == 0) {
+        if (argc <= 5) {
+            std::cerr << "The \"bulk_load\" action takes two options, and an "
+                         "optional run size (in MB) and thread count:\n"
+                         "\t\tbulk_load <n_keywords> <n_entries> "
+                         "[<run_size> [<n_threads>]]\n";
+            return -1;
+        }
+        if (!sse::utility::is_directory(base_path)
+            && !sse::utility::create_directory(base_path,
+                                               static_cast<mode_t>(0700))) {
+            throw std::runtime_error(std::string(base_path)
+                                     + ": unable to create directory");
+        }
+
+        size_t n_keywords = atoll(argv[4]);
+        size_t n_entries  = atoll(argv[5]);
+
+        sse::insecure::RocksDBBulkLoader::Options rocksdb_options;
+        sse::insecure::ExternalSorter::Options    sort_options;
+        if (argc > 6) {
+            rocksdb_options.run_capacity_bytes = atoll(argv[6]) * 1024 * 1024;
+            sort_options.run_capacity_bytes
+                = rocksdb_options.run_capacity_bytes;
+        }
+        if (argc > 7) {
+            rocksdb_options.thread_count = std::max<size_t>(atoll(argv[7]), 1);
+            sort_options.thread_count    = rocksdb_options.thread_count;
+        }
+
+        std::cerr << "Bulk loading a new index\n";
+        std::cerr << "Chosen index type: " << index_type << "\n";
+        std::cerr << "Number of distinct keywords: "
+                  << std::to_string(n_keywords) << "\n";
+        std::cerr << "Number of entries: " << std::to_string(n_entries) << "\n";
+
+        if (index_type == "RocksDB" || index_type == "RocksDBChunked") {
+            bulk_load_test_database<sse::insecure::RocksDBMultiMap>(
+                base_path,
+                index_type,
+                index_factory,
+                n_keywords,
+                n_entries,
+                rocksdb_options);
+        } else if (index_type == "RocksDBMerge") {
+            bulk_load_test_database<sse::insecure::RocksDBMergeMultiMap>(
+                base_path,
+                index_type,
+                index_factory,
+                n_keywords,
+                n_entries,
+                rocksdb_options);
+        } else if (index_type == "WiredTiger"
+                   || index_type == "WiredTigerChunked"
+                   || index_type == "WiredTigerHashed"
+                   || index_type == "WiredTigerRewrite"
+                   || index_type == "WiredTigerRows") {
+            bulk_load_test_database<sse::insecure::WiredTigerMultimap>(
+                base_path,
+                index_type,
+                index_factory,
+                n_keywords,
+                n_entries,
+                sort_options);
+        } else {
+            std::cerr << "The \"bulk_load\" action is not supported by the "
+                         "sharded index types, nor by RocksDBHashed\n";
+            return -1;
+        }
+    } else if (strcasecmp(action, "build") == 0) {
+        if (argc <= 5) {
+            std::cerr << "The \"build\" action takes two options, and an "
+                         "optional thread count:\n"
+                         "\t\tbuild <n_keywords> <n_entries> [<n_threads>]\n";
+            return -1;
+        }
+        if (!sse::utility::is_directory(base_path)
+            && !sse::utility::create_directory(base_path,
+                                               static_cast<mode_t>(0700))) {
+            throw std::runtime_error(std::string(base_path)
+                                     + ": unable to create directory");
+        }
+
+        size_t n_keywords = atoll(argv[4]);
+        size_t n_entries  = atoll(argv[5]);
+
+        // All the index types support concurrent put_list calls for distinct
+        // keywords
+        sse::insecure::IndexBuilder::Options options;
+        options.concurrent_puts = true;
+        if (argc > 6) {
+            options.thread_count = std::max<size_t>(atoll(argv[6]), 1);
+        }
+
+        std::cerr << "Building a new index\n";
+        std::cerr << "Chosen index type: " << index_type << "\n";
+        std::cerr << "Number of distinct keywords: "
+                  << std::to_string(n_keywords) << "\n";
+        std::cerr << "Number of entries: " << std::to_string(n_entries) << "\n";
+
+        build_test_database(base_path,
+                            index_type,
+                            index_factory,
+                            n_keywords,
+                            n_entries,
+                            options);
     } else if (strcasecmp(action, "search") == 0) {
         if (argc <= 4) {
             std::cerr << "The \"search\" action takes one options:\n"
@@ -293,11 +849,54 @@ int main(int argc, char* argv[])
         size_t n_keywords = atoll(argv[4]);
 
         search_test_database(base_path, index_type, index_factory, n_keywords);
+    } else if (strcasecmp(action, "cached_search") == 0) {
+        if (argc <= 5) {
+            std::cerr << "The \"cached_search\" action takes two options, and "
+                         "an optional cache size (in MB):\n"
+                         "\t\tcached_search <n_keywords> <n_queries> "
+                         "[<cache_size>]\n";
+            return -1;
+        }
+        std::cerr << "Cached search benchmark for index type: " << index_type
+                  << "\n";
+
+        size_t n_keywords = atoll(argv[4]);
+        size_t n_queries  = atoll(argv[5]);
+        size_t cache_size = 64;
+
+        if (argc > 6) {
+            cache_size = atoll(argv[6]);
+        }
+
+        cached_search_test_database(base_path,
+                                    index_type,
+                                    index_factory,
+                                    n_keywords,
+                                    n_queries,
+                                    cache_size * 1024 * 1024);
+    } else if (strcasecmp(action, "freeze") == 0) {
+        if (argc <= 4) {
+            std::cerr << "The \"freeze\" action takes one option, and an "
+                         "optional read mode (mmap or direct):\n"
+                         "\t\tfreeze <n_keywords> [<mode>]\n";
+            return -1;
+        }
+        std::cerr << "Freeze benchmark for index type: " << index_type << "\n";
+
+        size_t n_keywords = atoll(argv[4]);
+        bool   direct_io  = (argc > 5) && (strcasecmp(argv[5], "direct") == 0);
+
+        freeze_test_database(
+            base_path, index_type, index_factory, n_keywords, direct_io);
     } else {
         std::cerr << "Invalid action type. <action> must be "
                      "chosen from the following list:\n"
                      "\t\tgenerate\n "
-                     "\t\tsearch\n ";
+                     "\t\tbulk_load\n "
+                     "\t\tbuild\n "
+                     "\t\tsearch\n "
+                     "\t\tcached_search\n "
+                     "\t\tfreeze\n ";
         ;
         return -1;
     }
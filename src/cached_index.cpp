@@ -0,0 +1,290 @@
+#include "cached_index.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+// Estimated memory overhead of an entry, besides its list and keyword: the
+// vector and shared pointer control blocks, the hash table node, the slot.
+constexpr size_t kEntryOverhead = 128;
+
+size_t entry_size(const Index::keyword_type&               keyword,
+                  const std::vector<Index::document_type>& list)
+{
+    return kEntryOverhead + keyword.size()
+           + list.size() * sizeof(Index::document_type);
+}
+} // namespace
+
+CachedIndex::CachedIndex(std::unique_ptr<Index> backend)
+    : CachedIndex(std::move(backend), Options())
+{
+}
+
+CachedIndex::CachedIndex(std::unique_ptr<Index> backend,
+                         const Options&         options)
+    : m_backend(std::move(backend)),
+      m_shard_count(std::max<size_t>(options.shard_count, 1)),
+      m_shard_capacity(options.capacity_bytes / m_shard_count),
+      m_shards(new Shard[m_shard_count])
+{
+}
+
+std::vector<Index::document_type> CachedIndex::search(
+    const Index::keyword_type& keyword) const
+{
+    list_pointer list = lookup(keyword);
+    if (!list) {
+        list = fetch(keyword);
+    }
+    return *list;
+}
+
+void CachedIndex::search(const Index::keyword_type&          keyword,
+                         const Index::document_visitor_type& visitor) const
+{
+    list_pointer list = lookup(keyword);
+    if (!list) {
+        list = fetch(keyword);
+    }
+
+    // the list is kept alive by the shared pointer, even if it is evicted
+    // during the visit
+    if (!list->empty()) {
+        visitor(list->data(), list->size());
+    }
+}
+
+Index::MultiSearchResult CachedIndex::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    std::vector<list_pointer> lists(keywords.size());
+
+    // Only the missing lists are fetched from the backend, in a single call
+    std::vector<Index::keyword_type> missing_keywords;
+    std::vector<size_t>              missing_positions;
+    std::vector<uint64_t>            generations;
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        lists[i] = lookup(keywords[i]);
+
+        if (!lists[i]) {
+            Shard& s = shard(keywords[i]);
+            {
+                std::lock_guard<std::mutex> lock(s.mtx);
+                generations.push_back(s.generation);
+            }
+            missing_keywords.push_back(keywords[i]);
+            missing_positions.push_back(i);
+        }
+    }
+
+    if (!missing_keywords.empty()) {
+        Index::MultiSearchResult fetched
+            = m_backend->search_many(missing_keywords);
+
+        for (size_t j = 0; j < missing_keywords.size(); j++) {
+            list_pointer list
+                = std::make_shared<const std::vector<document_type>>(
+                    fetched.list(j), fetched.list(j) + fetched.list_size(j));
+
+            admit(shard(missing_keywords[j]),
+                  missing_keywords[j],
+                  list,
+                  generations[j]);
+            lists[missing_positions[j]] = std::move(list);
+        }
+    }
+
+    size_t total_size = 0;
+    for (const auto& list : lists) {
+        total_size += list->size();
+    }
+
+    Index::MultiSearchResult result(keywords.size());
+    result.reserve(total_size);
+    for (size_t i = 0; i < keywords.size(); i++) {
+        result.set_list(i, lists[i]->data(), lists[i]->size());
+    }
+    return result;
+}
+
+void CachedIndex::insert(const Index::keyword_type& keyword,
+                         Index::document_type       document)
+{
+    m_backend->insert(keyword, document);
+    invalidate(keyword);
+}
+
+void CachedIndex::insert_batch(const std::vector<Index::entry_type>& entries)
+{
+    m_backend->insert_batch(entries);
+
+    std::vector<Index::keyword_type> keywords;
+    keywords.reserve(entries.size());
+    for (const auto& entry : entries) {
+        keywords.push_back(entry.first);
+    }
+    std::sort(keywords.begin(), keywords.end());
+    keywords.erase(std::unique(keywords.begin(), keywords.end()),
+                   keywords.end());
+
+    for (const auto& keyword : keywords) {
+        invalidate(keyword);
+    }
+}
+
+void CachedIndex::put_list(const Index::keyword_type&  keyword,
+                           const Index::document_type* documents,
+                           size_t                      n)
+{
+    m_backend->put_list(keyword, documents, n);
+    invalidate(keyword);
+}
+
+void CachedIndex::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    m_backend->for_each_keyword(visitor);
+}
+
+size_t CachedIndex::memory_usage() const
+{
+    size_t usage = 0;
+    for (size_t i = 0; i < m_shard_count; i++) {
+        std::lock_guard<std::mutex> lock(m_shards[i].mtx);
+        usage += m_shards[i].used_bytes;
+    }
+    return usage;
+}
+
+CachedIndex::Shard& CachedIndex::shard(const Index::keyword_type& keyword) const
+{
+    return m_shards[std::hash<Index::keyword_type>()(keyword) % m_shard_count];
+}
+
+CachedIndex::list_pointer CachedIndex::lookup(
+    const Index::keyword_type& keyword) const
+{
+    Shard&                      s = shard(keyword);
+    std::lock_guard<std::mutex> lock(s.mtx);
+
+    auto it = s.slots.find(keyword);
+    if (it == s.slots.end()) {
+        m_misses++;
+        return nullptr;
+    }
+
+    Entry& entry     = s.entries[it->second];
+    entry.referenced = true;
+    m_hits++;
+    return entry.list;
+}
+
+CachedIndex::list_pointer CachedIndex::fetch(
+    const Index::keyword_type& keyword) const
+{
+    Shard&   s = shard(keyword);
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(s.mtx);
+        generation = s.generation;
+    }
+
+    list_pointer list = std::make_shared<const std::vector<document_type>>(
+        m_backend->search(keyword));
+
+    admit(s, keyword, list, generation);
+    return list;
+}
+
+void CachedIndex::admit(Shard&                     s,
+                        const Index::keyword_type& keyword,
+                        list_pointer               list,
+                        uint64_t                   generation) const
+{
+    const size_t bytes = entry_size(keyword, *list);
+
+    std::lock_guard<std::mutex> lock(s.mtx);
+
+    // the list might be stale, or another thread might have cached it
+    if (s.generation != generation || s.slots.count(keyword) != 0) {
+        return;
+    }
+    if (!make_room(s, bytes)) {
+        return;
+    }
+
+    size_t slot;
+    if (s.free_slots.empty()) {
+        slot = s.entries.size();
+        s.entries.emplace_back();
+    } else {
+        slot = s.free_slots.back();
+        s.free_slots.pop_back();
+    }
+
+    Entry& entry     = s.entries[slot];
+    entry.keyword    = keyword;
+    entry.list       = std::move(list);
+    entry.bytes      = bytes;
+    entry.referenced = false;
+
+    s.slots.emplace(keyword, slot);
+    s.used_bytes += bytes;
+}
+
+void CachedIndex::invalidate(const Index::keyword_type& keyword)
+{
+    Shard&                      s = shard(keyword);
+    std::lock_guard<std::mutex> lock(s.mtx);
+
+    s.generation++;
+
+    auto it = s.slots.find(keyword);
+    if (it == s.slots.end()) {
+        return;
+    }
+
+    Entry& entry = s.entries[it->second];
+    s.used_bytes -= entry.bytes;
+    entry = Entry();
+
+    s.free_slots.push_back(it->second);
+    s.slots.erase(it);
+}
+
+bool CachedIndex::make_room(Shard& s, size_t bytes) const
+{
+    if (bytes > m_shard_capacity) {
+        return false;
+    }
+
+    // CLOCK: sweep the slots, giving a second chance to the entries that were
+    // referenced since the last sweep
+    while (s.used_bytes + bytes > m_shard_capacity) {
+        if (s.hand >= s.entries.size()) {
+            s.hand = 0;
+        }
+        Entry& entry = s.entries[s.hand];
+
+        if (entry.list) {
+            if (entry.referenced) {
+                entry.referenced = false;
+            } else {
+                s.used_bytes -= entry.bytes;
+                s.slots.erase(entry.keyword);
+                s.free_slots.push_back(s.hand);
+                entry = Entry();
+            }
+        }
+        s.hand++;
+    }
+    return true;
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Decorator caching the decoded document lists of a backend.
+//
+// The cache is split in shards, each protected by its own mutex and evicting
+// its entries with the CLOCK algorithm when its share of the memory budget is
+// exceeded. The cached lists are immutable and reference counted: a search
+// never copies a list while holding a shard lock.
+// Inserts are forwarded to the backend and invalidate the cached list of
+// their keyword.
+class CachedIndex : public Index
+{
+public:
+    struct Options
+    {
+        // Maximum memory used by the cached lists (and their keywords)
+        size_t capacity_bytes{64 * 1024 * 1024};
+        // Number of independent shards
+        size_t shard_count{16};
+    };
+
+    explicit CachedIndex(std::unique_ptr<Index> backend);
+    CachedIndex(std::unique_ptr<Index> backend, const Options& options);
+
+    using Index::search;
+
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const override;
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document) override;
+    void insert_batch(const std::vector<Index::entry_type>& entries) override;
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n) override;
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    size_t hits() const
+    {
+        return m_hits;
+    }
+    size_t misses() const
+    {
+        return m_misses;
+    }
+    void reset_counters()
+    {
+        m_hits   = 0;
+        m_misses = 0;
+    }
+
+    // Memory currently used by the cached lists
+    size_t memory_usage() const;
+
+private:
+    using list_pointer = std::shared_ptr<const std::vector<document_type>>;
+
+    struct Entry
+    {
+        Index::keyword_type keyword;
+        list_pointer        list;
+        size_t              bytes{0};
+        bool                referenced{false};
+    };
+
+    struct Shard
+    {
+        std::mutex mtx;
+
+        std::unordered_map<Index::keyword_type, size_t> slots;
+        std::vector<Entry>                              entries;
+        std::vector<size_t>                             free_slots;
+
+        size_t hand{0};
+        size_t used_bytes{0};
+        // Incremented by every invalidation, so that a list read from the
+        // backend before an insert is not cached after it
+        uint64_t generation{0};
+    };
+
+    Shard& shard(const Index::keyword_type& keyword) const;
+
+    // Return the cached list of keyword, or nullptr
+    list_pointer lookup(const Index::keyword_type& keyword) const;
+
+    // Fetch the list of keyword from the backend, and cache it
+    list_pointer fetch(const Index::keyword_type& keyword) const;
+
+    // Cache list if the shard was not invalidated since generation
+    void admit(Shard&                     shard,
+               const Index::keyword_type& keyword,
+               list_pointer               list,
+               uint64_t                   generation) const;
+
+    void invalidate(const Index::keyword_type& keyword);
+
+    // Evict entries until bytes more bytes fit in the shard. Returns false if
+    // the shard is too small.
+    bool make_room(Shard& shard, size_t bytes) const;
+
+    std::unique_ptr<Index>   m_backend;
+    const size_t             m_shard_count;
+    const size_t             m_shard_capacity;
+    std::unique_ptr<Shard[]> m_shards;
+
+    mutable std::atomic<size_t> m_hits{0};
+    mutable std::atomic<size_t> m_misses{0};
+};
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,294 @@
+#include "concurrent_hash_multimap.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+// The tables are grown when they are more than 3/4 full
+constexpr size_t kMaxLoadNumerator   = 3;
+constexpr size_t kMaxLoadDenominator = 4;
+
+constexpr size_t kMinSlotCount        = 16;
+constexpr size_t kMinPostingsCapacity = 4;
+
+size_t keyword_hash(const Index::keyword_type& keyword)
+{
+    return std::hash<Index::keyword_type>()(keyword);
+}
+} // namespace
+
+ConcurrentHashMultiMap::Postings::Postings(size_t cap)
+    : capacity(cap), documents(new Index::document_type[cap])
+{
+}
+
+ConcurrentHashMultiMap::Node::Node(const Index::keyword_type& kw,
+                                   size_t                     h,
+                                   Postings*                  p)
+    : keyword(kw), hash(h), postings(p)
+{
+}
+
+ConcurrentHashMultiMap::Node::~Node()
+{
+    delete postings.load();
+}
+
+ConcurrentHashMultiMap::Table::Table(size_t n)
+    : size(n), slots(new std::atomic<Node*>[n])
+{
+    for (size_t i = 0; i < n; i++) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ConcurrentHashMultiMap::Stripe::~Stripe()
+{
+    delete table.load();
+}
+
+ConcurrentHashMultiMap::ConcurrentHashMultiMap()
+    : ConcurrentHashMultiMap(Options())
+{
+}
+
+ConcurrentHashMultiMap::ConcurrentHashMultiMap(const Options& options)
+{
+    if (options.stripe_count == 0) {
+        throw std::invalid_argument("The stripe count must be positive");
+    }
+
+    m_stripes.reserve(options.stripe_count);
+    for (size_t i = 0; i < options.stripe_count; i++) {
+        m_stripes.emplace_back(new Stripe());
+    }
+}
+
+// The readers are gone: the retired objects are freed by the reclaimer, and
+// the published ones by the stripes
+ConcurrentHashMultiMap::~ConcurrentHashMultiMap() = default;
+
+std::vector<Index::document_type> ConcurrentHashMultiMap::search(
+    const Index::keyword_type& keyword) const
+{
+    std::vector<Index::document_type> result;
+
+    search(keyword, [&result](const Index::document_type* docs, size_t n) {
+        result.assign(docs, docs + n);
+    });
+    return result;
+}
+
+void ConcurrentHashMultiMap::search(
+    const Index::keyword_type&          keyword,
+    const Index::document_visitor_type& visitor) const
+{
+    EpochReclaimer::Guard guard(m_reclaimer);
+
+    const Node* node = find(keyword, keyword_hash(keyword));
+    if (node == nullptr) {
+        return;
+    }
+
+    const Postings* postings = node->postings.load();
+    const size_t    size     = postings->size.load(std::memory_order_acquire);
+    if (size > 0) {
+        visitor(postings->documents.get(), size);
+    }
+}
+
+Index::MultiSearchResult ConcurrentHashMultiMap::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    Index::MultiSearchResult result(keywords.size());
+
+    EpochReclaimer::Guard guard(m_reclaimer);
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        const Node* node = find(keywords[i], keyword_hash(keywords[i]));
+        if (node == nullptr) {
+            result.set_list(i, nullptr, 0);
+            continue;
+        }
+
+        const Postings* postings = node->postings.load();
+        result.set_list(i,
+                        postings->documents.get(),
+                        postings->size.load(std::memory_order_acquire));
+    }
+    return result;
+}
+
+void ConcurrentHashMultiMap::insert(const Index::keyword_type& keyword,
+                                    Index::document_type       document)
+{
+    put_list(keyword, &document, 1);
+}
+
+void ConcurrentHashMultiMap::insert_batch(
+    const std::vector<Index::entry_type>& entries)
+{
+    for (const auto& group : Index::group_by_keyword(entries)) {
+        put_list(group.first, group.second.data(), group.second.size());
+    }
+}
+
+void ConcurrentHashMultiMap::put_list(const Index::keyword_type&  keyword,
+                                      const Index::document_type* documents,
+                                      size_t                      n)
+{
+    const size_t hash = keyword_hash(keyword);
+    Stripe&      s    = stripe(hash);
+
+    std::lock_guard<std::mutex> lock(s.mtx);
+
+    Node* node = find(keyword, hash);
+
+    if (node == nullptr) {
+        Postings* postings = new Postings(std::max(kMinPostingsCapacity, n));
+        std::memcpy(postings->documents.get(),
+                    documents,
+                    n * sizeof(Index::document_type));
+        postings->size.store(n, std::memory_order_relaxed);
+
+        publish(s, std::unique_ptr<Node>(new Node(keyword, hash, postings)));
+        return;
+    }
+
+    // The stripe mutex is held: the postings cannot change under us
+    Postings*    postings = node->postings.load(std::memory_order_relaxed);
+    const size_t size     = postings->size.load(std::memory_order_relaxed);
+
+    if (size + n <= postings->capacity) {
+        std::memcpy(postings->documents.get() + size,
+                    documents,
+                    n * sizeof(Index::document_type));
+        postings->size.store(size + n, std::memory_order_release);
+        return;
+    }
+
+    // Replace the array by a larger copy: the readers of the old one keep a
+    // consistent list
+    Postings* grown
+        = new Postings(std::max(2 * postings->capacity, size + n));
+    std::memcpy(grown->documents.get(),
+                postings->documents.get(),
+                size * sizeof(Index::document_type));
+    std::memcpy(grown->documents.get() + size,
+                documents,
+                n * sizeof(Index::document_type));
+    grown->size.store(size + n, std::memory_order_relaxed);
+
+    node->postings.store(grown);
+    m_reclaimer.retire([postings]() { delete postings; });
+}
+
+void ConcurrentHashMultiMap::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    std::vector<Index::keyword_type> keywords;
+    for (const auto& s : m_stripes) {
+        keywords.clear();
+        {
+            std::lock_guard<std::mutex> lock(s->mtx);
+            for (const auto& node : s->nodes) {
+                keywords.push_back(node->keyword);
+            }
+        }
+        for (const auto& keyword : keywords) {
+            visitor(keyword);
+        }
+    }
+}
+
+size_t ConcurrentHashMultiMap::keyword_count() const
+{
+    size_t count = 0;
+    for (const auto& s : m_stripes) {
+        std::lock_guard<std::mutex> lock(s->mtx);
+        count += s->nodes.size();
+    }
+    return count;
+}
+
+ConcurrentHashMultiMap::Stripe& ConcurrentHashMultiMap::stripe(
+    size_t hash) const
+{
+    // The slots are chosen with the low bits of the hash: the stripes use the
+    // high bits
+    return *m_stripes[(static_cast<uint64_t>(hash) >> 32) % m_stripes.size()];
+}
+
+ConcurrentHashMultiMap::Node* ConcurrentHashMultiMap::find(
+    const Index::keyword_type& keyword,
+    size_t                     hash) const
+{
+    const Table* table = stripe(hash).table.load();
+    if (table == nullptr) {
+        return nullptr;
+    }
+
+    // The table is never full: the probe always ends on an empty slot
+    const size_t mask = table->size - 1;
+    for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+        Node* node = table->slots[pos].load();
+
+        if (node == nullptr) {
+            return nullptr;
+        }
+        if (node->hash == hash && node->keyword == keyword) {
+            return node;
+        }
+    }
+}
+
+void ConcurrentHashMultiMap::publish(Stripe& s, std::unique_ptr<Node> node)
+{
+    // The node must not be freed once it is visible
+    s.nodes.reserve(s.nodes.size() + 1);
+
+    Table* table = s.table.load(std::memory_order_relaxed);
+
+    if (table == nullptr
+        || (s.nodes.size() + 1) * kMaxLoadDenominator
+               > table->size * kMaxLoadNumerator) {
+        // Build a larger table with the existing nodes, before publishing it
+        const size_t n_slots
+            = (table == nullptr) ? kMinSlotCount : 2 * table->size;
+        Table* grown = new Table(n_slots);
+
+        for (const auto& n : s.nodes) {
+            size_t pos = n->hash & (n_slots - 1);
+            while (grown->slots[pos].load(std::memory_order_relaxed)
+                   != nullptr) {
+                pos = (pos + 1) & (n_slots - 1);
+            }
+            grown->slots[pos].store(n.get(), std::memory_order_relaxed);
+        }
+
+        s.table.store(grown);
+        if (table != nullptr) {
+            m_reclaimer.retire([table]() { delete table; });
+        }
+        table = grown;
+    }
+
+    const size_t mask = table->size - 1;
+    size_t       pos  = node->hash & mask;
+    while (table->slots[pos].load(std::memory_order_relaxed) != nullptr) {
+        pos = (pos + 1) & mask;
+    }
+
+    // The node is complete before it becomes visible
+    table->slots[pos].store(node.get());
+    s.nodes.push_back(std::move(node));
+}
+
+} // namespace insecure
+} // namespace sse
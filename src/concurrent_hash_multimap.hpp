@@ -0,0 +1,118 @@
+#pragma once
+
+#include "epoch_reclaimer.hpp"
+#include "index.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Thread safe in-memory index, for concurrent writers and readers.
+//
+// The keywords are split in stripes by hash. Every stripe has an open
+// addressing hash table of keywords, pointing to contiguous, growable
+// document arrays, and a mutex serializing its writers: the inserts of
+// keywords of different stripes run in parallel.
+//
+// The searches do not take any lock, and never wait for the inserts. The
+// documents are appended after the end of the published part of an array,
+// and the full arrays and tables are replaced by larger copies. The replaced
+// arrays and tables are freed by an EpochReclaimer once the searches that
+// could read them are over.
+class ConcurrentHashMultiMap : public Index
+{
+public:
+    struct Options
+    {
+        // Number of independent stripes. More stripes reduce the contention
+        // between the writers.
+        size_t stripe_count{64};
+    };
+
+    ConcurrentHashMultiMap();
+    explicit ConcurrentHashMultiMap(const Options& options);
+    ~ConcurrentHashMultiMap();
+
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const override;
+    // The visitor is called once, with the whole list. It must not block:
+    // the memory of the replaced arrays cannot be freed during the call.
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document) override;
+    void insert_batch(const std::vector<Index::entry_type>& entries) override;
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n) override;
+    // The keywords of a stripe are copied before being visited: the visitor
+    // can access the index
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    size_t keyword_count() const;
+
+private:
+    // Documents array. The documents before size are never modified: a
+    // reader that loaded size can read them while a writer appends.
+    struct Postings
+    {
+        explicit Postings(size_t cap);
+
+        const size_t                            capacity;
+        std::atomic<size_t>                     size{0};
+        std::unique_ptr<Index::document_type[]> documents;
+    };
+
+    struct Node
+    {
+        Node(const Index::keyword_type& kw, size_t h, Postings* p);
+        ~Node();
+
+        const Index::keyword_type keyword;
+        const size_t              hash;
+        std::atomic<Postings*>    postings;
+    };
+
+    // Fixed size table of nodes, probed linearly
+    struct Table
+    {
+        explicit Table(size_t n);
+
+        const size_t                          size;
+        std::unique_ptr<std::atomic<Node*>[]> slots;
+    };
+
+    struct Stripe
+    {
+        ~Stripe();
+
+        // Serializes the writers of the stripe
+        std::mutex          mtx;
+        std::atomic<Table*> table{nullptr};
+        // Nodes of the stripe, only accessed by the writers
+        std::vector<std::unique_ptr<Node>> nodes;
+    };
+
+    Stripe& stripe(size_t hash) const;
+
+    // Node of keyword, or nullptr. Must be called with an epoch guard, or the
+    // stripe mutex.
+    Node* find(const Index::keyword_type& keyword, size_t hash) const;
+
+    // Add node to the table of its stripe, and publish it. Must be called
+    // with the stripe mutex.
+    void publish(Stripe& stripe, std::unique_ptr<Node> node);
+
+    std::vector<std::unique_ptr<Stripe>> m_stripes;
+    EpochReclaimer                       m_reclaimer;
+};
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,92 @@
+#include "epoch_reclaimer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace sse {
+namespace insecure {
+
+constexpr size_t   EpochReclaimer::kSlotCount;
+constexpr uint64_t EpochReclaimer::kIdleSlot;
+
+EpochReclaimer::Guard::Guard(const EpochReclaimer& reclaimer)
+    : m_reclaimer(reclaimer), m_slot(reclaimer.enter())
+{
+}
+
+EpochReclaimer::Guard::~Guard()
+{
+    m_reclaimer.exit(m_slot);
+}
+
+EpochReclaimer::~EpochReclaimer()
+{
+    for (auto& retired : m_retired) {
+        retired.second();
+    }
+}
+
+void EpochReclaimer::retire(std::function<void()> deleter)
+{
+    std::lock_guard<std::mutex> lock(m_retired_mutex);
+
+    // The readers starting from now announce a later epoch: they cannot see
+    // the retired object
+    uint64_t epoch = m_epoch.fetch_add(1);
+    m_retired.emplace_back(epoch, std::move(deleter));
+
+    collect();
+}
+
+size_t EpochReclaimer::pending_count() const
+{
+    std::lock_guard<std::mutex> lock(m_retired_mutex);
+    return m_retired.size();
+}
+
+size_t EpochReclaimer::enter() const
+{
+    // Every thread starts its search for a free slot at its own position, so
+    // that the readers rarely compete for a slot
+    static thread_local const size_t first_slot
+        = std::hash<std::thread::id>()(std::this_thread::get_id())
+          % kSlotCount;
+
+    for (size_t slot = first_slot;; slot = (slot + 1) % kSlotCount) {
+        uint64_t idle = kIdleSlot;
+        if (m_slots[slot].epoch.compare_exchange_strong(idle,
+                                                        m_epoch.load())) {
+            return slot;
+        }
+    }
+}
+
+void EpochReclaimer::exit(size_t slot) const
+{
+    m_slots[slot].epoch.store(kIdleSlot, std::memory_order_release);
+}
+
+void EpochReclaimer::collect()
+{
+    uint64_t oldest_reader = kIdleSlot;
+    for (const auto& slot : m_slots) {
+        oldest_reader = std::min(oldest_reader, slot.epoch.load());
+    }
+
+    // An object retired in epoch e is visible to the readers that announced
+    // e or an earlier epoch
+    auto unreachable = std::partition(
+        m_retired.begin(),
+        m_retired.end(),
+        [oldest_reader](const std::pair<uint64_t, std::function<void()>>& r) {
+            return r.first >= oldest_reader;
+        });
+
+    for (auto it = unreachable; it != m_retired.end(); ++it) {
+        it->second();
+    }
+    m_retired.erase(unreachable, m_retired.end());
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Epoch-based reclamation of the memory shared with lock-free readers.
+//
+// The readers announce the epoch in which they started in a slot, for the
+// duration of a Guard. The writers replace the shared objects, and retire the
+// old ones, that are only freed once all the readers that started before
+// their retirement are gone. Neither the readers nor the writers ever wait
+// for each other.
+//
+// The readers must load the shared pointers, and the writers must replace
+// them, with sequentially consistent atomic operations.
+class EpochReclaimer
+{
+public:
+    // Read-side critical section. The objects loaded during the lifetime of
+    // the guard are not freed before its destruction.
+    class Guard
+    {
+    public:
+        explicit Guard(const EpochReclaimer& reclaimer);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        const EpochReclaimer& m_reclaimer;
+        size_t                m_slot;
+    };
+
+    EpochReclaimer() = default;
+    // Frees all the retired objects: there must not be any guard left
+    ~EpochReclaimer();
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    // Call deleter once no reader can access the retired object anymore. The
+    // object must already be unreachable for the new readers. Also frees the
+    // objects retired earlier that became unreachable.
+    void retire(std::function<void()> deleter);
+
+    // Number of retired objects that are not freed yet
+    size_t pending_count() const;
+
+private:
+    // Number of concurrent guards. More readers wait for a free slot.
+    static constexpr size_t kSlotCount = 128;
+
+    static constexpr uint64_t kIdleSlot = UINT64_MAX;
+
+    // Slots are padded to a cache line: the readers do not share lines
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch{kIdleSlot};
+        char                  padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    // Announce the current epoch in a free slot, and return its index
+    size_t enter() const;
+    void   exit(size_t slot) const;
+
+    // Free the retired objects that no reader can access anymore. Must be
+    // called with m_retired_mutex locked.
+    void collect();
+
+    std::atomic<uint64_t>                m_epoch{0};
+    mutable std::array<Slot, kSlotCount> m_slots;
+
+    mutable std::mutex m_retired_mutex;
+    // (epoch of the retirement, deleter)
+    std::vector<std::pair<uint64_t, std::function<void()>>> m_retired;
+};
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,281 @@
+#include "external_sorter.hpp"
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+std::string run_path(const std::string& directory, size_t i)
+{
+    return directory + "/run_" + std::to_string(i);
+}
+
+bool keyword_less(const Index::entry_type& a, const Index::entry_type& b)
+{
+    return a.first < b.first;
+}
+
+// Sort a run, and write it to path as a sequence of lists. Each list is
+// serialized as the length of the keyword, the keyword, the number of
+// documents and the documents, with native integers.
+void write_run(const std::string& path, std::vector<Index::entry_type>* run)
+{
+    // stable: the documents of a keyword stay in the order of the source
+    std::stable_sort(run->begin(), run->end(), keyword_less);
+
+    std::ofstream                     out(path, std::ios::binary);
+    std::vector<Index::document_type> documents;
+
+    for (auto it = run->begin(); it != run->end();) {
+        const Index::keyword_type& keyword = it->first;
+
+        documents.clear();
+        for (; it != run->end() && it->first == keyword; ++it) {
+            documents.push_back(it->second);
+        }
+
+        const uint64_t length      = keyword.size();
+        const uint64_t n_documents = documents.size();
+
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(keyword.data(), length);
+        out.write(reinterpret_cast<const char*>(&n_documents),
+                  sizeof(n_documents));
+        out.write(reinterpret_cast<const char*>(documents.data()),
+                  n_documents * sizeof(Index::document_type));
+    }
+    out.close();
+
+    if (!out) {
+        throw std::runtime_error(path + ": unable to write the run");
+    }
+}
+} // namespace
+
+// Sequential reader of a sorted run: the spilled runs are read from their
+// file, and the last run from memory.
+class ExternalSorter::RunReader
+{
+public:
+    explicit RunReader(const std::string& path)
+        : m_path(path), m_file(path, std::ios::binary)
+    {
+        if (!m_file) {
+            throw std::runtime_error(path + ": unable to open the run");
+        }
+    }
+
+    explicit RunReader(std::vector<Index::entry_type>&& run)
+        : m_run(std::move(run))
+    {
+    }
+
+    // Set *list to the next list of the run. Returns false at the end of the
+    // run.
+    bool next(list_type* list)
+    {
+        if (!m_file.is_open()) {
+            if (m_position == m_run.size()) {
+                return false;
+            }
+            list->first = std::move(m_run[m_position].first);
+            list->second.clear();
+            for (; m_position < m_run.size()
+                   && (list->second.empty()
+                       || m_run[m_position].first == list->first);
+                 m_position++) {
+                list->second.push_back(m_run[m_position].second);
+            }
+            return true;
+        }
+
+        uint64_t length;
+        if (!m_file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+            if (m_file.eof() && m_file.gcount() == 0) {
+                return false;
+            }
+            throw std::runtime_error(m_path + ": truncated run");
+        }
+
+        uint64_t n_documents = 0;
+        list->first.resize(length);
+        m_file.read(&list->first[0], length);
+        m_file.read(reinterpret_cast<char*>(&n_documents),
+                    sizeof(n_documents));
+        if (!m_file) {
+            throw std::runtime_error(m_path + ": truncated run");
+        }
+
+        list->second.resize(n_documents);
+        if (!m_file.read(reinterpret_cast<char*>(list->second.data()),
+                         n_documents * sizeof(Index::document_type))) {
+            throw std::runtime_error(m_path + ": truncated run");
+        }
+        return true;
+    }
+
+private:
+    const std::string              m_path;
+    std::ifstream                  m_file;
+    std::vector<Index::entry_type> m_run;
+    size_t                         m_position{0};
+};
+
+ExternalSorter::ExternalSorter(std::string directory, const Options& options)
+    : m_directory(std::move(directory)),
+      m_run_capacity(options.run_capacity_bytes),
+      m_thread_count(
+          (options.thread_count > 0)
+              ? options.thread_count
+              : std::max<size_t>(std::thread::hardware_concurrency(), 1))
+{
+    if (!utility::is_directory(m_directory)
+        && !utility::create_directory(m_directory,
+                                      static_cast<mode_t>(0700))) {
+        throw std::runtime_error(m_directory + ": unable to create directory");
+    }
+}
+
+ExternalSorter::~ExternalSorter()
+{
+    for (auto& spill : m_spills) {
+        if (spill->thread.joinable()) {
+            spill->thread.join();
+        }
+    }
+
+    // close the runs before removing their files
+    m_runs.clear();
+
+    try {
+        utility::remove_directory(m_directory);
+    } catch (const std::exception& e) {
+        std::cerr << "Unable to remove the sorted runs: " << e.what() << "\n";
+    }
+}
+
+void ExternalSorter::sort(const source_type& source)
+{
+    std::vector<Index::entry_type> run;
+    size_t                         run_bytes = 0;
+    Index::entry_type              entry;
+
+    while (source(&entry)) {
+        m_stats.entry_count++;
+
+        run_bytes += sizeof(Index::entry_type) + entry.first.size();
+        run.push_back(std::move(entry));
+
+        if (run_bytes >= m_run_capacity) {
+            spill_run(std::move(run));
+            run.clear();
+            run_bytes = 0;
+        }
+    }
+
+    while (m_joined_spills < m_spills.size()) {
+        join_spill();
+    }
+
+    for (size_t i = 0; i < m_spills.size(); i++) {
+        m_runs.emplace_back(new RunReader(run_path(m_directory, i)));
+    }
+
+    // The last run is merged directly from memory
+    if (!run.empty()) {
+        std::stable_sort(run.begin(), run.end(), keyword_less);
+        m_runs.emplace_back(new RunReader(std::move(run)));
+    }
+
+    m_stats.run_count = m_runs.size();
+}
+
+void ExternalSorter::merge(const list_consumer_type& consumer)
+{
+    std::vector<list_type> heads(m_runs.size());
+
+    // Min-heap of the runs, ordered by their next keyword. The runs sharing a
+    // keyword are popped in the order of the source.
+    auto greater = [&heads](size_t a, size_t b) {
+        int c = heads[a].first.compare(heads[b].first);
+        return c > 0 || (c == 0 && a > b);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> queue(
+        greater);
+
+    for (size_t i = 0; i < m_runs.size(); i++) {
+        if (m_runs[i]->next(&heads[i])) {
+            queue.push(i);
+        }
+    }
+
+    while (!queue.empty()) {
+        size_t i = queue.top();
+        queue.pop();
+
+        list_type list = std::move(heads[i]);
+        if (m_runs[i]->next(&heads[i])) {
+            queue.push(i);
+        }
+
+        while (!queue.empty() && heads[queue.top()].first == list.first) {
+            size_t j = queue.top();
+            queue.pop();
+
+            list.second.insert(list.second.end(),
+                               heads[j].second.begin(),
+                               heads[j].second.end());
+            if (m_runs[j]->next(&heads[j])) {
+                queue.push(j);
+            }
+        }
+
+        m_stats.keyword_count++;
+        if (!consumer(std::move(list))) {
+            return;
+        }
+    }
+}
+
+void ExternalSorter::spill_run(std::vector<Index::entry_type>&& run)
+{
+    // Bound the number of runs in memory
+    if (m_spills.size() - m_joined_spills >= m_thread_count) {
+        join_spill();
+    }
+
+    std::string path = run_path(m_directory, m_spills.size());
+
+    m_spills.emplace_back(new Spill());
+    Spill* s = m_spills.back().get();
+
+    s->thread = std::thread(
+        [s, path](std::vector<Index::entry_type> entries) {
+            try {
+                write_run(path, &entries);
+            } catch (...) {
+                s->error = std::current_exception();
+            }
+        },
+        std::move(run));
+}
+
+void ExternalSorter::join_spill()
+{
+    Spill& spill = *m_spills[m_joined_spills++];
+
+    spill.thread.join();
+    if (spill.error) {
+        std::rethrow_exception(spill.error);
+    }
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// External sort of (keyword, document) pairs into complete posting lists, for
+// the bulk loads of the persistent backends.
+//
+// The pairs are buffered in runs bounded by a memory budget. Every full run is
+// sorted and spilled to a temporary file by a background thread, while the
+// following pairs are buffered. The runs are then merged into lists, by
+// increasing keyword. The documents of a keyword keep the order of the source.
+class ExternalSorter
+{
+public:
+    // Set *entry to the next pair to sort, or return false once all the pairs
+    // were returned
+    using source_type = std::function<bool(Index::entry_type* entry)>;
+
+    using list_type = std::pair<Index::keyword_type,
+                                std::vector<Index::document_type>>;
+
+    // Called with the merged lists, by increasing keyword. Returns false to
+    // stop the merge.
+    using list_consumer_type = std::function<bool(list_type&& list)>;
+
+    struct Options
+    {
+        // Memory used by the pairs of a run. Up to thread_count full runs can
+        // be sorted while the next one is buffered.
+        size_t run_capacity_bytes{256 * 1024 * 1024};
+        // Number of threads sorting and spilling the full runs. Zero means
+        // one per core.
+        size_t thread_count{0};
+    };
+
+    struct Stats
+    {
+        size_t entry_count{0};
+        size_t keyword_count{0};
+        // Number of sorted runs, including the last one, that stays in memory
+        size_t run_count{0};
+    };
+
+    // The runs are spilled in directory, that is created if needed. The
+    // directory is removed with all its content when the sorter is destroyed:
+    // the callers can put their own temporary files in it.
+    ExternalSorter(std::string directory, const Options& options);
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    // Read all the pairs of source, and sort them. Throws std::runtime_error
+    // if a run cannot be spilled.
+    void sort(const source_type& source);
+
+    // Merge the sorted runs, and pass the lists to consumer. Must be called
+    // once, after sort.
+    void merge(const list_consumer_type& consumer);
+
+    const std::string& directory() const
+    {
+        return m_directory;
+    }
+
+    const Stats& stats() const
+    {
+        return m_stats;
+    }
+
+private:
+    class RunReader;
+
+    // Sort run and write it to the next run file, in a background thread
+    void spill_run(std::vector<Index::entry_type>&& run);
+
+    // Wait for the oldest spilling thread, and rethrow its error, if any
+    void join_spill();
+
+    const std::string m_directory;
+    const size_t      m_run_capacity;
+    const size_t      m_thread_count;
+
+    struct Spill
+    {
+        std::thread        thread;
+        std::exception_ptr error;
+    };
+    std::vector<std::unique_ptr<Spill>> m_spills;
+    size_t                              m_joined_spills{0};
+
+    std::vector<std::unique_ptr<RunReader>> m_runs;
+    Stats                                   m_stats;
+};
+
+} // namespace insecure
+} // namespace sse
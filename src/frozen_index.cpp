@@ -0,0 +1,618 @@
+#include "frozen_index.hpp"
+
+#include "utils.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+constexpr char     kMagic[8] = {'S', 'S', 'E', 'F', 'R', 'Z', 'N', '1'};
+constexpr uint32_t kVersion  = 1;
+
+// Seeds tried before giving up on the hash function. A seed fails when a
+// bucket cannot be placed: always if two keywords of the bucket have the same
+// (f1, f2) modulo the number of slots, as every displacement then sends them
+// to the same slot, and rarely when the last buckets do not find free slots.
+// Each seed fails with a small probability, independently of the others. If
+// all the seeds fail, build() throws std::runtime_error.
+constexpr size_t kMaxSeedCount = 16;
+// Displacements tried for a bucket, in multiples of the number of slots
+constexpr uint64_t kMaxDisplacementRounds = 64;
+
+// Layout of the file:
+// - the header, padded to the alignment
+// - the records, in slot order. A record is the keyword bytes, padded to 8
+//   bytes, and the documents.
+// - the displacements of the buckets
+// - the slots
+// - a padding to the alignment
+struct Header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t document_size;
+    uint64_t seed;
+    uint64_t alignment;
+    uint64_t records_length;
+    uint64_t bucket_count;
+    uint64_t displacements_offset;
+    uint64_t slot_count;
+    uint64_t slots_offset;
+    uint64_t document_count;
+};
+static_assert(sizeof(Header) == 80, "Unexpected frozen index header size");
+
+size_t round_up(size_t n, size_t alignment)
+{
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+// Read length bytes at offset. Returns false on an error or at the end of the
+// file.
+bool read_fully(int fd, void* buffer, size_t length, off_t offset)
+{
+    char* dst = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t done = pread(fd, dst, length, offset);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        dst += done;
+        length -= done;
+        offset += done;
+    }
+    return true;
+}
+
+// FNV-1a from a seeded basis, finalized to spread the bits. The hash is
+// persisted: it must not depend on the platform.
+uint64_t keyword_hash(const char* data, size_t length, uint64_t seed)
+{
+    return utility::mix64(
+        utility::stable_hash(data, length, utility::mix64(seed)));
+}
+
+// Bucket of a keyword, and the two hashes combined with the displacement of
+// the bucket
+struct KeywordHash
+{
+    uint64_t bucket;
+    uint64_t f1;
+    uint64_t f2;
+};
+
+KeywordHash split_hash(uint64_t h, size_t bucket_count, size_t slot_count)
+{
+    return KeywordHash{(h >> 32) % bucket_count,
+                       h % slot_count,
+                       utility::mix64(h) % slot_count};
+}
+
+// The displacement d encodes the pair (d / n, d % n): the small displacements
+// probe the slots following f1, and the larger ones jump by f2
+uint64_t slot_position(const KeywordHash& kh,
+                       uint64_t           displacement,
+                       size_t             slot_count)
+{
+    const uint64_t d0 = (displacement / slot_count) % slot_count;
+    const uint64_t d1 = displacement % slot_count;
+    return (kh.f1 + (d0 * kh.f2) % slot_count + d1) % slot_count;
+}
+
+// Find a displacement for every bucket, so that the keywords are sent to
+// distinct slots. Sets the slot of every keyword in positions. Returns false
+// if a bucket cannot be placed with this seed.
+bool place_keywords(const std::vector<Index::keyword_type>& keywords,
+                    uint64_t                                seed,
+                    std::vector<uint64_t>*                  displacements,
+                    std::vector<uint64_t>*                  positions)
+{
+    const size_t n = keywords.size();
+
+    std::vector<KeywordHash> hashes(n);
+    for (size_t i = 0; i < n; i++) {
+        hashes[i] = split_hash(
+            keyword_hash(keywords[i].data(), keywords[i].size(), seed),
+            displacements->size(),
+            n);
+    }
+
+    // Group the keywords by bucket, and place the largest buckets first,
+    // while most of the slots are free
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&hashes](size_t a, size_t b) {
+        return hashes[a].bucket < hashes[b].bucket;
+    });
+
+    // (position of the first keyword in order, size)
+    std::vector<std::pair<size_t, size_t>> buckets;
+    for (size_t i = 0; i < n; i++) {
+        if (i == 0 || hashes[order[i]].bucket != hashes[order[i - 1]].bucket) {
+            buckets.emplace_back(i, 0);
+        }
+        buckets.back().second++;
+    }
+    std::stable_sort(buckets.begin(),
+                     buckets.end(),
+                     [](const std::pair<size_t, size_t>& a,
+                        const std::pair<size_t, size_t>& b) {
+                         return a.second > b.second;
+                     });
+
+    std::fill(displacements->begin(), displacements->end(), 0);
+    std::vector<bool>     taken(n, false);
+    std::vector<uint64_t> bucket_positions;
+
+    for (const auto& bucket : buckets) {
+        bool placed = false;
+
+        for (uint64_t d = 0; !placed && d < kMaxDisplacementRounds * n; d++) {
+            bucket_positions.clear();
+            placed = true;
+
+            for (size_t k = 0; k < bucket.second; k++) {
+                const uint64_t pos
+                    = slot_position(hashes[order[bucket.first + k]], d, n);
+                if (taken[pos]
+                    || std::count(bucket_positions.begin(),
+                                  bucket_positions.end(),
+                                  pos)
+                           > 0) {
+                    placed = false;
+                    break;
+                }
+                bucket_positions.push_back(pos);
+            }
+
+            if (placed) {
+                for (size_t k = 0; k < bucket.second; k++) {
+                    const size_t keyword = order[bucket.first + k];
+
+                    taken[bucket_positions[k]] = true;
+                    (*positions)[keyword]      = bucket_positions[k];
+                }
+                (*displacements)[hashes[order[bucket.first]].bucket] = d;
+            }
+        }
+        if (!placed) {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+FrozenIndex::Stats FrozenIndex::build(const Index&       source,
+                                      const std::string& path)
+{
+    return build(source, path, BuildOptions());
+}
+
+FrozenIndex::Stats FrozenIndex::build(const Index&        source,
+                                      const std::string&  path,
+                                      const BuildOptions& options)
+{
+    if (options.bucket_size == 0) {
+        throw std::invalid_argument("bucket_size must be >= 1");
+    }
+    if (options.alignment < sizeof(Header)
+        || (options.alignment & (options.alignment - 1)) != 0) {
+        throw std::invalid_argument(
+            "The alignment must be a power of two, larger than the header");
+    }
+
+    // Sorted, so that the file does not depend on the enumeration order
+    std::vector<Index::keyword_type> keywords;
+    source.for_each_keyword([&keywords](const Index::keyword_type& keyword) {
+        keywords.push_back(keyword);
+    });
+    std::sort(keywords.begin(), keywords.end());
+    keywords.erase(std::unique(keywords.begin(), keywords.end()),
+                   keywords.end());
+
+    const size_t n = keywords.size();
+
+    Stats stats;
+    stats.keyword_count = n;
+    stats.bucket_count
+        = std::max<size_t>((n + options.bucket_size - 1) / options.bucket_size,
+                           1);
+
+    std::vector<uint64_t> displacements(stats.bucket_count, 0);
+    std::vector<uint64_t> positions(n);
+    uint64_t              seed  = 0;
+    bool                  found = (n == 0);
+
+    while (!found && stats.seed_count < kMaxSeedCount) {
+        seed  = stats.seed_count++;
+        found = place_keywords(keywords, seed, &displacements, &positions);
+    }
+    if (!found) {
+        throw std::runtime_error(path
+                                 + ": unable to find a perfect hash function");
+    }
+
+    std::vector<size_t> keyword_of_slot(n);
+    for (size_t i = 0; i < n; i++) {
+        keyword_of_slot[positions[i]] = i;
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream     file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error(tmp_path
+                                 + ": unable to create the frozen index");
+    }
+
+    auto write = [&file, &tmp_path](const void* data, size_t length) {
+        if (!file.write(reinterpret_cast<const char*>(data), length)) {
+            throw std::runtime_error(tmp_path
+                                     + ": unable to write the frozen index");
+        }
+    };
+    const std::string padding(options.alignment, '\0');
+
+    try {
+        // The header is only known at the end
+        write(padding.data(), padding.size());
+
+        std::vector<Slot>                 slots(n);
+        std::vector<Index::document_type> list;
+        uint64_t                          records_length = 0;
+
+        for (size_t pos = 0; pos < n; pos++) {
+            const Index::keyword_type& keyword = keywords[keyword_of_slot[pos]];
+            if (keyword.size() > UINT32_MAX) {
+                throw std::runtime_error(path + ": keyword too long");
+            }
+
+            list.clear();
+            source.search(keyword,
+                          [&list](const Index::document_type* docs, size_t m) {
+                              list.insert(list.end(), docs, docs + m);
+                          });
+
+            const size_t keyword_length = round_up(keyword.size(), 8);
+            write(keyword.data(), keyword.size());
+            write(padding.data(), keyword_length - keyword.size());
+            write(list.data(), list.size() * sizeof(Index::document_type));
+
+            slots[pos] = Slot{records_length,
+                              static_cast<uint32_t>(keyword.size()),
+                              0,
+                              list.size()};
+            records_length
+                += keyword_length + list.size() * sizeof(Index::document_type);
+            stats.document_count += list.size();
+        }
+
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version              = kVersion;
+        header.document_size        = sizeof(Index::document_type);
+        header.seed                 = seed;
+        header.alignment            = options.alignment;
+        header.records_length       = records_length;
+        header.bucket_count         = displacements.size();
+        header.displacements_offset = options.alignment + records_length;
+        header.slot_count           = n;
+        header.slots_offset         = header.displacements_offset
+                              + displacements.size() * sizeof(uint64_t);
+        header.document_count = stats.document_count;
+
+        write(displacements.data(), displacements.size() * sizeof(uint64_t));
+        write(slots.data(), slots.size() * sizeof(Slot));
+
+        // The reads of direct_io never go past the end of the file
+        const size_t end = header.slots_offset + slots.size() * sizeof(Slot);
+        stats.file_size  = round_up(end, options.alignment);
+        write(padding.data(), stats.file_size - end);
+
+        file.seekp(0);
+        write(&header, sizeof(header));
+
+        file.close();
+        if (!file) {
+            throw std::runtime_error(tmp_path
+                                     + ": unable to write the frozen index");
+        }
+    } catch (...) {
+        file.close();
+        std::remove(tmp_path.c_str());
+        throw;
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::string error = utility::errno_string();
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error(path + ": unable to move the frozen index; "
+                                 + error);
+    }
+    return stats;
+}
+
+FrozenIndex::FrozenIndex(const std::string& path)
+    : FrozenIndex(path, Options())
+{
+}
+
+FrozenIndex::FrozenIndex(const std::string& path, const Options& options)
+    : m_path(path), m_direct_io(options.direct_io)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error(path + ": unable to open the frozen index; "
+                                 + utility::errno_string());
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::string error = utility::errno_string();
+        close(fd);
+        throw std::runtime_error(path + ": unable to stat the frozen index; "
+                                 + error);
+    }
+    m_size = st.st_size;
+
+    Header header;
+    if (m_size < sizeof(Header)
+        || !read_fully(fd, &header, sizeof(header), 0)) {
+        close(fd);
+        throw std::runtime_error(path + ": truncated frozen index");
+    }
+
+    const char* invalid = nullptr;
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        invalid = ": not a frozen index";
+    } else if (header.version != kVersion
+               || header.document_size != sizeof(Index::document_type)) {
+        invalid = ": unsupported frozen index version";
+    } else if (header.alignment < sizeof(Header)
+               || (header.alignment & (header.alignment - 1)) != 0
+               || header.alignment > m_size
+               || header.records_length % 8 != 0
+               || header.records_length > m_size - header.alignment
+               || header.displacements_offset
+                      != header.alignment + header.records_length
+               || header.bucket_count == 0
+               || header.bucket_count
+                      > (m_size - header.displacements_offset)
+                            / sizeof(uint64_t)
+               || header.slots_offset
+                      != header.displacements_offset
+                             + header.bucket_count * sizeof(uint64_t)
+               || header.slot_count
+                      > (m_size - header.slots_offset) / sizeof(Slot)) {
+        invalid = ": truncated frozen index";
+    }
+    if (invalid != nullptr) {
+        close(fd);
+        throw std::runtime_error(path + invalid);
+    }
+
+    m_seed           = header.seed;
+    m_alignment      = header.alignment;
+    m_records_offset = header.alignment;
+    m_records_length = header.records_length;
+    m_bucket_count   = header.bucket_count;
+    m_slot_count     = header.slot_count;
+
+    if (!m_direct_io) {
+        // The pages are only read when they are first accessed
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        std::string error = utility::errno_string();
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error(path + ": unable to map the frozen index; "
+                                     + error);
+        }
+        m_data = reinterpret_cast<const char*>(data);
+
+        m_displacements = reinterpret_cast<const uint64_t*>(
+            m_data + header.displacements_offset);
+        m_slots
+            = reinterpret_cast<const Slot*>(m_data + header.slots_offset);
+        return;
+    }
+
+    // The tables are read once, through the page cache
+    m_displacement_buffer.resize(m_bucket_count);
+    m_slot_buffer.resize(m_slot_count);
+    bool success = read_fully(fd,
+                              m_displacement_buffer.data(),
+                              m_bucket_count * sizeof(uint64_t),
+                              header.displacements_offset)
+                   && read_fully(fd,
+                                 m_slot_buffer.data(),
+                                 m_slot_count * sizeof(Slot),
+                                 header.slots_offset);
+    close(fd);
+    if (!success) {
+        throw std::runtime_error(path + ": unable to read the frozen index");
+    }
+    m_displacements = m_displacement_buffer.data();
+    m_slots         = m_slot_buffer.data();
+
+    int flags = O_RDONLY;
+#if !defined(OS_MACOSX) && !defined(OS_OPENBSD) && !defined(OS_SOLARIS)
+    flags |= O_DIRECT;
+#endif
+
+    m_file_descriptor = open(path.c_str(), flags);
+    if (m_file_descriptor == -1) {
+        throw std::runtime_error(path + ": unable to open the frozen index; "
+                                 + utility::errno_string());
+    }
+
+#ifdef OS_MACOSX
+    if (fcntl(m_file_descriptor, F_NOCACHE, 1) == -1) {
+        std::string error = utility::errno_string();
+        close(m_file_descriptor);
+        throw std::runtime_error(path + ": unable to call fcntl F_NOCACHE; "
+                                 + error);
+    }
+#endif
+}
+
+FrozenIndex::~FrozenIndex()
+{
+    if (m_data != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+    if (m_file_descriptor != -1) {
+        close(m_file_descriptor);
+    }
+}
+
+std::vector<Index::document_type> FrozenIndex::search(
+    const Index::keyword_type& keyword) const
+{
+    std::vector<Index::document_type> result;
+    search(keyword, [&result](const Index::document_type* docs, size_t n) {
+        result.assign(docs, docs + n);
+    });
+    return result;
+}
+
+void FrozenIndex::search(const Index::keyword_type&          keyword,
+                         const Index::document_visitor_type& visitor) const
+{
+    const Slot* slot = find_slot(keyword);
+
+    // The length is compared before reading the record
+    if (slot == nullptr || slot->keyword_length != keyword.size()) {
+        return;
+    }
+
+    read_record(*slot,
+                [slot, &keyword, &visitor](const char*                 data,
+                                           const Index::document_type* docs) {
+                    if (std::memcmp(data, keyword.data(), keyword.size()) == 0
+                        && slot->document_count > 0) {
+                        visitor(docs, slot->document_count);
+                    }
+                });
+}
+
+Index::MultiSearchResult FrozenIndex::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    Index::MultiSearchResult result(keywords.size());
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        bool found = false;
+        search(keywords[i],
+               [&result, &found, i](const Index::document_type* docs,
+                                    size_t                      n) {
+                   result.set_list(i, docs, n);
+                   found = true;
+               });
+        if (!found) {
+            result.set_list(i, nullptr, 0);
+        }
+    }
+    return result;
+}
+
+void FrozenIndex::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    for (size_t i = 0; i < m_slot_count; i++) {
+        const Slot& slot = m_slots[i];
+        read_record(slot,
+                    [&slot, &visitor](const char* data,
+                                      const Index::document_type*) {
+                        visitor(Index::keyword_type(data, slot.keyword_length));
+                    });
+    }
+}
+
+void FrozenIndex::insert(const Index::keyword_type& /*keyword*/,
+                         Index::document_type /*document*/)
+{
+    throw std::logic_error(m_path + ": frozen indexes are read-only");
+}
+
+const FrozenIndex::Slot* FrozenIndex::find_slot(
+    const Index::keyword_type& keyword) const
+{
+    if (m_slot_count == 0) {
+        return nullptr;
+    }
+
+    const KeywordHash kh = split_hash(
+        keyword_hash(keyword.data(), keyword.size(), m_seed),
+        m_bucket_count,
+        m_slot_count);
+
+    return &m_slots[slot_position(
+        kh, m_displacements[kh.bucket], m_slot_count)];
+}
+
+void FrozenIndex::read_record(const Slot&               slot,
+                              const record_reader_type& reader) const
+{
+    // The slots of a corrupted file could point outside of the records
+    const size_t keyword_length = round_up(slot.keyword_length, 8);
+    if (slot.record_offset > m_records_length
+        || keyword_length > m_records_length - slot.record_offset
+        || slot.document_count
+               > (m_records_length - slot.record_offset - keyword_length)
+                     / sizeof(Index::document_type)) {
+        throw std::runtime_error(m_path + ": corrupted frozen index");
+    }
+
+    if (!m_direct_io) {
+        const char* record = m_data + m_records_offset + slot.record_offset;
+        reader(record,
+               reinterpret_cast<const Index::document_type*>(record
+                                                             + keyword_length));
+        return;
+    }
+
+    // O_DIRECT reads whole aligned blocks, in an aligned buffer
+    const size_t begin = m_records_offset + slot.record_offset;
+    const size_t end   = begin + keyword_length
+                       + slot.document_count * sizeof(Index::document_type);
+    const size_t first = begin & ~(m_alignment - 1);
+    const size_t last  = round_up(end, m_alignment);
+
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, m_alignment, last - first) != 0) {
+        throw std::runtime_error("Unable to do an aligned allocation");
+    }
+    std::unique_ptr<char, decltype(&free)> buffer_guard(
+        static_cast<char*>(buffer), &free);
+
+    if (!read_fully(m_file_descriptor, buffer, last - first, first)) {
+        throw std::runtime_error(m_path + ": unable to read a record; "
+                                 + utility::errno_string());
+    }
+
+    const char* record = buffer_guard.get() + (begin - first);
+    reader(record,
+           reinterpret_cast<const Index::document_type*>(record
+                                                         + keyword_length));
+}
+
+} // namespace insecure
+} // namespace sse
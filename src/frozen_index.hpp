@@ -0,0 +1,151 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Immutable, read-optimized index, stored in a single file built offline from
+// any other index.
+//
+// The keywords are mapped to the slots of a fixed-width table by a minimal
+// perfect hash function (CHD: the keywords are hashed in buckets, and every
+// bucket stores the displacement that sends its keywords to free slots). A
+// slot locates the record of its keyword: the keyword bytes, followed by its
+// contiguous document list. The records are stored in a page-aligned section,
+// in slot order.
+//
+// A search is one hash, one displacement and one slot read, and the
+// comparison of the keyword of the record. By default, the file is mapped in
+// memory and the lists are passed to the visitors from the mapping, without
+// any copy. With direct_io, the tables are loaded in memory, and every search
+// reads the pages of its record with O_DIRECT, bypassing the page cache.
+class FrozenIndex : public Index
+{
+public:
+    struct Options
+    {
+        // Read the records with O_DIRECT, instead of mapping the file
+        bool direct_io{false};
+    };
+
+    struct BuildOptions
+    {
+        // Average number of keywords per bucket of the hash function. Larger
+        // buckets make a smaller table of displacements, and a slower build.
+        size_t bucket_size{4};
+        // Alignment of the record section and of the file size. Must be a
+        // power of two, and a multiple of the block size of the device to
+        // read the file with direct_io.
+        size_t alignment{4096};
+    };
+
+    struct Stats
+    {
+        size_t keyword_count{0};
+        size_t document_count{0};
+        size_t bucket_count{0};
+        // Number of seeds tried before finding a perfect hash function
+        size_t seed_count{0};
+        size_t file_size{0};
+    };
+
+    // Write the keywords of source (enumerated by for_each_keyword) and their
+    // lists to a new frozen index at path. The file is written to a
+    // temporary path, and renamed to path once complete. Throws
+    // std::runtime_error on a write error.
+    static Stats build(const Index&        source,
+                       const std::string&  path,
+                       const BuildOptions& options);
+    static Stats build(const Index& source, const std::string& path);
+
+    // Open the frozen index at path. Throws std::runtime_error if the file
+    // cannot be read, or is not a valid frozen index.
+    explicit FrozenIndex(const std::string& path);
+    FrozenIndex(const std::string& path, const Options& options);
+    ~FrozenIndex();
+
+    FrozenIndex(const FrozenIndex&) = delete;
+    FrozenIndex& operator=(const FrozenIndex&) = delete;
+
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const override;
+    // The visitor is called once, with a pointer in the mapping, or in a
+    // buffer with direct_io
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
+    // The keywords are visited in slot order
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    // Frozen indexes are immutable: throws std::logic_error
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document) override;
+
+    size_t keyword_count() const
+    {
+        return m_slot_count;
+    }
+
+    size_t file_size() const
+    {
+        return m_size;
+    }
+
+private:
+    // Location of a record: its offset in the record section, the length of
+    // its keyword, and the size of its list
+    struct Slot
+    {
+        uint64_t record_offset;
+        uint32_t keyword_length;
+        uint32_t reserved;
+        uint64_t document_count;
+    };
+
+    // Called with the keyword bytes and the documents of a record. The
+    // pointers are only valid during the call.
+    using record_reader_type
+        = std::function<void(const char*, const Index::document_type*)>;
+
+    // Slot of keyword, if it is in the index. The keyword of the record must
+    // be compared to keyword. Returns nullptr for an empty index.
+    const Slot* find_slot(const Index::keyword_type& keyword) const;
+
+    // Read the record of slot, and pass it to reader. Throws
+    // std::runtime_error if the slot points outside of the record section.
+    void read_record(const Slot& slot, const record_reader_type& reader) const;
+
+    const std::string m_path;
+    const bool        m_direct_io;
+
+    // Mapping of the whole file, when not using direct_io
+    const char* m_data{nullptr};
+    size_t      m_size{0};
+    // File opened with O_DIRECT
+    int m_file_descriptor{-1};
+
+    uint64_t m_seed{0};
+    size_t   m_alignment{0};
+    size_t   m_records_offset{0};
+    size_t   m_records_length{0};
+
+    const uint64_t* m_displacements{nullptr};
+    size_t          m_bucket_count{0};
+    const Slot*     m_slots{nullptr};
+    size_t          m_slot_count{0};
+
+    // Tables loaded in memory with direct_io
+    std::vector<uint64_t> m_displacement_buffer;
+    std::vector<Slot>     m_slot_buffer;
+};
+
+} // namespace insecure
+} // namespace sse
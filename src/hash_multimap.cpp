@@ -0,0 +1,169 @@
+#include "hash_multimap.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+namespace sse {
+namespace insecure {
+
+constexpr uint32_t HashMultiMap::PostingArray::kInlineCapacity;
+
+HashMultiMap::PostingArray::PostingArray(PostingArray&& other) noexcept
+    : m_size(other.m_size), m_capacity(other.m_capacity)
+{
+    if (other.is_inline()) {
+        std::memcpy(m_inline,
+                    other.m_inline,
+                    m_size * sizeof(Index::document_type));
+    } else {
+        m_heap = other.m_heap;
+    }
+    other.m_size     = 0;
+    other.m_capacity = kInlineCapacity;
+}
+
+HashMultiMap::PostingArray::~PostingArray()
+{
+    if (!is_inline()) {
+        std::free(m_heap);
+    }
+}
+
+void HashMultiMap::PostingArray::append(const Index::document_type* documents,
+                                        size_t                      n)
+{
+    constexpr size_t kMaxSize = std::numeric_limits<uint32_t>::max();
+
+    if (n > kMaxSize - m_size) {
+        throw std::length_error("HashMultiMap: document list too long");
+    }
+    const size_t new_size = m_size + n;
+
+    if (new_size > m_capacity) {
+        const size_t capacity = std::min(
+            kMaxSize, std::max<size_t>(2 * size_t(m_capacity), new_size));
+        const size_t bytes = capacity * sizeof(Index::document_type);
+
+        // The documents are trivially copyable: the heap arrays are grown in
+        // place when possible
+        Index::document_type* heap = static_cast<Index::document_type*>(
+            is_inline() ? std::malloc(bytes) : std::realloc(m_heap, bytes));
+        if (heap == nullptr) {
+            throw std::bad_alloc();
+        }
+        if (is_inline()) {
+            std::memcpy(heap, m_inline, m_size * sizeof(Index::document_type));
+        }
+        m_heap     = heap;
+        m_capacity = static_cast<uint32_t>(capacity);
+    }
+
+    Index::document_type* data = is_inline() ? m_inline : m_heap;
+    std::memcpy(data + m_size, documents, n * sizeof(Index::document_type));
+    m_size = static_cast<uint32_t>(new_size);
+}
+
+std::vector<Index::document_type> HashMultiMap::search(
+    const Index::keyword_type& keyword) const
+{
+    const PostingArray* documents = find(keyword);
+    if (documents == nullptr) {
+        return {};
+    }
+    return std::vector<Index::document_type>(
+        documents->data(), documents->data() + documents->size());
+}
+
+void HashMultiMap::search(const Index::keyword_type&          keyword,
+                          const Index::document_visitor_type& visitor) const
+{
+    const PostingArray* documents = find(keyword);
+    if (documents != nullptr && documents->size() > 0) {
+        visitor(documents->data(), documents->size());
+    }
+}
+
+Index::MultiSearchResult HashMultiMap::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    Index::MultiSearchResult result(keywords.size());
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        const PostingArray* documents = find(keywords[i]);
+        if (documents == nullptr) {
+            result.set_list(i, nullptr, 0);
+        } else {
+            result.set_list(i, documents->data(), documents->size());
+        }
+    }
+    return result;
+}
+
+void HashMultiMap::insert(const Index::keyword_type& keyword,
+                          Index::document_type       document)
+{
+    find_or_create(keyword).append(&document, 1);
+}
+
+void HashMultiMap::put_list(const Index::keyword_type&  keyword,
+                            const Index::document_type* documents,
+                            size_t                      n)
+{
+    find_or_create(keyword).append(documents, n);
+}
+
+void HashMultiMap::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    for (size_t id = 0; id < m_lists.size(); id++) {
+        visitor(
+            m_dictionary.keyword(static_cast<KeywordDictionary::id_type>(id)));
+    }
+}
+
+void HashMultiMap::reserve(size_t n_keywords)
+{
+    m_dictionary.reserve(n_keywords);
+    m_lists.reserve(n_keywords);
+}
+
+size_t HashMultiMap::memory_usage() const
+{
+    size_t bytes = m_dictionary.memory_usage()
+                   + m_lists.capacity() * sizeof(PostingArray);
+
+    for (const auto& documents : m_lists) {
+        bytes += documents.heap_bytes();
+    }
+    return bytes;
+}
+
+const HashMultiMap::PostingArray* HashMultiMap::find(
+    const Index::keyword_type& keyword) const
+{
+    KeywordDictionary::id_type id = m_dictionary.find(keyword);
+    if (id == KeywordDictionary::kNotFound) {
+        return nullptr;
+    }
+    return &m_lists[id];
+}
+
+HashMultiMap::PostingArray& HashMultiMap::find_or_create(
+    const Index::keyword_type& keyword)
+{
+    KeywordDictionary::id_type id = m_dictionary.intern(keyword);
+
+    // The identifiers are dense: a new keyword gets the next list
+    if (id == m_lists.size()) {
+        m_lists.emplace_back();
+    }
+    return m_lists[id];
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "index.hpp"
+#include "keyword_dictionary.hpp"
+
+#include <cstdint>
+
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// In-memory index storing the document list of every keyword in a single
+// contiguous array, indexed by the identifier of the keyword in a
+// KeywordDictionary.
+//
+// A search is then a probe of the open addressing table of the dictionary and
+// a contiguous read of the list, instead of a traversal of the nodes of a
+// tree. The short lists are stored inline, without any heap allocation.
+//
+// As StdMultiMap, the index is not thread safe.
+class HashMultiMap : public Index
+{
+public:
+    HashMultiMap() = default;
+
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const;
+    // The visitor is called once, with the whole list
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const;
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document);
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n);
+    void for_each_keyword(const Index::keyword_visitor_type& visitor) const;
+
+    // Allocate the table for n_keywords keywords
+    void reserve(size_t n_keywords);
+
+    size_t keyword_count() const
+    {
+        return m_lists.size();
+    }
+
+    const KeywordDictionary& dictionary() const
+    {
+        return m_dictionary;
+    }
+
+    // Number of bytes allocated by the index: the dictionary and the lists.
+    // Linear in the number of keywords.
+    size_t memory_usage() const;
+
+private:
+    // Growable array of documents. Up to kInlineCapacity documents are stored
+    // in the object itself.
+    class PostingArray
+    {
+    public:
+        PostingArray() = default;
+        PostingArray(PostingArray&& other) noexcept;
+        ~PostingArray();
+
+        PostingArray(const PostingArray&) = delete;
+        PostingArray& operator=(const PostingArray&) = delete;
+        PostingArray& operator=(PostingArray&&) = delete;
+
+        const Index::document_type* data() const
+        {
+            return is_inline() ? m_inline : m_heap;
+        }
+        size_t size() const
+        {
+            return m_size;
+        }
+        size_t heap_bytes() const
+        {
+            return is_inline() ? 0 : m_capacity * sizeof(Index::document_type);
+        }
+
+        // Throws std::length_error if the array would contain more than
+        // 2^32 - 1 documents
+        void append(const Index::document_type* documents, size_t n);
+
+    private:
+        static constexpr uint32_t kInlineCapacity = 2;
+
+        // The capacity only grows: the array is inline until its first
+        // reallocation
+        bool is_inline() const
+        {
+            return m_capacity == kInlineCapacity;
+        }
+
+        uint32_t m_size{0};
+        uint32_t m_capacity{kInlineCapacity};
+        union {
+            Index::document_type  m_inline[kInlineCapacity];
+            Index::document_type* m_heap;
+        };
+    };
+
+    // List of keyword, or nullptr
+    const PostingArray* find(const Index::keyword_type& keyword) const;
+
+    // List of keyword, created if needed
+    PostingArray& find_or_create(const Index::keyword_type& keyword);
+
+    KeywordDictionary m_dictionary;
+    // Lists, indexed by keyword identifier
+    std::vector<PostingArray> m_lists;
+};
+
+} // namespace insecure
+} // namespace sse
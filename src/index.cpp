@@ -1,10 +1,112 @@
 #include "index.hpp"
 
+#include <cstring>
 #include <rocksdb/slice.h>
 
+#include <algorithm>
+#include <stdexcept>
+
 namespace sse {
 namespace insecure {
 
+Index::MultiSearchResult::MultiSearchResult(size_t n_keywords)
+    : m_ranges(n_keywords, std::make_pair(0, 0))
+{
+}
+
+std::vector<Index::document_type> Index::MultiSearchResult::list_vector(
+    size_t i) const
+{
+    return std::vector<document_type>(list(i), list(i) + list_size(i));
+}
+
+void Index::MultiSearchResult::set_list(size_t               i,
+                                        const document_type* list,
+                                        size_t               n)
+{
+    m_ranges[i] = std::make_pair(m_documents.size(), n);
+    m_documents.insert(m_documents.end(), list, list + n);
+}
+
+bool Index::MultiSearchResult::set_serialized_list(size_t      i,
+                                                   const char* data,
+                                                   size_t      length)
+{
+    constexpr size_t elt_size = sizeof(Index::document_type);
+
+    const size_t offset = m_documents.size();
+    const size_t n      = length / elt_size;
+
+    m_ranges[i] = std::make_pair(offset, n);
+
+    // data may be null if the list is empty
+    if (n > 0) {
+        m_documents.resize(offset + n);
+        memcpy(reinterpret_cast<char*>(m_documents.data() + offset),
+               data,
+               n * elt_size);
+    }
+
+    return (n * elt_size == length);
+}
+
+void Index::search(const keyword_type&          keyword,
+                   const document_visitor_type& visitor) const
+{
+    std::vector<document_type> list = search(keyword);
+
+    if (!list.empty()) {
+        visitor(list.data(), list.size());
+    }
+}
+
+Index::MultiSearchResult Index::search_many(
+    const std::vector<keyword_type>& keywords) const
+{
+    MultiSearchResult result(keywords.size());
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        std::vector<document_type> list = search(keywords[i]);
+        result.set_list(i, list.data(), list.size());
+    }
+    return result;
+}
+
+void Index::insert_batch(const std::vector<entry_type>& entries)
+{
+    for (const auto& entry : entries) {
+        insert(entry.first, entry.second);
+    }
+}
+
+void Index::put_list(const keyword_type&  keyword,
+                     const document_type* documents,
+                     size_t               n)
+{
+    std::vector<entry_type> entries;
+    entries.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        entries.emplace_back(keyword, documents[i]);
+    }
+    insert_batch(entries);
+}
+
+void Index::for_each_keyword(const keyword_visitor_type& /*visitor*/) const
+{
+    throw std::logic_error("This index cannot enumerate its keywords");
+}
+
+std::map<Index::keyword_type, std::vector<Index::document_type>> Index::
+    group_by_keyword(const std::vector<entry_type>& entries)
+{
+    std::map<keyword_type, std::vector<document_type>> groups;
+
+    for (const auto& entry : entries) {
+        groups[entry.first].push_back(entry.second);
+    }
+    return groups;
+}
+
 bool Index::deserialize_document_list(const char* data,
                                       size_t      data_length,
                                       std::vector<Index::document_type>* result)
@@ -34,5 +136,36 @@ bool Index::deserialize_document_list(const rocksdb::Slice&              data,
 {
     return deserialize_document_list(data.data(), data.size(), result);
 }
+
+bool Index::visit_document_list(const char*                  data,
+                                size_t                       data_length,
+                                const document_visitor_type& visitor)
+{
+    constexpr size_t elt_size = sizeof(Index::document_type);
+    const size_t     n        = data_length / elt_size;
+
+    if (n == 0) {
+        return (data_length == 0);
+    }
+
+    if (reinterpret_cast<uintptr_t>(data) % alignof(Index::document_type)
+        == 0) {
+        visitor(reinterpret_cast<const Index::document_type*>(data), n);
+    } else {
+        constexpr size_t     kBufferSize = 512;
+        Index::document_type buffer[kBufferSize];
+
+        for (size_t offset = 0; offset < n; offset += kBufferSize) {
+            const size_t chunk_size = std::min(kBufferSize, n - offset);
+
+            memcpy(reinterpret_cast<char*>(buffer),
+                   data + offset * elt_size,
+                   chunk_size * elt_size);
+            visitor(buffer, chunk_size);
+        }
+    }
+
+    return (n * elt_size == data_length);
+}
 } // namespace insecure
-} // namespace sse
\ No newline at end of file
+} // namespace sse
@@ -2,7 +2,10 @@
 
 #include <cstdint>
 
+#include <functional>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace rocksdb {
@@ -18,15 +21,120 @@ class Index
 public:
     using keyword_type  = std::string;
     using document_type = uint64_t;
+    using entry_type    = std::pair<keyword_type, document_type>;
+
+    // Callback receiving a contiguous part of a document list. The pointer is
+    // only valid during the call.
+    using document_visitor_type
+        = std::function<void(const document_type*, size_t)>;
+
+    // Callback receiving a keyword of the index
+    using keyword_visitor_type = std::function<void(const keyword_type&)>;
+
+    // Result of a multi-keyword search. The document lists of all the
+    // searched keywords are stored contiguously in a single arena, and are
+    // accessed using the position of the keyword in the query.
+    class MultiSearchResult
+    {
+    public:
+        MultiSearchResult() = default;
+        explicit MultiSearchResult(size_t n_keywords);
+
+        // Number of searched keywords
+        size_t size() const
+        {
+            return m_ranges.size();
+        }
+
+        const document_type* list(size_t i) const
+        {
+            return m_documents.data() + m_ranges[i].first;
+        }
+        size_t list_size(size_t i) const
+        {
+            return m_ranges[i].second;
+        }
+        std::vector<document_type> list_vector(size_t i) const;
+
+        // Total number of documents in the arena
+        size_t total_size() const
+        {
+            return m_documents.size();
+        }
+
+        void reserve(size_t n_documents)
+        {
+            m_documents.reserve(n_documents);
+        }
+
+        // Set the list of the i-th keyword. The lists can be set in any
+        // order, but each one must only be set once.
+        void set_list(size_t i, const document_type* list, size_t n);
+
+        // Set the list of the i-th keyword from its serialized form.
+        // Returns false if the data length is not a multiple of the document
+        // size.
+        bool set_serialized_list(size_t i, const char* data, size_t length);
+
+    private:
+        std::vector<document_type> m_documents;
+        // (offset, length) of each list in m_documents
+        std::vector<std::pair<size_t, size_t>> m_ranges;
+    };
 
     virtual ~Index(){};
 
     virtual std::vector<document_type> search(
         const keyword_type& keyword) const = 0;
 
+    // Search keyword and pass its document list to visitor, without copying
+    // it when the backend allows it. The visitor can be called several times,
+    // on consecutive parts of the list, and is not called if the list is
+    // empty.
+    // The default implementation calls search() and visits the result.
+    virtual void search(const keyword_type&          keyword,
+                        const document_visitor_type& visitor) const;
+
+    // Search several keywords at once. The i-th list of the result is the
+    // list of keywords[i]. The default implementation calls search() for
+    // every keyword.
+    virtual MultiSearchResult search_many(
+        const std::vector<keyword_type>& keywords) const;
+
+    // Append document to the list of keyword.
+    // The write errors are reported by throwing std::runtime_error, by
+    // insert() as well as by insert_batch() and put_list(). The RocksDB
+    // backends are the exception: they log their write errors to std::cerr.
+    // The inserts of a WriteBufferedIndex report the errors of its backend
+    // when they are flushed.
     virtual void insert(const keyword_type& keyword, document_type document)
         = 0;
 
+    // Insert all the (keyword, document) pairs of entries.
+    // The default implementation calls insert() for every pair. Backends
+    // should override it to group the entries by keyword and to issue a
+    // single write per batch.
+    virtual void insert_batch(const std::vector<entry_type>& entries);
+
+    // Append the n documents of documents to the list of keyword, in order.
+    // The default implementation calls insert_batch(). Backends should
+    // override it to write the whole list at once: the list is already
+    // grouped, and does not need to go through group_by_keyword().
+    virtual void put_list(const keyword_type&  keyword,
+                          const document_type* documents,
+                          size_t               n);
+
+    // Call visitor once with every keyword of the index, in an unspecified
+    // order. The keywords inserted during the call may or may not be
+    // visited. The default implementation throws std::logic_error, for the
+    // backends that cannot enumerate their keywords.
+    virtual void for_each_keyword(const keyword_visitor_type& visitor) const;
+
+    // Group the documents of entries by keyword, preserving the insertion
+    // order of the documents of a same keyword. The keywords are sorted.
+    static std::map<keyword_type, std::vector<document_type>> group_by_keyword(
+        const std::vector<entry_type>& entries);
+
 
     static bool deserialize_document_list(
         const char*                        data,
@@ -40,6 +148,13 @@ public:
         const rocksdb::Slice&              data,
         std::vector<Index::document_type>* result);
 
+    // Visit a serialized document list. The data is directly passed to the
+    // visitor if it is correctly aligned, and is otherwise copied by chunks in
+    // a buffer on the stack.
+    static bool visit_document_list(const char*                  data,
+                                    size_t                       data_length,
+                                    const document_visitor_type& visitor);
+
     // static std::string serialize_document_list(
     // const std::vector<Index::document_type> doc_list);
 };
@@ -0,0 +1,196 @@
+#include "index_builder.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <numeric>
+#include <random>
+#include <thread>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+bool keyword_less(const Index::entry_type& a, const Index::entry_type& b)
+{
+    return a.first < b.first;
+}
+
+// Run f(0), ..., f(n - 1) in n threads, and rethrow the first exception once
+// all the threads are joined
+void run_threads(size_t n, const std::function<void(size_t)>& f)
+{
+    std::vector<std::thread>        threads;
+    std::vector<std::exception_ptr> errors(n);
+
+    threads.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        threads.emplace_back([&f, &errors, i]() {
+            try {
+                f(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (const auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+} // namespace
+
+IndexBuilder::IndexBuilder(const Options& options) : m_options(options)
+{
+}
+
+IndexBuilder::Stats IndexBuilder::build(const source_type& source,
+                                        Index*             index) const
+{
+    const size_t n_threads
+        = (m_options.thread_count > 0)
+              ? m_options.thread_count
+              : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    std::vector<Index::entry_type> entries;
+    Index::entry_type              entry;
+    while (source(&entry)) {
+        entries.push_back(std::move(entry));
+    }
+
+    const bucket_bounds_type bounds    = partition(n_threads, &entries);
+    const size_t             n_buckets = bounds.size() - 1;
+
+    std::vector<size_t> keyword_counts(n_buckets, 0);
+
+    // The bucket is sorted: pass its lists one by one
+    auto put_bucket = [&](size_t b) {
+        std::vector<Index::document_type> documents;
+
+        const auto end = entries.begin() + bounds[b + 1];
+        for (auto it = entries.begin() + bounds[b]; it != end;) {
+            const Index::keyword_type& keyword = it->first;
+
+            documents.clear();
+            for (; it != end && it->first == keyword; ++it) {
+                documents.push_back(it->second);
+            }
+
+            index->put_list(keyword, documents.data(), documents.size());
+            keyword_counts[b]++;
+        }
+    };
+
+    run_threads(n_buckets, [&](size_t b) {
+        // stable: the documents of a keyword stay in the order of the source
+        std::stable_sort(entries.begin() + bounds[b],
+                         entries.begin() + bounds[b + 1],
+                         keyword_less);
+
+        if (m_options.concurrent_puts) {
+            put_bucket(b);
+        }
+    });
+
+    if (!m_options.concurrent_puts) {
+        for (size_t b = 0; b < n_buckets; b++) {
+            put_bucket(b);
+        }
+    }
+
+    Stats stats;
+    stats.entry_count   = entries.size();
+    stats.bucket_count  = n_buckets;
+    stats.keyword_count = std::accumulate(
+        keyword_counts.begin(), keyword_counts.end(), size_t(0));
+    return stats;
+}
+
+IndexBuilder::bucket_bounds_type IndexBuilder::partition(
+    size_t                          n_threads,
+    std::vector<Index::entry_type>* entries) const
+{
+    const size_t n = entries->size();
+
+    if (n_threads < 2 || n == 0) {
+        return {0, n};
+    }
+
+    // Choose the bounds of the buckets from a random sample of the keywords.
+    // The generator is seeded deterministically, so that a same source is
+    // always split the same way.
+    const size_t oversampling = std::max<size_t>(m_options.oversampling, 1);
+
+    std::minstd_rand                      generator(static_cast<unsigned>(n));
+    std::uniform_int_distribution<size_t> distribution(0, n - 1);
+
+    std::vector<const Index::keyword_type*> sample(n_threads * oversampling);
+    for (auto& keyword : sample) {
+        keyword = &(*entries)[distribution(generator)].first;
+    }
+    std::sort(sample.begin(),
+              sample.end(),
+              [](const Index::keyword_type* a, const Index::keyword_type* b) {
+                  return *a < *b;
+              });
+
+    // The bucket b contains the keywords in [splitters[b-1], splitters[b]).
+    // The duplicated splitters of the frequent keywords are removed: a
+    // keyword is always in a single bucket.
+    std::vector<Index::keyword_type> splitters;
+    for (size_t b = 1; b < n_threads; b++) {
+        splitters.push_back(*sample[b * oversampling]);
+    }
+    splitters.erase(std::unique(splitters.begin(), splitters.end()),
+                    splitters.end());
+
+    const size_t n_buckets = splitters.size() + 1;
+
+    // Every thread computes the buckets of a slice of the pairs, and counts
+    // the pairs of every bucket
+    std::vector<uint32_t>            bucket_of(n);
+    std::vector<std::vector<size_t>> offsets(
+        n_threads, std::vector<size_t>(n_buckets, 0));
+
+    auto slice_begin = [n, n_threads](size_t t) { return t * n / n_threads; };
+
+    run_threads(n_threads, [&](size_t t) {
+        for (size_t i = slice_begin(t); i < slice_begin(t + 1); i++) {
+            bucket_of[i] = static_cast<uint32_t>(
+                std::upper_bound(
+                    splitters.begin(), splitters.end(), (*entries)[i].first)
+                - splitters.begin());
+            offsets[t][bucket_of[i]]++;
+        }
+    });
+
+    // Turn the counts into the positions of the slices in the buckets: the
+    // slices of a bucket are stored in the order of the source
+    bucket_bounds_type bounds(n_buckets + 1);
+    size_t             position = 0;
+    for (size_t b = 0; b < n_buckets; b++) {
+        bounds[b] = position;
+        for (size_t t = 0; t < n_threads; t++) {
+            size_t count  = offsets[t][b];
+            offsets[t][b] = position;
+            position += count;
+        }
+    }
+    bounds[n_buckets] = n;
+
+    std::vector<Index::entry_type> partitioned(n);
+    run_threads(n_threads, [&](size_t t) {
+        for (size_t i = slice_begin(t); i < slice_begin(t + 1); i++) {
+            partitioned[offsets[t][bucket_of[i]]++] = std::move((*entries)[i]);
+        }
+    });
+    entries->swap(partitioned);
+
+    return bounds;
+}
+
+} // namespace insecure
+} // namespace sse
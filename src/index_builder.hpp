@@ -0,0 +1,70 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Parallel build of the lists of any Index from a stream of (keyword,
+// document) pairs.
+//
+// The pairs are read in memory, and partitioned by keyword with a parallel
+// sample sort: the keywords of a sample are used to split the keyword space
+// in one bucket per thread, every thread scatters its part of the pairs in
+// the buckets, and sorts a bucket. The lists of each bucket are then passed
+// to the index with a single put_list call per keyword.
+//
+// The documents of a keyword are kept in the order of the source, and are
+// appended to the existing list of the keyword.
+class IndexBuilder
+{
+public:
+    // Set *entry to the next pair to load, or return false once all the pairs
+    // were returned
+    using source_type = std::function<bool(Index::entry_type* entry)>;
+
+    struct Options
+    {
+        // Number of threads partitioning and sorting the pairs. Zero means
+        // one per core.
+        size_t thread_count{0};
+        // Number of sampled keywords per bucket, used to choose the bounds of
+        // the buckets
+        size_t oversampling{64};
+        // Pass the lists of the different buckets to the index concurrently,
+        // from the sorting threads. The index must then support concurrent
+        // put_list calls for distinct keywords. Otherwise, the lists are
+        // passed by the calling thread, by increasing keyword.
+        bool concurrent_puts{false};
+    };
+
+    struct Stats
+    {
+        size_t entry_count{0};
+        size_t keyword_count{0};
+        size_t bucket_count{0};
+    };
+
+    IndexBuilder() = default;
+    explicit IndexBuilder(const Options& options);
+
+    // Load all the pairs of source in index. The exceptions of the index are
+    // propagated, after all the threads are stopped.
+    Stats build(const source_type& source, Index* index) const;
+
+private:
+    using bucket_bounds_type = std::vector<size_t>;
+
+    // Reorder entries by bucket, and return the offset of the first pair of
+    // every bucket, followed by entries.size()
+    bucket_bounds_type partition(size_t                          n_threads,
+                                 std::vector<Index::entry_type>* entries) const;
+
+    Options m_options;
+};
+
+} // namespace insecure
+} // namespace sse
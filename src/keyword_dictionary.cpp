@@ -0,0 +1,177 @@
+#include "keyword_dictionary.hpp"
+
+#include "utils.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+// The table is grown when it is more than 3/4 full
+constexpr size_t kMaxLoadNumerator   = 3;
+constexpr size_t kMaxLoadDenominator = 4;
+
+constexpr size_t kMinSlotCount = 16;
+
+// 64 bits FNV-1a. The keywords are short: a simple byte-wise hash is enough.
+uint64_t keyword_hash(const char* data, size_t length)
+{
+    const uint64_t hash = utility::stable_hash(data, length, 0);
+    // FNV-1a mixes the low bits poorly, and they choose the slot
+    return hash ^ (hash >> 32);
+}
+
+// The slot is chosen with the low bits of the hash: the tag uses the high bits
+uint32_t hash_tag(uint64_t hash)
+{
+    return static_cast<uint32_t>(hash >> 32);
+}
+} // namespace
+
+constexpr KeywordDictionary::id_type KeywordDictionary::kNotFound;
+
+KeywordDictionary::KeywordDictionary(const Options& options)
+    : m_arena_block_size(std::max<size_t>(options.arena_block_size, 1))
+{
+}
+
+KeywordDictionary::id_type KeywordDictionary::find(const char* data,
+                                                   size_t      length) const
+{
+    if (m_slots.empty()) {
+        return kNotFound;
+    }
+
+    const uint64_t hash = keyword_hash(data, length);
+    const uint32_t tag  = hash_tag(hash);
+    const size_t   mask = m_slots.size() - 1;
+
+    // The table is never full: the probe always ends on an empty slot
+    for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+        const Slot& slot = m_slots[pos];
+
+        if (slot.id == kNotFound) {
+            return kNotFound;
+        }
+        if (slot.tag == tag && m_entries[slot.id].length == length
+            && std::memcmp(m_entries[slot.id].data, data, length) == 0) {
+            return slot.id;
+        }
+    }
+}
+
+KeywordDictionary::id_type KeywordDictionary::intern(const char* data,
+                                                     size_t      length)
+{
+    const uint64_t hash = keyword_hash(data, length);
+    const uint32_t tag  = hash_tag(hash);
+
+    // The known keywords are found without growing the table
+    size_t pos = 0;
+    if (!m_slots.empty()) {
+        const size_t mask = m_slots.size() - 1;
+        for (pos = hash & mask;; pos = (pos + 1) & mask) {
+            const Slot& slot = m_slots[pos];
+
+            if (slot.id == kNotFound) {
+                break;
+            }
+            if (slot.tag == tag && m_entries[slot.id].length == length
+                && std::memcmp(m_entries[slot.id].data, data, length) == 0) {
+                return slot.id;
+            }
+        }
+    }
+
+    if (m_entries.size() >= kNotFound) {
+        throw std::length_error("KeywordDictionary: too many keywords");
+    }
+
+    if ((m_entries.size() + 1) * kMaxLoadDenominator
+        > m_slots.size() * kMaxLoadNumerator) {
+        rehash(std::max(kMinSlotCount, 2 * m_slots.size()));
+
+        const size_t mask = m_slots.size() - 1;
+        pos = hash & mask;
+        while (m_slots[pos].id != kNotFound) {
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    const id_type id = static_cast<id_type>(m_entries.size());
+    m_entries.push_back(Entry{store(data, length), length});
+    m_slots[pos] = Slot{tag, id};
+    return id;
+}
+
+void KeywordDictionary::reserve(size_t n_keywords)
+{
+    size_t n_slots = kMinSlotCount;
+    while (n_slots * kMaxLoadNumerator < n_keywords * kMaxLoadDenominator) {
+        n_slots *= 2;
+    }
+    if (n_slots > m_slots.size()) {
+        rehash(n_slots);
+    }
+    m_entries.reserve(n_keywords);
+}
+
+size_t KeywordDictionary::memory_usage() const
+{
+    return m_blocks_bytes + m_blocks.capacity() * sizeof(m_blocks[0])
+           + m_entries.capacity() * sizeof(Entry)
+           + m_slots.capacity() * sizeof(Slot);
+}
+
+const char* KeywordDictionary::store(const char* data, size_t length)
+{
+    if (length == 0) {
+        return "";
+    }
+
+    if (length > m_block_available) {
+        // The remainder of the current block is kept when a keyword does not
+        // fit in a fresh block either
+        const size_t block_size = std::max(length, m_arena_block_size);
+
+        m_blocks.emplace_back(new char[block_size]);
+        m_blocks_bytes += block_size;
+
+        if (length >= m_arena_block_size && m_block_available > 0) {
+            std::memcpy(m_blocks.back().get(), data, length);
+            return m_blocks.back().get();
+        }
+        m_block_position  = m_blocks.back().get();
+        m_block_available = block_size;
+    }
+
+    char* stored = m_block_position;
+    std::memcpy(stored, data, length);
+    m_block_position += length;
+    m_block_available -= length;
+    return stored;
+}
+
+void KeywordDictionary::rehash(size_t n_slots)
+{
+    m_slots.assign(n_slots, Slot{0, kNotFound});
+
+    const size_t mask = n_slots - 1;
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        const uint64_t hash
+            = keyword_hash(m_entries[i].data, m_entries[i].length);
+
+        size_t pos = hash & mask;
+        while (m_slots[pos].id != kNotFound) {
+            pos = (pos + 1) & mask;
+        }
+        m_slots[pos] = Slot{hash_tag(hash), static_cast<id_type>(i)};
+    }
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <cstdint>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Dictionary interning the keywords of an in-memory index, and mapping them
+// to dense 32 bits identifiers.
+//
+// The keywords are copied once, in large blocks of an arena, and are never
+// moved: a keyword costs its bytes, a 16 bytes entry and a slot of the table,
+// instead of a std::string per occurrence. The identifiers are found with an
+// open addressing hash table. A lookup never allocates, and an insertion only
+// allocates when the arena or the table is full.
+//
+// The dictionary is not thread safe.
+class KeywordDictionary
+{
+public:
+    using id_type = uint32_t;
+
+    // Returned by find() for a missing keyword
+    static constexpr id_type kNotFound = UINT32_MAX;
+
+    struct Options
+    {
+        // Size of the blocks of the arena. The longer keywords get a block of
+        // their own.
+        size_t arena_block_size{64 * 1024};
+    };
+
+    KeywordDictionary() = default;
+    explicit KeywordDictionary(const Options& options);
+
+    KeywordDictionary(const KeywordDictionary&) = delete;
+    KeywordDictionary& operator=(const KeywordDictionary&) = delete;
+
+    // Identifier of the keyword, or kNotFound
+    id_type find(const char* data, size_t length) const;
+    id_type find(const Index::keyword_type& keyword) const
+    {
+        return find(keyword.data(), keyword.size());
+    }
+
+    // Identifier of the keyword, that is added if needed. The identifiers are
+    // given in insertion order, starting from 0. Throws std::length_error if
+    // the dictionary already contains 2^32 - 1 keywords.
+    id_type intern(const char* data, size_t length);
+    id_type intern(const Index::keyword_type& keyword)
+    {
+        return intern(keyword.data(), keyword.size());
+    }
+
+    // The interned bytes of a keyword. The pointer stays valid as long as the
+    // dictionary.
+    const char* data(id_type id) const
+    {
+        return m_entries[id].data;
+    }
+    size_t length(id_type id) const
+    {
+        return m_entries[id].length;
+    }
+    Index::keyword_type keyword(id_type id) const
+    {
+        return Index::keyword_type(data(id), length(id));
+    }
+
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    // Allocate the table for n_keywords keywords
+    void reserve(size_t n_keywords);
+
+    // Number of bytes allocated by the dictionary
+    size_t memory_usage() const;
+
+private:
+    struct Entry
+    {
+        const char* data;
+        size_t      length;
+    };
+
+    struct Slot
+    {
+        // High bits of the hash of the keyword, compared before the keyword
+        uint32_t tag;
+        // Identifier of the keyword, or kNotFound for an empty slot
+        id_type id;
+    };
+
+    // Copy length bytes in the arena
+    const char* store(const char* data, size_t length);
+
+    // Rebuild the table with n_slots slots, a power of 2
+    void rehash(size_t n_slots);
+
+    size_t m_arena_block_size{Options().arena_block_size};
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t                               m_blocks_bytes{0};
+    // Free bytes at the end of the last block
+    char*  m_block_position{nullptr};
+    size_t m_block_available{0};
+
+    std::vector<Entry> m_entries;
+    std::vector<Slot>  m_slots;
+};
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,77 @@
+#include "keyword_key.hpp"
+
+#include "utils.hpp"
+
+namespace sse {
+namespace insecure {
+
+namespace {
+// Independent seeds of the words of a hash
+constexpr uint64_t kSeeds[2] = {0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL};
+
+inline uint64_t hash_word(const Index::keyword_type& keyword, uint64_t seed)
+{
+    return utility::mix64(
+        utility::stable_hash(keyword.data(), keyword.size(), seed)
+        ^ keyword.size());
+}
+} // namespace
+
+template<size_t Width>
+HashedKeyword<Width>::HashedKeyword(const Index::keyword_type& keyword)
+{
+    for (size_t i = 0; i < kWordCount; i++) {
+        m_words[i] = hash_word(keyword, kSeeds[i]);
+    }
+}
+
+template<size_t Width>
+void HashedKeyword<Width>::append_to(std::string* out) const
+{
+    char bytes[Width];
+    for (size_t i = 0; i < kWordCount; i++) {
+        for (size_t b = 0; b < 8; b++) {
+            bytes[8 * i + b]
+                = static_cast<char>((m_words[i] >> (56 - 8 * b)) & 0xFF);
+        }
+    }
+    out->append(bytes, Width);
+}
+
+template class HashedKeyword<8>;
+template class HashedKeyword<16>;
+
+size_t keyword_key_width(KeywordKeyType type)
+{
+    switch (type) {
+    case KeywordKeyType::Hash64:
+        return HashedKeyword64::kWidth;
+    case KeywordKeyType::Hash128:
+        return HashedKeyword128::kWidth;
+    case KeywordKeyType::String:
+    default:
+        return 0;
+    }
+}
+
+const std::string& keyword_key(KeywordKeyType             type,
+                               const Index::keyword_type& keyword,
+                               std::string*               buffer)
+{
+    switch (type) {
+    case KeywordKeyType::Hash64:
+        buffer->clear();
+        HashedKeyword64(keyword).append_to(buffer);
+        return *buffer;
+    case KeywordKeyType::Hash128:
+        buffer->clear();
+        HashedKeyword128(keyword).append_to(buffer);
+        return *buffer;
+    case KeywordKeyType::String:
+    default:
+        return keyword;
+    }
+}
+
+} // namespace insecure
+} // namespace sse
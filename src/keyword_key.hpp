@@ -0,0 +1,73 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <cstdint>
+
+#include <array>
+#include <string>
+
+namespace sse {
+namespace insecure {
+
+// Representation of the keywords in the keys of the persistent backends
+enum class KeywordKeyType : uint8_t
+{
+    // The bytes of the keyword. The keys have a variable width, and the
+    // keywords can be enumerated.
+    String = 0,
+    // 64 bits hash of the keyword
+    Hash64 = 1,
+    // 128 bits hash of the keyword
+    Hash128 = 2,
+};
+
+// Fixed-width key of a keyword: a hash of Width bytes of the keyword.
+//
+// The keys are compared as integers, or as a few bytes, whatever the length
+// of the keywords. Two keywords with the same hash share their list: with n
+// keywords, the probability of a collision is about n^2 / 2^(8 * Width + 1).
+// The hash does not depend on the platform, and the bytes are in big endian,
+// so that their bytewise order is the order of the words.
+template<size_t Width>
+class HashedKeyword
+{
+public:
+    static_assert(Width == 8 || Width == 16,
+                  "The hashed keywords have 64 or 128 bits");
+
+    static constexpr size_t kWidth     = Width;
+    static constexpr size_t kWordCount = Width / 8;
+
+    explicit HashedKeyword(const Index::keyword_type& keyword);
+
+    // The i-th word of the hash, the first one being the most significant
+    uint64_t word(size_t i) const
+    {
+        return m_words[i];
+    }
+
+    // Append the Width bytes of the hash to out
+    void append_to(std::string* out) const;
+
+private:
+    std::array<uint64_t, kWordCount> m_words;
+};
+
+using HashedKeyword64  = HashedKeyword<8>;
+using HashedKeyword128 = HashedKeyword<16>;
+
+extern template class HashedKeyword<8>;
+extern template class HashedKeyword<16>;
+
+// Width of the keys of type, in bytes, or 0 for the variable width keys
+size_t keyword_key_width(KeywordKeyType type);
+
+// Key of keyword. A String key is the keyword itself, and is returned without
+// any copy: buffer is only used to store the hashed keys.
+const std::string& keyword_key(KeywordKeyType             type,
+                               const Index::keyword_type& keyword,
+                               std::string*               buffer);
+
+} // namespace insecure
+} // namespace sse
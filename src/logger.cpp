@@ -181,4 +181,36 @@ SearchBenchmark::~SearchBenchmark()
                   // is the one of the derived class.
 }
 
+constexpr auto cache_JSON_end
+    = "\", \"items\" : {0}, \"time\" : {1}, \"time/item\" : {2}, "
+      "\"hits\" : {3}, \"misses\" : {4}, \"hit_ratio\" : {5} }}";
+
+CacheBenchmark::CacheBenchmark(std::string message)
+    : Benchmark(search_JSON_begin + std::move(message) + cache_JSON_end)
+{
+}
+
+void CacheBenchmark::trace(
+    std::chrono::duration<double, std::milli> time_ms,
+    std::chrono::duration<double, std::milli> time_per_item)
+{
+    const size_t lookups   = hits_ + misses_;
+    const double hit_ratio = (lookups > 0) ? double(hits_) / lookups : 0.0;
+
+    if (benchmark_logger_) {
+        benchmark_logger_->trace(format_.c_str(),
+                                 count_,
+                                 time_ms.count(),
+                                 time_per_item.count(),
+                                 hits_,
+                                 misses_,
+                                 hit_ratio);
+    }
+}
+
+CacheBenchmark::~CacheBenchmark()
+{
+    stop_trace(); // see ~SearchBenchmark
+}
+
 } // namespace sse
\ No newline at end of file
@@ -104,6 +104,28 @@ private:
     size_t locality_;
 };
 
+class CacheBenchmark : public Benchmark
+{
+public:
+    explicit CacheBenchmark(std::string message);
+
+    void trace(
+        std::chrono::duration<double, std::milli> time_ms,
+        std::chrono::duration<double, std::milli> time_per_item) override;
+
+    void set_cache_stats(size_t hits, size_t misses)
+    {
+        hits_   = hits;
+        misses_ = misses;
+    }
+
+    ~CacheBenchmark() override;
+
+private:
+    size_t hits_{0};
+    size_t misses_{0};
+};
+
 template<typename T>
 class ThroughputBenchmark
 {
@@ -0,0 +1,361 @@
+#include "mapped_multimap.hpp"
+
+#include "utils.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+constexpr char     kMagic[8] = {'S', 'S', 'E', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t kVersion  = 2;
+
+// Layout of the file:
+// - the header
+// - the encoded lists, by increasing keyword
+// - the bytes of all the keywords, padded to a multiple of 8 bytes
+// - the table of entries, by increasing keyword
+// The lists section starts on 8 bytes, so that the lists of the Raw codec
+// are visited in place.
+struct Header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t document_size;
+    uint8_t  codec;
+    uint8_t  reserved[7];
+    uint64_t document_count;
+    uint64_t keywords_offset;
+    uint64_t keywords_length;
+    uint64_t entry_count;
+    uint64_t entries_offset;
+};
+static_assert(sizeof(Header) == 64, "Unexpected snapshot header size");
+
+// Lexicographic comparison of the bytes of two keywords, in the order of
+// std::string
+int compare_keywords(const char* a,
+                     size_t      a_length,
+                     const char* b,
+                     size_t      b_length)
+{
+    int cmp = std::memcmp(a, b, std::min(a_length, b_length));
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (a_length < b_length) ? -1 : (a_length > b_length);
+}
+
+bool is_known_codec(uint8_t codec)
+{
+    return codec == static_cast<uint8_t>(PostingListCodecType::Raw)
+           || codec == static_cast<uint8_t>(PostingListCodecType::DeltaVarint)
+           || codec == static_cast<uint8_t>(PostingListCodecType::BitPacked);
+}
+} // namespace
+
+MappedMultiMap::Writer::Writer(std::string path, PostingListCodecType codec)
+    : m_path(std::move(path)), m_tmp_path(m_path + ".tmp"),
+      m_codec(posting_list_codec(codec)),
+      m_file(m_tmp_path, std::ios::binary | std::ios::trunc)
+{
+    if (!m_file) {
+        throw std::runtime_error(m_tmp_path
+                                 + ": unable to create the snapshot");
+    }
+
+    // The header is only known at the end
+    Header header{};
+    write(&header, sizeof(header));
+}
+
+MappedMultiMap::Writer::~Writer()
+{
+    if (!m_finished) {
+        m_file.close();
+        std::remove(m_tmp_path.c_str());
+    }
+}
+
+void MappedMultiMap::Writer::add(const Index::keyword_type&  keyword,
+                                 const Index::document_type* documents,
+                                 size_t                      n)
+{
+    if (!m_entries.empty() && keyword <= m_last_keyword) {
+        throw std::invalid_argument(
+            "Snapshot keywords must be added in increasing order");
+    }
+
+    m_encoded.clear();
+    if (n > 0) {
+        m_codec.encode(documents, n, &m_encoded);
+    }
+
+    m_entries.push_back(Entry{m_keywords.size(),
+                              keyword.size(),
+                              m_lists_length,
+                              m_encoded.size(),
+                              n});
+    m_keywords.append(keyword);
+    m_last_keyword = keyword;
+
+    write(m_encoded.data(), m_encoded.size());
+    m_lists_length += m_encoded.size();
+    m_document_count += n;
+}
+
+void MappedMultiMap::Writer::finish()
+{
+    // The keywords are aligned on 8 bytes, and their length is padded to 8
+    // bytes, for the entries to be readable in place
+    const uint64_t lists_padding = (8 - m_lists_length % 8) % 8;
+    const char     padding[8]    = {};
+    write(padding, lists_padding);
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version         = kVersion;
+    header.document_size   = sizeof(Index::document_type);
+    header.codec           = static_cast<uint8_t>(m_codec.type());
+    header.document_count  = m_document_count;
+    header.keywords_offset = sizeof(Header) + m_lists_length + lists_padding;
+    header.keywords_length = m_keywords.size();
+    header.entry_count     = m_entries.size();
+    header.entries_offset
+        = header.keywords_offset + ((m_keywords.size() + 7) & ~uint64_t(7));
+
+    m_keywords.resize(header.entries_offset - header.keywords_offset, '\0');
+    write(m_keywords.data(), m_keywords.size());
+    write(m_entries.data(), m_entries.size() * sizeof(Entry));
+
+    m_file.seekp(0);
+    write(&header, sizeof(header));
+
+    m_file.close();
+    if (!m_file) {
+        throw std::runtime_error(m_tmp_path
+                                 + ": unable to write the snapshot");
+    }
+
+    if (std::rename(m_tmp_path.c_str(), m_path.c_str()) != 0) {
+        throw std::runtime_error(m_path + ": unable to move the snapshot; "
+                                 + utility::errno_string());
+    }
+    m_finished = true;
+}
+
+void MappedMultiMap::Writer::write(const void* data, size_t length)
+{
+    if (!m_file.write(reinterpret_cast<const char*>(data), length)) {
+        throw std::runtime_error(m_tmp_path
+                                 + ": unable to write the snapshot");
+    }
+}
+
+MappedMultiMap::MappedMultiMap(const std::string& path) : m_path(path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error(path + ": unable to open the snapshot; "
+                                 + utility::errno_string());
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::string error = utility::errno_string();
+        close(fd);
+        throw std::runtime_error(path + ": unable to stat the snapshot; "
+                                 + error);
+    }
+    m_size = st.st_size;
+
+    if (m_size < sizeof(Header)) {
+        close(fd);
+        throw std::runtime_error(path + ": truncated snapshot");
+    }
+
+    // The pages are only read when they are first accessed
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    std::string error = utility::errno_string();
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(path + ": unable to map the snapshot; "
+                                 + error);
+    }
+    m_data = reinterpret_cast<const char*>(data);
+
+    Header header;
+    std::memcpy(&header, m_data, sizeof(header));
+
+    const char* invalid = nullptr;
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        invalid = ": not a snapshot";
+    } else if (header.version != kVersion
+               || header.document_size != sizeof(Index::document_type)
+               || !is_known_codec(header.codec)) {
+        invalid = ": unsupported snapshot version";
+    } else if (header.keywords_offset < sizeof(Header)
+               || header.entries_offset < header.keywords_offset
+               || header.entries_offset > m_size
+               || header.entries_offset % alignof(Entry) != 0
+               || header.keywords_length
+                      > header.entries_offset - header.keywords_offset
+               || header.entry_count
+                      != (m_size - header.entries_offset) / sizeof(Entry)) {
+        invalid = ": truncated snapshot";
+    }
+    if (invalid != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+        throw std::runtime_error(path + invalid);
+    }
+
+    m_codec = &posting_list_codec(
+        static_cast<PostingListCodecType>(header.codec));
+    m_lists           = m_data + sizeof(Header);
+    m_lists_length    = header.keywords_offset - sizeof(Header);
+    m_keywords        = m_data + header.keywords_offset;
+    m_keywords_length = header.keywords_length;
+    m_entries
+        = reinterpret_cast<const Entry*>(m_data + header.entries_offset);
+    m_entry_count    = header.entry_count;
+    m_document_count = header.document_count;
+}
+
+MappedMultiMap::~MappedMultiMap()
+{
+    munmap(const_cast<char*>(m_data), m_size);
+}
+
+std::vector<Index::document_type> MappedMultiMap::search(
+    const Index::keyword_type& keyword) const
+{
+    std::vector<Index::document_type> result;
+
+    const Entry* entry = find(keyword);
+    if (entry != nullptr) {
+        result.reserve(entry->document_count);
+        if (!m_codec->decode(
+                m_lists + entry->list_offset, entry->list_length, &result)) {
+            throw std::runtime_error(m_path + ": corrupted snapshot");
+        }
+    }
+    return result;
+}
+
+void MappedMultiMap::search(const Index::keyword_type&          keyword,
+                            const Index::document_visitor_type& visitor) const
+{
+    const Entry* entry = find(keyword);
+    if (entry != nullptr
+        && !m_codec->visit(
+            m_lists + entry->list_offset, entry->list_length, visitor)) {
+        throw std::runtime_error(m_path + ": corrupted snapshot");
+    }
+}
+
+Index::MultiSearchResult MappedMultiMap::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    Index::MultiSearchResult result(keywords.size());
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        const Entry* entry = find(keywords[i]);
+        if (entry == nullptr) {
+            result.set_list(i, nullptr, 0);
+        } else if (!m_codec->set_list(&result,
+                                      i,
+                                      m_lists + entry->list_offset,
+                                      entry->list_length)) {
+            throw std::runtime_error(m_path + ": corrupted snapshot");
+        }
+    }
+    return result;
+}
+
+void MappedMultiMap::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    for (size_t i = 0; i < m_entry_count; i++) {
+        visitor(keyword(i));
+    }
+}
+
+void MappedMultiMap::insert(const Index::keyword_type& /*keyword*/,
+                            Index::document_type /*document*/)
+{
+    throw std::logic_error(m_path + ": snapshots are read-only");
+}
+
+Index::keyword_type MappedMultiMap::keyword(size_t i) const
+{
+    const Entry& entry = m_entries[i];
+    if (!is_valid(entry)) {
+        throw std::runtime_error(m_path + ": corrupted snapshot");
+    }
+    return Index::keyword_type(m_keywords + entry.keyword_offset,
+                               entry.keyword_length);
+}
+
+void MappedMultiMap::read_list(size_t                             i,
+                               std::vector<Index::document_type>* list) const
+{
+    const Entry& entry = m_entries[i];
+    if (!is_valid(entry)
+        || !m_codec->decode(
+            m_lists + entry.list_offset, entry.list_length, list)) {
+        throw std::runtime_error(m_path + ": corrupted snapshot");
+    }
+}
+
+const MappedMultiMap::Entry* MappedMultiMap::find(
+    const Index::keyword_type& keyword) const
+{
+    const Entry* first = m_entries;
+    size_t       count = m_entry_count;
+
+    while (count > 0) {
+        const size_t step  = count / 2;
+        const Entry* entry = first + step;
+
+        // The entries of a corrupted file could point outside of the mapping
+        if (!is_valid(*entry)) {
+            return nullptr;
+        }
+
+        int cmp = compare_keywords(m_keywords + entry->keyword_offset,
+                                   entry->keyword_length,
+                                   keyword.data(),
+                                   keyword.size());
+        if (cmp == 0) {
+            return entry;
+        }
+        if (cmp < 0) {
+            first = entry + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return nullptr;
+}
+
+bool MappedMultiMap::is_valid(const Entry& entry) const
+{
+    return entry.keyword_offset <= m_keywords_length
+           && entry.keyword_length <= m_keywords_length - entry.keyword_offset
+           && entry.list_offset <= m_lists_length
+           && entry.list_length <= m_lists_length - entry.list_offset;
+}
+
+} // namespace insecure
+} // namespace sse
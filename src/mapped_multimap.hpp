@@ -0,0 +1,174 @@
+#pragma once
+
+#include "index.hpp"
+#include "posting_list_codec.hpp"
+
+#include <cstdint>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Read-only index over a snapshot file, mapped in memory.
+//
+// A snapshot is a flat, pointer-free image of an index: the encoded document
+// lists stored contiguously, by increasing keyword, followed by the keywords
+// and a sorted table locating the keyword and the list of every entry.
+// Opening a snapshot only maps the file and checks its header: the pages are
+// read by the system when the searches first touch them, so the startup time
+// does not depend on the size of the index.
+//
+// The searches binary search the table. The codec of the lists is stored in
+// the header: with the Raw codec, the lists are passed to the visitors
+// directly from the mapping, and the compressed codecs are used for the
+// segments of a SegmentedIndex. The file is in the byte order of the machine
+// that wrote it.
+//
+// A mapped snapshot is read-only: a StdMultiMap restarted from a snapshot
+// cannot be appended to, and must be saved again from a StdMultiMap to be
+// updated. The restarts of a writable index are provided by SegmentedIndex,
+// that maps its immutable segments and buffers the new documents in memory.
+class MappedMultiMap : public Index
+{
+private:
+    // Entry of the table. The offsets are relative to the sections of the
+    // keywords and of the lists.
+    struct Entry
+    {
+        uint64_t keyword_offset;
+        uint64_t keyword_length;
+        uint64_t list_offset;
+        uint64_t list_length;
+        uint64_t document_count;
+    };
+
+public:
+    // Sequential writer of a snapshot. The lists must be added by strictly
+    // increasing keyword. The snapshot is written to a temporary file, that
+    // is renamed to its path by finish(): an existing snapshot is replaced
+    // atomically, and is left intact if the writer fails.
+    class Writer
+    {
+    public:
+        // Throws std::runtime_error if the temporary file cannot be created
+        explicit Writer(std::string          path,
+                        PostingListCodecType codec = PostingListCodecType::Raw);
+        // Removes the temporary file if finish() was not called
+        ~Writer();
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        // Encode and append the list of keyword. Throws std::invalid_argument
+        // if keyword is not greater than the previous one, and
+        // std::runtime_error on a write error.
+        void add(const Index::keyword_type&  keyword,
+                 const Index::document_type* documents,
+                 size_t                      n);
+
+        // Write the keywords and the table, and move the snapshot in place.
+        // Throws std::runtime_error on a write error.
+        void finish();
+
+    private:
+        void write(const void* data, size_t length);
+
+        const std::string       m_path;
+        const std::string       m_tmp_path;
+        const PostingListCodec& m_codec;
+        std::ofstream           m_file;
+        bool                    m_finished{false};
+
+        std::string        m_keywords;
+        std::string        m_last_keyword;
+        std::string        m_encoded;
+        std::vector<Entry> m_entries;
+        uint64_t           m_lists_length{0};
+        uint64_t           m_document_count{0};
+    };
+
+    // Map the snapshot at path. Throws std::runtime_error if the file cannot
+    // be mapped, or is not a valid snapshot.
+    explicit MappedMultiMap(const std::string& path);
+    ~MappedMultiMap();
+
+    MappedMultiMap(const MappedMultiMap&) = delete;
+    MappedMultiMap& operator=(const MappedMultiMap&) = delete;
+
+    // The searches throw std::runtime_error if a list cannot be decoded
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const override;
+    // With the Raw codec, the visitor is called once, with a pointer in the
+    // mapping
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
+
+    // The keywords are visited in increasing order
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    // The snapshots are immutable: throws std::logic_error
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document) override;
+
+    // Sequential access to the entries, for the merges. The i-th entry is
+    // the one of the i-th keyword, by increasing order. Throw
+    // std::runtime_error if the entry is corrupted.
+    Index::keyword_type keyword(size_t i) const;
+    // Decode the list of the i-th entry, and append it to list
+    void read_list(size_t i, std::vector<Index::document_type>* list) const;
+
+    const std::string& path() const
+    {
+        return m_path;
+    }
+
+    PostingListCodecType codec() const
+    {
+        return m_codec->type();
+    }
+
+    size_t keyword_count() const
+    {
+        return m_entry_count;
+    }
+    size_t document_count() const
+    {
+        return m_document_count;
+    }
+
+    // Size of the mapped file
+    size_t file_size() const
+    {
+        return m_size;
+    }
+
+private:
+    // Entry of keyword, or nullptr if the keyword is not in the snapshot
+    const Entry* find(const Index::keyword_type& keyword) const;
+
+    // Whether the keyword and the list of entry are inside of their sections
+    bool is_valid(const Entry& entry) const;
+
+    const std::string       m_path;
+    const PostingListCodec* m_codec{nullptr};
+
+    const char* m_data{nullptr};
+    size_t      m_size{0};
+
+    const Entry* m_entries{nullptr};
+    size_t       m_entry_count{0};
+    const char*  m_lists{nullptr};
+    size_t       m_lists_length{0};
+    const char*  m_keywords{nullptr};
+    size_t       m_keywords_length{0};
+    size_t       m_document_count{0};
+};
+
+} // namespace insecure
+} // namespace sse
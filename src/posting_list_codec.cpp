@@ -0,0 +1,442 @@
+#include "posting_list_codec.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+// Varints are little endian base 128 integers: 7 bits per byte, the high bit
+// being set on every byte except the last.
+constexpr size_t kMaxVarintLength = 10;
+
+inline void put_varint(uint64_t value, std::string* out)
+{
+    char   buffer[kMaxVarintLength];
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        buffer[length++] = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = static_cast<char>(value);
+
+    out->append(buffer, length);
+}
+
+// Read a varint at *data, and advance *data. Returns false if the varint
+// overflows end.
+inline bool get_varint(const char** data, const char* end, uint64_t* value)
+{
+    uint64_t result = 0;
+
+    for (unsigned shift = 0; shift < 7 * kMaxVarintLength && *data < end;
+         shift += 7) {
+        const uint64_t byte = static_cast<uint8_t>(*((*data)++));
+
+        result |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The documents of a list are not necessarily sorted (they are in insertion
+// order): the deltas are signed, and zigzag encoded so that small negative
+// deltas also map to small integers.
+inline uint64_t zigzag_delta(uint64_t previous, uint64_t current)
+{
+    const uint64_t delta = current - previous;
+    return (delta << 1) ^ (0 - (delta >> 63));
+}
+
+inline uint64_t unzigzag_delta(uint64_t previous, uint64_t zigzag)
+{
+    return previous + ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+}
+
+class RawCodec : public PostingListCodec
+{
+public:
+    PostingListCodecType type() const override
+    {
+        return PostingListCodecType::Raw;
+    }
+
+    const char* name() const override
+    {
+        return "raw";
+    }
+
+    void encode(const Index::document_type* documents,
+                size_t                      n,
+                std::string*                out) const override
+    {
+        out->append(reinterpret_cast<const char*>(documents),
+                    n * sizeof(Index::document_type));
+    }
+
+    bool decode(const char*                        data,
+                size_t                             length,
+                std::vector<Index::document_type>* result) const override
+    {
+        constexpr size_t elt_size = sizeof(Index::document_type);
+
+        const size_t offset = result->size();
+        const size_t n      = length / elt_size;
+
+        // data may be null if the list is empty
+        if (n > 0) {
+            result->resize(offset + n);
+            memcpy(reinterpret_cast<char*>(result->data() + offset),
+                   data,
+                   n * elt_size);
+        }
+
+        return (n * elt_size == length);
+    }
+
+    bool visit(const char*                         data,
+               size_t                              length,
+               const Index::document_visitor_type& visitor) const override
+    {
+        return Index::visit_document_list(data, length, visitor);
+    }
+
+    bool set_list(Index::MultiSearchResult* result,
+                  size_t                    i,
+                  const char*               data,
+                  size_t                    length) const override
+    {
+        return result->set_serialized_list(i, data, length);
+    }
+
+    bool append(const Index::document_type* documents,
+                size_t                      n,
+                std::string*                encoded) const override
+    {
+        encode(documents, n, encoded);
+        return true;
+    }
+};
+
+// Segment: varint(n) || varint(zigzag delta)^n
+class DeltaVarintCodec : public PostingListCodec
+{
+public:
+    PostingListCodecType type() const override
+    {
+        return PostingListCodecType::DeltaVarint;
+    }
+
+    const char* name() const override
+    {
+        return "delta_varint";
+    }
+
+    void encode(const Index::document_type* documents,
+                size_t                      n,
+                std::string*                out) const override
+    {
+        put_varint(n, out);
+
+        Index::document_type previous = 0;
+        for (size_t i = 0; i < n; i++) {
+            put_varint(zigzag_delta(previous, documents[i]), out);
+            previous = documents[i];
+        }
+    }
+
+    bool decode(const char*                        data,
+                size_t                             length,
+                std::vector<Index::document_type>* result) const override
+    {
+        const char* end = data + length;
+
+        while (data < end) {
+            uint64_t n;
+            // every document takes at least one byte
+            if (!get_varint(&data, end, &n)
+                || n > static_cast<uint64_t>(end - data)) {
+                return false;
+            }
+            result->reserve(result->size() + n);
+
+            Index::document_type previous = 0;
+            for (uint64_t i = 0; i < n; i++) {
+                uint64_t zigzag;
+                if (!get_varint(&data, end, &zigzag)) {
+                    return false;
+                }
+                previous = unzigzag_delta(previous, zigzag);
+                result->push_back(previous);
+            }
+        }
+        return true;
+    }
+};
+
+// Segment: varint(n) || block^(n / 128) || varint(zigzag delta)^(n % 128)
+//
+// A block is a byte containing the bit width b of its largest zigzag delta,
+// followed by the 128 deltas packed on b bits. The deltas are interleaved in
+// kLanes lanes of 64 bits words (the i-th delta belongs to the lane
+// i % kLanes), so that the kLanes values unpacked at each step have the same
+// shift: the unpacking loops are vectorized by the compiler, without being
+// tied to an instruction set.
+class BitPackedCodec : public PostingListCodec
+{
+public:
+    PostingListCodecType type() const override
+    {
+        return PostingListCodecType::BitPacked;
+    }
+
+    const char* name() const override
+    {
+        return "bitpacked";
+    }
+
+    void encode(const Index::document_type* documents,
+                size_t                      n,
+                std::string*                out) const override
+    {
+        put_varint(n, out);
+
+        Index::document_type previous = 0;
+        size_t               i        = 0;
+
+        uint64_t deltas[kBlockSize];
+        uint64_t words[kLanes * kValuesPerLane];
+
+        for (; i + kBlockSize <= n; i += kBlockSize) {
+            uint64_t max_delta = 0;
+            for (size_t j = 0; j < kBlockSize; j++) {
+                deltas[j] = zigzag_delta(previous, documents[i + j]);
+                previous  = documents[i + j];
+                max_delta |= deltas[j];
+            }
+
+            unsigned bits = 0;
+            while (bits < 64 && (max_delta >> bits) != 0) {
+                bits++;
+            }
+
+            const size_t n_words = kLanes * words_per_lane(bits);
+            pack(deltas, bits, words);
+
+            out->push_back(static_cast<char>(bits));
+            out->append(reinterpret_cast<const char*>(words),
+                        n_words * sizeof(uint64_t));
+        }
+
+        for (; i < n; i++) {
+            put_varint(zigzag_delta(previous, documents[i]), out);
+            previous = documents[i];
+        }
+    }
+
+    bool decode(const char*                        data,
+                size_t                             length,
+                std::vector<Index::document_type>* result) const override
+    {
+        const char* end = data + length;
+
+        uint64_t words[kLanes * kValuesPerLane];
+
+        while (data < end) {
+            uint64_t n;
+            if (!get_varint(&data, end, &n)
+                || n > static_cast<uint64_t>(end - data) * kBlockSize) {
+                return false;
+            }
+
+            size_t offset = result->size();
+            result->resize(offset + n);
+            Index::document_type* out = result->data() + offset;
+
+            Index::document_type previous = 0;
+            uint64_t             i        = 0;
+
+            for (; i + kBlockSize <= n; i += kBlockSize) {
+                const unsigned bits
+                    = (data < end) ? static_cast<uint8_t>(*(data++)) : 0xFF;
+                const size_t n_bytes
+                    = kLanes * words_per_lane(bits) * sizeof(uint64_t);
+
+                if (bits > 64 || n_bytes > static_cast<size_t>(end - data)) {
+                    result->resize(offset + i);
+                    return false;
+                }
+
+                // copy the words to an aligned buffer
+                memcpy(reinterpret_cast<char*>(words), data, n_bytes);
+                data += n_bytes;
+
+                unpack(words, bits, out + i);
+
+                for (size_t j = 0; j < kBlockSize; j++) {
+                    previous   = unzigzag_delta(previous, out[i + j]);
+                    out[i + j] = previous;
+                }
+            }
+
+            for (; i < n; i++) {
+                uint64_t zigzag;
+                if (!get_varint(&data, end, &zigzag)) {
+                    result->resize(offset + i);
+                    return false;
+                }
+                previous = unzigzag_delta(previous, zigzag);
+                out[i]   = previous;
+            }
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t kBlockSize     = 128;
+    static constexpr size_t kLanes         = 4;
+    static constexpr size_t kValuesPerLane = kBlockSize / kLanes;
+
+    static size_t words_per_lane(unsigned bits)
+    {
+        return (kValuesPerLane * bits + 63) / 64;
+    }
+
+    // Pack the kBlockSize values on bits bits. The values must fit.
+    static void pack(const uint64_t* values, unsigned bits, uint64_t* words)
+    {
+        std::fill(words, words + kLanes * words_per_lane(bits), 0);
+
+        for (size_t j = 0; j < kValuesPerLane && bits > 0; j++) {
+            const size_t   bit   = j * bits;
+            const unsigned shift = bit % 64;
+            uint64_t*      low   = words + (bit / 64) * kLanes;
+
+            for (size_t lane = 0; lane < kLanes; lane++) {
+                low[lane] |= values[j * kLanes + lane] << shift;
+            }
+            if (shift + bits > 64) {
+                uint64_t* high = low + kLanes;
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    high[lane] |= values[j * kLanes + lane] >> (64 - shift);
+                }
+            }
+        }
+    }
+
+    static void unpack(const uint64_t* words, unsigned bits, uint64_t* values)
+    {
+        if (bits == 0) {
+            std::fill(values, values + kBlockSize, 0);
+            return;
+        }
+
+        const uint64_t mask
+            = (bits == 64) ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1);
+
+        for (size_t j = 0; j < kValuesPerLane; j++) {
+            const size_t    bit   = j * bits;
+            const unsigned  shift = bit % 64;
+            const uint64_t* low   = words + (bit / 64) * kLanes;
+            uint64_t*       out   = values + j * kLanes;
+
+            if (shift + bits <= 64) {
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    out[lane] = (low[lane] >> shift) & mask;
+                }
+            } else {
+                const uint64_t* high = low + kLanes;
+                for (size_t lane = 0; lane < kLanes; lane++) {
+                    out[lane] = ((low[lane] >> shift)
+                                 | (high[lane] << (64 - shift)))
+                                & mask;
+                }
+            }
+        }
+    }
+};
+
+constexpr size_t BitPackedCodec::kBlockSize;
+constexpr size_t BitPackedCodec::kLanes;
+constexpr size_t BitPackedCodec::kValuesPerLane;
+} // namespace
+
+bool PostingListCodec::visit(const char*                         data,
+                             size_t                              length,
+                             const Index::document_visitor_type& visitor) const
+{
+    std::vector<Index::document_type> list;
+    bool                              valid = decode(data, length, &list);
+
+    if (!list.empty()) {
+        visitor(list.data(), list.size());
+    }
+    return valid;
+}
+
+bool PostingListCodec::set_list(Index::MultiSearchResult* result,
+                                size_t                    i,
+                                const char*               data,
+                                size_t                    length) const
+{
+    std::vector<Index::document_type> list;
+    bool                              valid = decode(data, length, &list);
+
+    result->set_list(i, list.data(), list.size());
+    return valid;
+}
+
+bool PostingListCodec::append(const Index::document_type* documents,
+                              size_t                      n,
+                              std::string*                encoded) const
+{
+    std::vector<Index::document_type> list;
+    if (!decode(encoded->data(), encoded->size(), &list)) {
+        return false;
+    }
+    list.insert(list.end(), documents, documents + n);
+
+    encoded->clear();
+    encode(list.data(), list.size(), encoded);
+    return true;
+}
+
+const PostingListCodec& posting_list_codec(PostingListCodecType type)
+{
+    static const RawCodec         raw_codec;
+    static const DeltaVarintCodec delta_varint_codec;
+    static const BitPackedCodec   bitpacked_codec;
+
+    switch (type) {
+    case PostingListCodecType::DeltaVarint:
+        return delta_varint_codec;
+    case PostingListCodecType::BitPacked:
+        return bitpacked_codec;
+    case PostingListCodecType::Raw:
+    default:
+        return raw_codec;
+    }
+}
+
+bool parse_posting_list_codec(const std::string&    name,
+                              PostingListCodecType* type)
+{
+    for (PostingListCodecType t : {PostingListCodecType::Raw,
+                                   PostingListCodecType::DeltaVarint,
+                                   PostingListCodecType::BitPacked}) {
+        if (name == posting_list_codec(t).name()) {
+            *type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+enum class PostingListCodecType : uint8_t
+{
+    // Array of native uint64_t
+    Raw = 0,
+    // Zigzag-encoded deltas between consecutive documents, stored as varints
+    DeltaVarint = 1,
+    // Zigzag-encoded deltas, bit-packed by blocks of 128 documents
+    BitPacked = 2,
+};
+
+// Encoding of the document lists stored by the persistent backends.
+//
+// An encoded list is a sequence of self-delimited segments: the concatenation
+// of two encoded lists is the encoding of the concatenation of the lists.
+// This lets the merge operators and the append paths concatenate the encoded
+// values without decoding them.
+// The codec is not stored in the database: the same codec must be used every
+// time a database is opened.
+class PostingListCodec
+{
+public:
+    virtual ~PostingListCodec(){};
+
+    virtual PostingListCodecType type() const = 0;
+    virtual const char*          name() const = 0;
+
+    // Append the encoding of the n documents to out, as a single segment
+    virtual void encode(const Index::document_type* documents,
+                        size_t                      n,
+                        std::string*                out) const = 0;
+
+    // Decode an encoded list and append its documents to result.
+    // Returns false if the data is corrupted.
+    virtual bool decode(const char*                        data,
+                        size_t                             length,
+                        std::vector<Index::document_type>* result) const = 0;
+
+    // Decode an encoded list and pass it to visitor, as specified by
+    // Index::search(keyword, visitor). The default implementation decodes the
+    // whole list first.
+    virtual bool visit(const char*                         data,
+                       size_t                              length,
+                       const Index::document_visitor_type& visitor) const;
+
+    // Decode an encoded list and set it as the i-th list of result.
+    virtual bool set_list(Index::MultiSearchResult* result,
+                          size_t                    i,
+                          const char*               data,
+                          size_t                    length) const;
+
+    // Append n documents to the encoded list. The default implementation
+    // decodes the list and encodes it again as a single segment, which
+    // compresses better than appending a new segment.
+    virtual bool append(const Index::document_type* documents,
+                        size_t                      n,
+                        std::string*                encoded) const;
+};
+
+// Get the codec of the given type. The codecs are stateless singletons.
+const PostingListCodec& posting_list_codec(PostingListCodecType type);
+
+// Get the type of a codec from its name ("raw", "delta_varint" or
+// "bitpacked"). Returns false if the name is unknown.
+bool parse_posting_list_codec(const std::string&    name,
+                              PostingListCodecType* type);
+
+} // namespace insecure
+} // namespace sse
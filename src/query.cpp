@@ -0,0 +1,680 @@
+#include "query.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+using document_type = Index::document_type;
+
+// Above this ratio between the sizes of two lists, the intersection gallops
+// in the largest list instead of scanning it
+constexpr size_t kGallopingRatio = 32;
+
+// Number of documents produced at once by the conjunctions, and passed to the
+// visitor
+constexpr size_t kBlockSize = 512;
+
+// Return the first position in [first, last) whose document is greater than
+// or equal to target. Probes exponentially growing distances before the
+// binary search, so that short skips are cheap.
+const document_type* gallop(const document_type* first,
+                            const document_type* last,
+                            document_type        target)
+{
+    size_t step = 1;
+    while (first + step < last && first[step] < target) {
+        first += step;
+        step *= 2;
+    }
+    return std::lower_bound(first, std::min(first + step + 1, last), target);
+}
+
+// Same as gallop, for the first document strictly greater than target
+const document_type* gallop_upper(const document_type* first,
+                                  const document_type* last,
+                                  document_type        target)
+{
+    size_t step = 1;
+    while (first + step < last && first[step] <= target) {
+        first += step;
+        step *= 2;
+    }
+    return std::upper_bound(first, std::min(first + step + 1, last), target);
+}
+
+size_t intersect_galloping(const document_type* small,
+                           size_t               n_small,
+                           const document_type* large,
+                           size_t               n_large,
+                           document_type*       out)
+{
+    const document_type* large_end = large + n_large;
+    size_t               n         = 0;
+
+    for (size_t i = 0; i < n_small && large != large_end; i++) {
+        large = gallop(large, large_end, small[i]);
+        if (large != large_end && *large == small[i]) {
+            out[n++] = small[i];
+        }
+    }
+    return n;
+}
+
+size_t intersect_scalar(const document_type* a,
+                        size_t               na,
+                        const document_type* b,
+                        size_t               nb,
+                        document_type*       out)
+{
+    size_t i = 0, j = 0, n = 0;
+
+    while (i < na && j < nb) {
+        // branchless merge step
+        const document_type x = a[i], y = b[j];
+        out[n] = x;
+        n += (x == y);
+        i += (x <= y);
+        j += (y <= x);
+    }
+    return n;
+}
+
+#ifdef __AVX2__
+// Compare every document of a to 4 documents of b at once, skipping the
+// blocks of 4 documents of b that are all smaller.
+size_t intersect_avx2(const document_type* a,
+                      size_t               na,
+                      const document_type* b,
+                      size_t               nb,
+                      document_type*       out)
+{
+    size_t i = 0, j = 0, n = 0;
+
+    // invariant: all the documents before b[j] are smaller than a[i]
+    while (i < na && j + 4 <= nb) {
+        const document_type x = a[i];
+
+        if (b[j + 3] < x) {
+            j += 4;
+            continue;
+        }
+
+        const __m256i block
+            = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+        const __m256i equal = _mm256_cmpeq_epi64(
+            block, _mm256_set1_epi64x(static_cast<long long>(x)));
+
+        out[n] = x;
+        n += (_mm256_movemask_epi8(equal) != 0);
+        i++;
+    }
+    return n + intersect_scalar(a + i, na - i, b + j, nb - j, out + n);
+}
+#endif
+
+class ListIterator : public PostingIterator
+{
+public:
+    explicit ListIterator(const std::vector<document_type>& list)
+        : m_position(list.data()), m_end(list.data() + list.size())
+    {
+    }
+
+    bool at_end() const override
+    {
+        return m_position == m_end;
+    }
+    document_type document() const override
+    {
+        return *m_position;
+    }
+    void next() override
+    {
+        m_position++;
+    }
+    void advance(document_type target) override
+    {
+        if (m_position != m_end && *m_position < target) {
+            m_position = gallop(m_position, m_end, target);
+        }
+    }
+    size_t cost() const override
+    {
+        return m_end - m_position;
+    }
+
+private:
+    const document_type* m_position;
+    const document_type* m_end;
+};
+
+// Conjunction of posting lists, evaluated by blocks of the smallest list:
+// every block is intersected with the matching ranges of the other lists,
+// from the smallest to the largest.
+class ListConjunctionIterator : public PostingIterator
+{
+public:
+    explicit ListConjunctionIterator(
+        std::vector<const std::vector<document_type>*> lists)
+    {
+        std::sort(lists.begin(),
+                  lists.end(),
+                  [](const std::vector<document_type>* a,
+                     const std::vector<document_type>* b) {
+                      return a->size() < b->size();
+                  });
+
+        for (const auto* list : lists) {
+            m_cursors.emplace_back(list->data(), list->data() + list->size());
+        }
+        m_buffers[0].resize(kBlockSize);
+        m_buffers[1].resize(kBlockSize);
+
+        fill_block();
+    }
+
+    bool at_end() const override
+    {
+        return m_block_position == m_block_size;
+    }
+    document_type document() const override
+    {
+        return m_block[m_block_position];
+    }
+    void next() override
+    {
+        if (++m_block_position == m_block_size) {
+            fill_block();
+        }
+    }
+    void advance(document_type target) override
+    {
+        if (at_end() || document() >= target) {
+            return;
+        }
+
+        if (m_block[m_block_size - 1] >= target) {
+            m_block_position = std::lower_bound(m_block + m_block_position,
+                                                m_block + m_block_size,
+                                                target)
+                               - m_block;
+            return;
+        }
+
+        // skip the whole block, and the documents before target
+        auto& smallest = m_cursors.front();
+        smallest.first = gallop(smallest.first, smallest.second, target);
+        fill_block();
+    }
+    size_t cost() const override
+    {
+        return (m_block_size - m_block_position)
+               + (m_cursors.front().second - m_cursors.front().first);
+    }
+
+private:
+    void fill_block()
+    {
+        m_block_position = 0;
+        m_block_size     = 0;
+
+        auto& smallest = m_cursors.front();
+
+        while (m_block_size == 0 && smallest.first != smallest.second) {
+            const size_t n_block = std::min<size_t>(
+                kBlockSize, smallest.second - smallest.first);
+
+            const document_type* block = smallest.first;
+            size_t               n     = n_block;
+            smallest.first += n_block;
+
+            const document_type low  = block[0];
+            const document_type high = block[n_block - 1];
+
+            for (size_t i = 1; i < m_cursors.size() && n > 0; i++) {
+                auto& cursor = m_cursors[i];
+
+                // the range of the list that can match the block
+                cursor.first = gallop(cursor.first, cursor.second, low);
+                const document_type* range_end
+                    = gallop_upper(cursor.first, cursor.second, high);
+
+                document_type* out = m_buffers[i % 2].data();
+                n                  = intersect_sorted_lists(
+                    block, n, cursor.first, range_end - cursor.first, out);
+
+                block        = out;
+                cursor.first = range_end;
+            }
+
+            m_block      = block;
+            m_block_size = n;
+        }
+    }
+
+    std::vector<std::pair<const document_type*, const document_type*>>
+        m_cursors;
+
+    std::vector<document_type> m_buffers[2];
+
+    const document_type* m_block{nullptr};
+    size_t               m_block_size{0};
+    size_t               m_block_position{0};
+};
+
+// Conjunction of arbitrary iterators: the iterators leapfrog each other,
+// starting from the cheapest one.
+class AndIterator : public PostingIterator
+{
+public:
+    explicit AndIterator(std::vector<std::unique_ptr<PostingIterator>> children)
+        : m_children(std::move(children))
+    {
+        std::sort(m_children.begin(),
+                  m_children.end(),
+                  [](const std::unique_ptr<PostingIterator>& a,
+                     const std::unique_ptr<PostingIterator>& b) {
+                      return a->cost() < b->cost();
+                  });
+        find_match();
+    }
+
+    bool at_end() const override
+    {
+        return m_at_end;
+    }
+    document_type document() const override
+    {
+        return m_children.front()->document();
+    }
+    void next() override
+    {
+        m_children.front()->next();
+        find_match();
+    }
+    void advance(document_type target) override
+    {
+        m_children.front()->advance(target);
+        find_match();
+    }
+    size_t cost() const override
+    {
+        return m_children.front()->cost();
+    }
+
+private:
+    // Move the iterators to the next document they all contain
+    void find_match()
+    {
+        PostingIterator& lead = *m_children.front();
+
+        while (!lead.at_end()) {
+            const document_type candidate = lead.document();
+            bool                match     = true;
+
+            for (size_t i = 1; i < m_children.size(); i++) {
+                PostingIterator& child = *m_children[i];
+
+                child.advance(candidate);
+                if (child.at_end()) {
+                    m_at_end = true;
+                    return;
+                }
+                if (child.document() != candidate) {
+                    lead.advance(child.document());
+                    match = false;
+                    break;
+                }
+            }
+
+            if (match) {
+                return;
+            }
+        }
+        m_at_end = true;
+    }
+
+    std::vector<std::unique_ptr<PostingIterator>> m_children;
+    bool                                          m_at_end{false};
+};
+
+class OrIterator : public PostingIterator
+{
+public:
+    explicit OrIterator(std::vector<std::unique_ptr<PostingIterator>> children)
+        : m_children(std::move(children))
+    {
+        update();
+    }
+
+    bool at_end() const override
+    {
+        return m_at_end;
+    }
+    document_type document() const override
+    {
+        return m_document;
+    }
+    void next() override
+    {
+        for (auto& child : m_children) {
+            if (!child->at_end() && child->document() == m_document) {
+                child->next();
+            }
+        }
+        update();
+    }
+    void advance(document_type target) override
+    {
+        for (auto& child : m_children) {
+            child->advance(target);
+        }
+        update();
+    }
+    size_t cost() const override
+    {
+        size_t cost = 0;
+        for (const auto& child : m_children) {
+            cost += child->cost();
+        }
+        return cost;
+    }
+
+private:
+    // Set the current document to the smallest document of the children
+    void update()
+    {
+        m_at_end = true;
+        for (const auto& child : m_children) {
+            if (!child->at_end()
+                && (m_at_end || child->document() < m_document)) {
+                m_document = child->document();
+                m_at_end   = false;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<PostingIterator>> m_children;
+    document_type                                 m_document{0};
+    bool                                          m_at_end{true};
+};
+
+// Documents of positive that are not in negative
+class ExclusionIterator : public PostingIterator
+{
+public:
+    ExclusionIterator(std::unique_ptr<PostingIterator> positive,
+                      std::unique_ptr<PostingIterator> negative)
+        : m_positive(std::move(positive)), m_negative(std::move(negative))
+    {
+        skip_excluded();
+    }
+
+    bool at_end() const override
+    {
+        return m_positive->at_end();
+    }
+    document_type document() const override
+    {
+        return m_positive->document();
+    }
+    void next() override
+    {
+        m_positive->next();
+        skip_excluded();
+    }
+    void advance(document_type target) override
+    {
+        m_positive->advance(target);
+        skip_excluded();
+    }
+    size_t cost() const override
+    {
+        return m_positive->cost();
+    }
+
+private:
+    void skip_excluded()
+    {
+        while (!m_positive->at_end()) {
+            const document_type doc = m_positive->document();
+
+            m_negative->advance(doc);
+            if (m_negative->at_end() || m_negative->document() != doc) {
+                return;
+            }
+            m_positive->next();
+        }
+    }
+
+    std::unique_ptr<PostingIterator> m_positive;
+    std::unique_ptr<PostingIterator> m_negative;
+};
+
+using PostingLists = std::map<Index::keyword_type, std::vector<document_type>>;
+
+std::unique_ptr<PostingIterator> build_iterator(const Query&        query,
+                                                const PostingLists& lists);
+
+std::unique_ptr<PostingIterator> build_disjunction(
+    std::vector<std::unique_ptr<PostingIterator>> iterators)
+{
+    if (iterators.size() == 1) {
+        return std::move(iterators.front());
+    }
+    return std::unique_ptr<PostingIterator>(
+        new OrIterator(std::move(iterators)));
+}
+
+std::unique_ptr<PostingIterator> build_conjunction(const Query&        query,
+                                                   const PostingLists& lists)
+{
+    std::vector<const std::vector<document_type>*> keyword_lists;
+    std::vector<std::unique_ptr<PostingIterator>>  positives;
+    std::vector<std::unique_ptr<PostingIterator>>  negatives;
+
+    for (const Query& operand : query.operands()) {
+        switch (operand.op()) {
+        case Query::Operator::Keyword:
+            keyword_lists.push_back(&lists.at(operand.keyword()));
+            break;
+        case Query::Operator::Not:
+            negatives.push_back(
+                build_iterator(operand.operands().front(), lists));
+            break;
+        default:
+            positives.push_back(build_iterator(operand, lists));
+            break;
+        }
+    }
+
+    // The plain lists are intersected by blocks
+    if (keyword_lists.size() == 1) {
+        positives.emplace_back(new ListIterator(*keyword_lists.front()));
+    } else if (keyword_lists.size() > 1) {
+        positives.emplace_back(
+            new ListConjunctionIterator(std::move(keyword_lists)));
+    }
+
+    if (positives.empty()) {
+        throw std::invalid_argument(
+            "Query: a conjunction must have a positive operand");
+    }
+
+    std::unique_ptr<PostingIterator> result;
+    if (positives.size() == 1) {
+        result = std::move(positives.front());
+    } else {
+        result.reset(new AndIterator(std::move(positives)));
+    }
+
+    if (!negatives.empty()) {
+        result.reset(new ExclusionIterator(
+            std::move(result), build_disjunction(std::move(negatives))));
+    }
+    return result;
+}
+
+std::unique_ptr<PostingIterator> build_iterator(const Query&        query,
+                                                const PostingLists& lists)
+{
+    switch (query.op()) {
+    case Query::Operator::Keyword:
+        return std::unique_ptr<PostingIterator>(
+            new ListIterator(lists.at(query.keyword())));
+    case Query::Operator::And:
+        return build_conjunction(query, lists);
+    case Query::Operator::Or: {
+        std::vector<std::unique_ptr<PostingIterator>> iterators;
+        for (const Query& operand : query.operands()) {
+            iterators.push_back(build_iterator(operand, lists));
+        }
+        return build_disjunction(std::move(iterators));
+    }
+    case Query::Operator::Not:
+    default:
+        throw std::invalid_argument(
+            "Query: a negation must be an operand of a conjunction");
+    }
+}
+} // namespace
+
+Query::Query(Operator            op,
+             Index::keyword_type keyword,
+             std::vector<Query>  operands)
+    : m_op(op), m_keyword(std::move(keyword)), m_operands(std::move(operands))
+{
+}
+
+Query Query::keyword(const Index::keyword_type& keyword)
+{
+    return Query(Operator::Keyword, keyword, {});
+}
+
+Query Query::conjunction(std::vector<Query> operands)
+{
+    if (operands.empty()) {
+        throw std::invalid_argument("Query: empty conjunction");
+    }
+    return Query(Operator::And, Index::keyword_type(), std::move(operands));
+}
+
+Query Query::disjunction(std::vector<Query> operands)
+{
+    if (operands.empty()) {
+        throw std::invalid_argument("Query: empty disjunction");
+    }
+    return Query(Operator::Or, Index::keyword_type(), std::move(operands));
+}
+
+Query Query::negation(Query operand)
+{
+    std::vector<Query> operands;
+    operands.push_back(std::move(operand));
+    return Query(Operator::Not, Index::keyword_type(), std::move(operands));
+}
+
+void Query::collect_keywords(std::vector<Index::keyword_type>* keywords) const
+{
+    if (m_op == Operator::Keyword) {
+        keywords->push_back(m_keyword);
+    }
+    for (const Query& operand : m_operands) {
+        operand.collect_keywords(keywords);
+    }
+}
+
+size_t intersect_sorted_lists(const document_type* a,
+                              size_t               na,
+                              const document_type* b,
+                              size_t               nb,
+                              document_type*       out)
+{
+    if (na > nb) {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    if (na == 0) {
+        return 0;
+    }
+
+    if (nb / na >= kGallopingRatio) {
+        return intersect_galloping(a, na, b, nb, out);
+    }
+#ifdef __AVX2__
+    return intersect_avx2(a, na, b, nb, out);
+#else
+    return intersect_scalar(a, na, b, nb, out);
+#endif
+}
+
+QueryEngine::QueryEngine(const Index& index) : m_index(index)
+{
+}
+
+void QueryEngine::execute(const Query&                        query,
+                          const Index::document_visitor_type& visitor) const
+{
+    std::vector<Index::keyword_type> keywords;
+    query.collect_keywords(&keywords);
+
+    std::sort(keywords.begin(), keywords.end());
+    keywords.erase(std::unique(keywords.begin(), keywords.end()),
+                   keywords.end());
+
+    // Fetch all the lists at once, and sort them
+    PostingLists lists;
+    {
+        Index::MultiSearchResult results = m_index.search_many(keywords);
+
+        for (size_t i = 0; i < keywords.size(); i++) {
+            std::vector<document_type>& list = lists[keywords[i]];
+
+            list.assign(results.list(i),
+                        results.list(i) + results.list_size(i));
+            if (!std::is_sorted(list.begin(), list.end())) {
+                std::sort(list.begin(), list.end());
+            }
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+        }
+    }
+
+    std::unique_ptr<PostingIterator> iterator = build_iterator(query, lists);
+
+    document_type buffer[kBlockSize];
+    size_t        n = 0;
+
+    for (; !iterator->at_end(); iterator->next()) {
+        buffer[n++] = iterator->document();
+
+        if (n == kBlockSize) {
+            visitor(buffer, n);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        visitor(buffer, n);
+    }
+}
+
+std::vector<Index::document_type> QueryEngine::execute(const Query& query) const
+{
+    std::vector<Index::document_type> results;
+
+    execute(query, [&results](const document_type* documents, size_t n) {
+        results.insert(results.end(), documents, documents + n);
+    });
+    return results;
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Boolean query over the keywords of an index, e.g.
+//   Query::conjunction({Query::keyword("a"),
+//                       Query::keyword("b"),
+//                       Query::negation(Query::keyword("c"))})
+// for a AND b AND NOT c.
+class Query
+{
+public:
+    enum class Operator
+    {
+        Keyword,
+        And,
+        Or,
+        Not,
+    };
+
+    static Query keyword(const Index::keyword_type& keyword);
+    static Query conjunction(std::vector<Query> operands);
+    static Query disjunction(std::vector<Query> operands);
+    // A negation is only allowed as an operand of a conjunction that also
+    // has positive operands.
+    static Query negation(Query operand);
+
+    Operator op() const
+    {
+        return m_op;
+    }
+    const Index::keyword_type& keyword() const
+    {
+        return m_keyword;
+    }
+    const std::vector<Query>& operands() const
+    {
+        return m_operands;
+    }
+
+    // Append the keywords of the query to keywords (with repetitions)
+    void collect_keywords(std::vector<Index::keyword_type>* keywords) const;
+
+private:
+    Query(Operator            op,
+          Index::keyword_type keyword,
+          std::vector<Query>  operands);
+
+    Operator            m_op;
+    Index::keyword_type m_keyword;
+    std::vector<Query>  m_operands;
+};
+
+// Iterator over a sorted list of documents, without duplicates
+class PostingIterator
+{
+public:
+    virtual ~PostingIterator(){};
+
+    virtual bool at_end() const = 0;
+    // Current document. Only valid if !at_end().
+    virtual Index::document_type document() const = 0;
+
+    virtual void next() = 0;
+    // Move to the first document greater than or equal to target. Does not
+    // move backwards.
+    virtual void advance(Index::document_type target) = 0;
+
+    // Upper bound on the number of remaining documents, used to plan the
+    // queries
+    virtual size_t cost() const = 0;
+};
+
+// Evaluate boolean queries on an index.
+// The posting lists are fetched with a single Index::search_many call, and
+// sorted when the backend does not return them sorted. The query is then
+// evaluated by combining iterators over these lists: the result is streamed
+// and no intermediate result is materialized. The conjunctions are evaluated
+// smallest list first, using galloping (and SIMD when available) to skip the
+// documents of the larger lists.
+class QueryEngine
+{
+public:
+    explicit QueryEngine(const Index& index);
+
+    // Pass the documents matching query to visitor, sorted and without
+    // duplicates, by consecutive blocks.
+    // Throws std::invalid_argument if the query contains a negation that is
+    // not an operand of a conjunction with positive operands.
+    void execute(const Query&                        query,
+                 const Index::document_visitor_type& visitor) const;
+
+    std::vector<Index::document_type> execute(const Query& query) const;
+
+private:
+    const Index& m_index;
+};
+
+// Intersection kernel on sorted lists without duplicates. Writes the
+// intersection of a and b to out (which must have room for min(na, nb)
+// documents), and returns its size.
+size_t intersect_sorted_lists(const Index::document_type* a,
+                              size_t                      na,
+                              const Index::document_type* b,
+                              size_t                      nb,
+                              Index::document_type*       out);
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,235 @@
+#include "rocksdb_bulk_loader.hpp"
+
+#include <rocksdb/db.h>
+#include <rocksdb/env.h>
+#include <rocksdb/options.h>
+#include <rocksdb/sst_file_writer.h>
+
+#include <condition_variable>
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+void check_status(const rocksdb::Status& s, const std::string& what)
+{
+    if (!s.ok()) {
+        throw std::runtime_error(what + "\nRocksdb status: " + s.ToString());
+    }
+}
+} // namespace
+
+RocksDBBulkLoader::RocksDBBulkLoader(rocksdb::DB*   db,
+                                     std::string    directory,
+                                     size_t         key_space_count,
+                                     encoder_type   encoder,
+                                     const Options& options)
+    : m_db(db), m_directory(std::move(directory)),
+      m_key_space_count(key_space_count), m_encoder(std::move(encoder)),
+      m_options(options)
+{
+    if (m_db == nullptr) {
+        throw std::invalid_argument("The database is not open");
+    }
+}
+
+RocksDBBulkLoader::Stats RocksDBBulkLoader::load(const source_type& source)
+{
+    const size_t n_threads
+        = (m_options.thread_count > 0)
+              ? m_options.thread_count
+              : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    ExternalSorter::Options sort_options;
+    sort_options.run_capacity_bytes = m_options.run_capacity_bytes;
+    sort_options.thread_count       = n_threads;
+
+    // The SST files are written next to the runs: the sorter removes them
+    // all at the end of the load
+    ExternalSorter sorter(m_directory, sort_options);
+    sorter.sort(source);
+
+    // The ranges of lists waiting for a writer. The queue is bounded, so that
+    // the merge does not get ahead of the writers.
+    const size_t max_pending_ranges = 2 * n_threads;
+
+    std::mutex                                            mtx;
+    std::condition_variable                               ranges_cv;
+    std::condition_variable                               space_cv;
+    std::deque<std::pair<size_t, std::vector<list_type>>> ranges;
+    std::map<size_t, std::vector<std::string>>            range_files;
+    bool                                                  merge_done = false;
+    std::exception_ptr                                    error;
+
+    auto set_error = [&](std::exception_ptr e) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!error) {
+            error = e;
+        }
+        ranges_cv.notify_all();
+        space_cv.notify_all();
+    };
+
+    auto writer = [&]() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            ranges_cv.wait(lock, [&]() {
+                return !ranges.empty() || merge_done || error;
+            });
+            if (error || ranges.empty()) {
+                return;
+            }
+
+            std::pair<size_t, std::vector<list_type>> pending
+                = std::move(ranges.front());
+            ranges.pop_front();
+            space_cv.notify_one();
+            lock.unlock();
+
+            std::vector<std::string> files;
+            try {
+                files = write_range(pending.first, pending.second);
+            } catch (...) {
+                set_error(std::current_exception());
+                return;
+            }
+
+            lock.lock();
+            range_files[pending.first] = std::move(files);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; i++) {
+        threads.emplace_back(writer);
+    }
+
+    // Cut the merged lists in ranges of consecutive keywords
+    std::vector<list_type> range;
+    size_t                 range_bytes = 0;
+    size_t                 range_id    = 0;
+
+    auto submit_range = [&]() {
+        std::unique_lock<std::mutex> lock(mtx);
+        space_cv.wait(lock, [&]() {
+            return ranges.size() < max_pending_ranges || error;
+        });
+        if (error) {
+            return false;
+        }
+        ranges.emplace_back(range_id++, std::move(range));
+        ranges_cv.notify_one();
+
+        range.clear();
+        range_bytes = 0;
+        return true;
+    };
+
+    try {
+        sorter.merge([&](list_type&& list) {
+            range_bytes += list.second.size() * sizeof(Index::document_type);
+            range.push_back(std::move(list));
+
+            return range_bytes < m_options.target_file_size || submit_range();
+        });
+
+        if (!range.empty()) {
+            submit_range();
+        }
+    } catch (...) {
+        set_error(std::current_exception());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        merge_done = true;
+    }
+    ranges_cv.notify_all();
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    Stats stats;
+    stats.entry_count   = sorter.stats().entry_count;
+    stats.keyword_count = sorter.stats().keyword_count;
+    stats.run_count     = sorter.stats().run_count;
+
+    // The files of a key space cover disjoint ranges of keys: they are all
+    // ingested in the bottommost level, in a single atomic operation
+    std::vector<std::string> files;
+    for (size_t space = 0; space < m_key_space_count; space++) {
+        for (const auto& range_file : range_files) {
+            if (!range_file.second[space].empty()) {
+                files.push_back(range_file.second[space]);
+            }
+        }
+    }
+    stats.file_count = files.size();
+
+    if (!files.empty()) {
+        rocksdb::IngestExternalFileOptions ingest_options;
+        ingest_options.move_files = true;
+
+        check_status(m_db->IngestExternalFile(files, ingest_options),
+                     "Unable to ingest the bulk loaded files");
+    }
+    return stats;
+}
+
+std::vector<std::string> RocksDBBulkLoader::write_range(
+    size_t                        id,
+    const std::vector<list_type>& lists)
+{
+    std::vector<sst_entries_type> key_spaces(m_key_space_count);
+    for (const auto& list : lists) {
+        m_encoder(list.first, list.second, &key_spaces);
+    }
+
+    const rocksdb::Options   options = m_db->GetOptions();
+    std::vector<std::string> paths(m_key_space_count);
+
+    for (size_t space = 0; space < m_key_space_count; space++) {
+        sst_entries_type& entries = key_spaces[space];
+        if (entries.empty()) {
+            continue;
+        }
+
+        // The keys of a same keyword are not necessarily emitted in order
+        std::sort(entries.begin(),
+                  entries.end(),
+                  [](const std::pair<std::string, std::string>& a,
+                     const std::pair<std::string, std::string>& b) {
+                      return a.first < b.first;
+                  });
+
+        paths[space] = m_directory + "/" + std::to_string(space) + "_"
+                       + std::to_string(id) + ".sst";
+
+        rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), options);
+        check_status(writer.Open(paths[space]),
+                     "Unable to create " + paths[space]);
+
+        for (const auto& kv : entries) {
+            check_status(writer.Put(kv.first, kv.second),
+                         "Unable to write " + paths[space]);
+        }
+        check_status(writer.Finish(), "Unable to write " + paths[space]);
+    }
+    return paths;
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "external_sorter.hpp"
+#include "index.hpp"
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rocksdb {
+class DB;
+} // namespace rocksdb
+
+namespace sse {
+namespace insecure {
+
+// Bulk build of the lists of a RocksDB backend, bypassing the memtable, the
+// WAL and the compactions.
+//
+// The (keyword, document) pairs are grouped into complete lists by an
+// ExternalSorter, and the lists are cut into ranges of consecutive keywords.
+// Each range is encoded and written as SST files by a pool of threads, and
+// all the files are ingested at once: the lists are written to disk a single
+// time, without any further compaction.
+//
+// The documents of a keyword are kept in the order of the source. The loaded
+// lists replace the existing lists of the same keywords: the loader is meant
+// to build an index from scratch.
+class RocksDBBulkLoader
+{
+public:
+    using source_type = ExternalSorter::source_type;
+
+    // Key-value pairs written to a SST file
+    using sst_entries_type = std::vector<std::pair<std::string, std::string>>;
+
+    // Encode the list of keyword as key-value pairs, and append them to
+    // (*key_spaces)[i] for the i-th key space of the database layout. The key
+    // spaces must be disjoint ranges of keys, and in every space, the keys of
+    // a keyword must be greater than the keys of the smaller keywords.
+    using encoder_type
+        = std::function<void(const Index::keyword_type&               keyword,
+                             const std::vector<Index::document_type>& documents,
+                             std::vector<sst_entries_type>* key_spaces)>;
+
+    struct Options
+    {
+        // Memory used by the pairs of a sorted run (see
+        // ExternalSorter::Options)
+        size_t run_capacity_bytes{256 * 1024 * 1024};
+        // Size of the documents of a range of keywords, before encoding. Each
+        // range is written to a SST file per key space.
+        size_t target_file_size{64 * 1024 * 1024};
+        // Number of threads sorting the runs, and writing the SST files.
+        // Zero means one per core.
+        size_t thread_count{0};
+    };
+
+    struct Stats
+    {
+        size_t entry_count{0};
+        size_t keyword_count{0};
+        // Number of sorted runs, including the last one, that stays in memory
+        size_t run_count{0};
+        size_t file_count{0};
+    };
+
+    // The sorted runs and the SST files are written in directory, that is
+    // created if needed, and removed at the end of the load.
+    RocksDBBulkLoader(rocksdb::DB*   db,
+                      std::string    directory,
+                      size_t         key_space_count,
+                      encoder_type   encoder,
+                      const Options& options);
+
+    // Load all the pairs of source. Throws std::runtime_error if the runs or
+    // the SST files cannot be written, or if the ingestion fails, in which
+    // case the database is left unchanged.
+    Stats load(const source_type& source);
+
+private:
+    using list_type = ExternalSorter::list_type;
+
+    // Encode a range of lists, and write it as SST files. Returns the paths of
+    // the files, indexed by key space (empty if a space has no key).
+    std::vector<std::string> write_range(size_t                        id,
+                                         const std::vector<list_type>& lists);
+
+    rocksdb::DB*       m_db;
+    const std::string  m_directory;
+    const size_t       m_key_space_count;
+    const encoder_type m_encoder;
+    const Options      m_options;
+};
+
+} // namespace insecure
+} // namespace sse
@@ -3,41 +3,129 @@
 #include "utils.hpp"
 
 #include <rocksdb/db.h>
+#include <rocksdb/iterator.h>
 #include <rocksdb/memtablerep.h>
 #include <rocksdb/merge_operator.h>
 #include <rocksdb/options.h>
+#include <rocksdb/slice.h>
 #include <rocksdb/table.h>
+#include <rocksdb/write_batch.h>
 
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <thread>
+#include <vector>
 
 namespace sse {
 namespace insecure {
 
 std::atomic<size_t> rocksdb_merge_counter_{0};
 
-class ResultListMergeOperator : public rocksdb::AssociativeMergeOperator
+namespace {
+// While a thread is searching, points to the list of the keys that were
+// resolved by this thread by folding at least tl_materialization_threshold
+// merge operands.
+thread_local std::vector<std::string>* tl_heavy_merges              = nullptr;
+thread_local size_t                    tl_materialization_threshold = 0;
+
+// Collect the heavy merges of the current thread during the lifetime of the
+// object.
+class HeavyMergeCollector
 {
 public:
-    virtual bool Merge(const rocksdb::Slice& key,
-                       const rocksdb::Slice* existing_value,
-                       const rocksdb::Slice& value,
-                       std::string*          new_value,
-                       rocksdb::Logger*      logger) const override
+    explicit HeavyMergeCollector(size_t threshold)
     {
-        rocksdb_merge_counter_++;
-        if (!existing_value) {
-            *new_value = std::string(value.data(), value.size());
-            return true;
+        if (threshold > 0) {
+            tl_heavy_merges              = &keys_;
+            tl_materialization_threshold = threshold;
         }
+    }
+
+    ~HeavyMergeCollector()
+    {
+        tl_heavy_merges = nullptr;
+    }
 
-        size_t concat_size = value.size() + existing_value->size();
+    std::vector<std::string>& keys()
+    {
+        return keys_;
+    }
+
+private:
+    std::vector<std::string> keys_;
+};
+} // namespace
 
-        *new_value = std::string();
-        new_value->reserve(concat_size); // only one memory allocation here
-        new_value->append(value.data(), value.size());
+// Concatenate the serialized lists of the operands, after the existing
+// value. The total size is computed first, so that the result is built with
+// a single allocation and a single copy of every operand.
+template<class Iterator>
+void concatenate_lists(const rocksdb::Slice* existing_value,
+                       Iterator              begin,
+                       Iterator              end,
+                       std::string*          new_value)
+{
+    size_t concat_size = (existing_value) ? existing_value->size() : 0;
+    for (Iterator it = begin; it != end; ++it) {
+        concat_size += it->size();
+    }
+
+    new_value->clear();
+    new_value->reserve(concat_size); // only one memory allocation here
+
+    if (existing_value) {
         new_value->append(existing_value->data(), existing_value->size());
+    }
+    for (Iterator it = begin; it != end; ++it) {
+        new_value->append(it->data(), it->size());
+    }
+}
 
+// The operands are concatenated all at once rather than folded pairwise as
+// an AssociativeMergeOperator would do: merging n operands is linear in the
+// size of the result instead of being quadratic.
+class ResultListMergeOperator : public rocksdb::MergeOperator
+{
+public:
+    virtual bool FullMergeV2(
+        const MergeOperationInput& merge_in,
+        MergeOperationOutput*      merge_out) const override
+    {
+        const std::vector<rocksdb::Slice>& operands = merge_in.operand_list;
+
+        rocksdb_merge_counter_ += operands.size();
+
+        if (tl_heavy_merges
+            && operands.size() >= tl_materialization_threshold) {
+            tl_heavy_merges->push_back(merge_in.key.ToString());
+        }
+
+        if (!merge_in.existing_value && operands.size() == 1) {
+            // nothing to concatenate: point to the operand instead of copying
+            // it
+            merge_out->existing_operand = operands.front();
+            return true;
+        }
+
+        concatenate_lists(merge_in.existing_value,
+                          operands.begin(),
+                          operands.end(),
+                          &merge_out->new_value);
+        return true;
+    }
+
+    virtual bool PartialMergeMulti(
+        const rocksdb::Slice& /*key*/,
+        const std::deque<rocksdb::Slice>& operand_list,
+        std::string*                      new_value,
+        rocksdb::Logger* /*logger*/) const override
+    {
+        rocksdb_merge_counter_ += operand_list.size();
+
+        concatenate_lists(
+            nullptr, operand_list.begin(), operand_list.end(), new_value);
         return true;
     }
 
@@ -48,6 +136,16 @@ public:
 };
 
 RocksDBMergeMultiMap::RocksDBMergeMultiMap(const std::string& path)
+    : RocksDBMergeMultiMap(path, Options())
+{
+}
+
+RocksDBMergeMultiMap::RocksDBMergeMultiMap(const std::string& path,
+                                           const Options&     index_options)
+    : path_(path),
+      materialization_threshold_(index_options.materialization_threshold),
+      hot_keyword_threshold_(index_options.hot_keyword_threshold),
+      codec_(posting_list_codec(index_options.codec))
 {
     rocksdb::Options options;
     options.create_if_missing = true;
@@ -62,6 +160,13 @@ RocksDBMergeMultiMap::RocksDBMergeMultiMap(const std::string& path)
 
     options.merge_operator.reset(new ResultListMergeOperator);
 
+    // Compaction policy
+    options.max_successive_merges = index_options.max_successive_merges;
+    if (index_options.periodic_compaction_seconds > 0) {
+        options.periodic_compaction_seconds
+            = index_options.periodic_compaction_seconds;
+    }
+
     options.allow_mmap_reads  = true;
     options.allow_mmap_writes = true;
 
@@ -76,6 +181,23 @@ RocksDBMergeMultiMap::RocksDBMergeMultiMap(const std::string& path)
         db_.reset(nullptr);
     } else {
         db_.reset(database);
+
+        if (lock_writes()) {
+            background_thread_
+                = std::thread(&RocksDBMergeMultiMap::background_loop, this);
+        }
+    }
+}
+
+RocksDBMergeMultiMap::~RocksDBMergeMultiMap()
+{
+    if (background_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(background_mtx_);
+            stop_background_ = true;
+        }
+        background_cv_.notify_all();
+        background_thread_.join();
     }
 }
 
@@ -84,39 +206,374 @@ std::vector<Index::document_type> RocksDBMergeMultiMap::search(
 {
     std::string data;
 
+    HeavyMergeCollector heavy_merges(materialization_threshold_);
+
     // set the locality counter to 0
     rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), keyword, &data);
 
+    schedule_materializations(std::move(heavy_merges.keys()));
+
     if (s.ok()) {
         std::vector<Index::document_type> result;
-        constexpr size_t elt_size = sizeof(Index::document_type);
-
-        result.resize(data.length() / elt_size);
-        memcpy(reinterpret_cast<char*>(result.data()),
-               data.data(),
-               result.size() * elt_size);
-
+        if (!codec_.decode(data.data(), data.size(), &result)) {
+            std::cerr << "Corruption!\n";
+        }
         return result;
     }
     return {};
 }
 
+void RocksDBMergeMultiMap::search(
+    const Index::keyword_type&          keyword,
+    const Index::document_visitor_type& visitor) const
+{
+    // The pinnable slice points directly to the block cache (or to the
+    // memtable) when possible, avoiding any copy of the value.
+    HeavyMergeCollector heavy_merges(materialization_threshold_);
+
+    rocksdb::PinnableSlice data;
+    rocksdb::Status        s = db_->Get(
+        rocksdb::ReadOptions(), db_->DefaultColumnFamily(), keyword, &data);
+
+    schedule_materializations(std::move(heavy_merges.keys()));
+
+    if (s.ok()) {
+        if (!codec_.visit(data.data(), data.size(), visitor)) {
+            std::cerr << "Corruption!\n";
+        }
+    } else if (!s.IsNotFound()) {
+        std::cerr << "Error when searching keyword " << keyword
+                  << "\nRocksdb status: " << s.ToString() << "\n";
+    }
+}
+
+Index::MultiSearchResult RocksDBMergeMultiMap::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    const size_t n_keywords = keywords.size();
+
+    std::vector<rocksdb::Slice>         keys(keywords.begin(), keywords.end());
+    std::vector<rocksdb::PinnableSlice> values(n_keywords);
+    std::vector<rocksdb::Status>        statuses(n_keywords);
+
+    HeavyMergeCollector heavy_merges(materialization_threshold_);
+
+    // Batched lookup: the block cache accesses are grouped, and the reads
+    // from disk are issued in parallel
+    db_->MultiGet(rocksdb::ReadOptions(),
+                  db_->DefaultColumnFamily(),
+                  n_keywords,
+                  keys.data(),
+                  values.data(),
+                  statuses.data());
+
+    schedule_materializations(std::move(heavy_merges.keys()));
+
+    size_t total_length = 0;
+    for (size_t i = 0; i < n_keywords; i++) {
+        if (statuses[i].ok()) {
+            total_length += values[i].size();
+        }
+    }
+
+    Index::MultiSearchResult result(n_keywords);
+    result.reserve(total_length / sizeof(Index::document_type));
+
+    for (size_t i = 0; i < n_keywords; i++) {
+        if (statuses[i].ok()) {
+            if (!codec_.set_list(
+                    &result, i, values[i].data(), values[i].size())) {
+                std::cerr << "Corruption!\n";
+            }
+        } else if (!statuses[i].IsNotFound()) {
+            std::cerr << "Error when searching keyword " << keywords[i]
+                      << "\nRocksdb status: " << statuses[i].ToString()
+                      << "\n";
+        }
+    }
+    return result;
+}
+
 void RocksDBMergeMultiMap::insert(const Index::keyword_type& keyword,
                                   Index::document_type       document)
 {
-    // serialize the vector
-    constexpr size_t elt_size = sizeof(Index::document_type);
-    rocksdb::Slice   slice(reinterpret_cast<const char*>(&document), elt_size);
+    // serialize the document
+    std::string operand;
+    codec_.encode(&document, 1, &operand);
 
-    rocksdb::Status s = db_->Merge(rocksdb::WriteOptions(), keyword, slice);
+    std::unique_lock<std::mutex> lock;
+    if (lock_writes()) {
+        lock = std::unique_lock<std::mutex>(
+            keyword_locks_[lock_stripe(keyword)]);
+    }
+
+    rocksdb::Status s = db_->Merge(rocksdb::WriteOptions(), keyword, operand);
+
+    if (s.ok() && hot_keyword_threshold_ > 0) {
+        record_merge(keyword);
+    }
 
     if (!s.ok()) {
         std::cerr << "Unable to merge pair in the database\nkeyword=" << keyword
-                  << "\ndata=" + slice.ToString(true) + "\nRocksdb status: "
+                  << "\ndata=" + rocksdb::Slice(operand).ToString(true)
+                         + "\nRocksdb status: "
+                  << s.ToString() << "\n";
+    }
+}
+
+void RocksDBMergeMultiMap::insert_batch(
+    const std::vector<Index::entry_type>& entries)
+{
+    // One merge operand per keyword instead of one per pair: this reduces the
+    // number of operands the merge operator has to fold when searching.
+    rocksdb::WriteBatch batch;
+    std::set<size_t>    stripes;
+
+    const auto groups = Index::group_by_keyword(entries);
+
+    std::string operand;
+
+    for (const auto& group : groups) {
+        const std::vector<Index::document_type>& documents = group.second;
+
+        operand.clear();
+        codec_.encode(documents.data(), documents.size(), &operand);
+
+        batch.Merge(group.first, operand);
+        stripes.insert(lock_stripe(group.first));
+    }
+
+    // Lock the stripes in increasing order to avoid deadlocks
+    std::vector<std::unique_lock<std::mutex>> locks;
+    if (lock_writes()) {
+        for (size_t stripe : stripes) {
+            locks.emplace_back(keyword_locks_[stripe]);
+        }
+    }
+
+    rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
+
+    if (!s.ok()) {
+        std::cerr << "Unable to merge a batch of " << entries.size()
+                  << " pairs in the database\nRocksdb status: "
                   << s.ToString() << "\n";
+    } else if (hot_keyword_threshold_ > 0) {
+        for (const auto& group : groups) {
+            record_merge(group.first);
+        }
+    }
+}
+
+void RocksDBMergeMultiMap::put_list(const Index::keyword_type&  keyword,
+                                    const Index::document_type* documents,
+                                    size_t                      n)
+{
+    std::string operand;
+    codec_.encode(documents, n, &operand);
+
+    std::unique_lock<std::mutex> lock;
+    if (lock_writes()) {
+        lock = std::unique_lock<std::mutex>(
+            keyword_locks_[lock_stripe(keyword)]);
+    }
+
+    rocksdb::Status s = db_->Merge(rocksdb::WriteOptions(), keyword, operand);
+
+    if (s.ok() && hot_keyword_threshold_ > 0) {
+        record_merge(keyword);
+    }
+
+    if (!s.ok()) {
+        std::cerr << "Unable to merge a list of " << n
+                  << " documents in the database\nkeyword=" << keyword
+                  << "\nRocksdb status: " << s.ToString() << "\n";
+    }
+}
+
+void RocksDBMergeMultiMap::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    std::unique_ptr<rocksdb::Iterator> it(
+        db_->NewIterator(rocksdb::ReadOptions()));
+
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        visitor(it->key().ToString());
+    }
+
+    if (!it->status().ok()) {
+        throw std::runtime_error("Unable to iterate over the keywords: "
+                                 + it->status().ToString());
+    }
+}
+
+RocksDBBulkLoader::Stats RocksDBMergeMultiMap::bulk_load(
+    const RocksDBBulkLoader::source_type& source,
+    const RocksDBBulkLoader::Options&     options)
+{
+    auto encoder = [this](const Index::keyword_type&               keyword,
+                          const std::vector<Index::document_type>& documents,
+                          std::vector<RocksDBBulkLoader::sst_entries_type>*
+                              key_spaces) {
+        std::string encoded;
+        codec_.encode(documents.data(), documents.size(), &encoded);
+        (*key_spaces)[0].emplace_back(keyword, std::move(encoded));
+    };
+
+    RocksDBBulkLoader loader(
+        db_.get(), path_ + "/bulk_load", 1, encoder, options);
+    return loader.load(source);
+}
+
+size_t RocksDBMergeMultiMap::lock_stripe(const Index::keyword_type& keyword)
+{
+    return std::hash<Index::keyword_type>()(keyword) % kLockStripes;
+}
+
+void RocksDBMergeMultiMap::record_merge(const Index::keyword_type& keyword)
+{
+    std::unordered_map<std::string, size_t>& counts
+        = insert_counts_[lock_stripe(keyword)];
+
+    auto it = counts.find(keyword);
+    if (it == counts.end()) {
+        if (counts.size() >= kMaxTrackedKeywords) {
+            counts.clear();
+        }
+        it = counts.emplace(keyword, 0).first;
+    }
+
+    if (++it->second >= hot_keyword_threshold_) {
+        counts.erase(it);
+        schedule_compaction(keyword);
+    }
+}
+
+void RocksDBMergeMultiMap::schedule_materializations(
+    std::vector<std::string>&& keywords) const
+{
+    if (keywords.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(background_mtx_);
+        pending_materializations_.insert(
+            std::make_move_iterator(keywords.begin()),
+            std::make_move_iterator(keywords.end()));
     }
+    background_cv_.notify_one();
 }
 
+void RocksDBMergeMultiMap::schedule_compaction(const std::string& keyword)
+{
+    {
+        std::lock_guard<std::mutex> lock(background_mtx_);
+        pending_compactions_.insert(keyword);
+    }
+    background_cv_.notify_one();
+}
+
+void RocksDBMergeMultiMap::wait_for_background_work() const
+{
+    std::unique_lock<std::mutex> lock(background_mtx_);
+
+    background_done_cv_.wait(lock, [this]() {
+        return (pending_materializations_.empty()
+                && pending_compactions_.empty())
+               || stop_background_;
+    });
+}
+
+void RocksDBMergeMultiMap::background_loop()
+{
+    std::unique_lock<std::mutex> lock(background_mtx_);
+
+    while (true) {
+        background_cv_.wait(lock, [this]() {
+            return stop_background_ || !pending_materializations_.empty()
+                   || !pending_compactions_.empty();
+        });
+
+        if (stop_background_) {
+            break;
+        }
+
+        // The keywords remain in the pending sets until they are processed.
+        // Materializations are cheaper and directly benefit the readers: run
+        // them first.
+        if (!pending_materializations_.empty()) {
+            std::string keyword = *pending_materializations_.begin();
+
+            lock.unlock();
+            materialize(keyword);
+            lock.lock();
+
+            pending_materializations_.erase(keyword);
+        } else {
+            std::string keyword = *pending_compactions_.begin();
+
+            lock.unlock();
+            compact(keyword);
+            lock.lock();
+
+            pending_compactions_.erase(keyword);
+        }
+
+        if (pending_materializations_.empty()
+            && pending_compactions_.empty()) {
+            background_done_cv_.notify_all();
+        }
+    }
+    background_done_cv_.notify_all();
+}
+
+void RocksDBMergeMultiMap::materialize(const std::string& keyword)
+{
+    std::lock_guard<std::mutex> lock(keyword_locks_[lock_stripe(keyword)]);
+
+    std::string     data;
+    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), keyword, &data);
+
+    if (s.ok()) {
+        // Merge the segments of the operands in a single one, which is
+        // encoded more compactly
+        if (codec_.type() != PostingListCodecType::Raw
+            && !codec_.append(nullptr, 0, &data)) {
+            std::cerr << "Corruption!\n";
+            return;
+        }
+
+        // The value shadows all the previous merge operands
+        s = db_->Put(rocksdb::WriteOptions(), keyword, data);
+    }
+
+    if (s.ok() && hot_keyword_threshold_ > 0) {
+        insert_counts_[lock_stripe(keyword)].erase(keyword);
+    }
+
+    if (!s.ok() && !s.IsNotFound()) {
+        std::cerr << "Unable to materialize the list of keyword " << keyword
+                  << "\nRocksdb status: " << s.ToString() << "\n";
+    }
+}
+
+void RocksDBMergeMultiMap::compact(const std::string& keyword)
+{
+    // Force the compaction of the bottommost level too: this is where the
+    // operands without a base value would otherwise remain unmerged.
+    rocksdb::CompactRangeOptions compact_options;
+    compact_options.exclusive_manual_compaction = false;
+    compact_options.bottommost_level_compaction
+        = rocksdb::BottommostLevelCompaction::kForce;
+
+    rocksdb::Slice  key(keyword);
+    rocksdb::Status s = db_->CompactRange(compact_options, &key, &key);
+
+    if (!s.ok()) {
+        std::cerr << "Unable to compact the list of keyword " << keyword
+                  << "\nRocksdb status: " << s.ToString() << "\n";
+    }
+}
 
 } // namespace insecure
-} // namespace sse
\ No newline at end of file
+} // namespace sse
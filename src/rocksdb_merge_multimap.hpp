@@ -2,8 +2,18 @@
 
 
 #include "index.hpp"
+#include "posting_list_codec.hpp"
+#include "rocksdb_bulk_loader.hpp"
 
+#include <condition_variable>
+
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
 
 namespace rocksdb {
 class DB;
@@ -17,15 +27,120 @@ extern std::atomic<size_t> rocksdb_merge_counter_;
 class RocksDBMergeMultiMap : public Index
 {
 public:
-    RocksDBMergeMultiMap(const std::string& path);
+    struct Options
+    {
+        // Minimum number of merge operands that a search must fold for the
+        // merged list to be written back to the database. The write back is
+        // done by a background thread, and spares the merge to the following
+        // searches of the same keyword. If zero, the lists are never written
+        // back.
+        size_t materialization_threshold{0};
+
+        // Compaction policy, bounding the number of merge operands that can
+        // accumulate for a keyword independently of the reads.
+
+        // Maximum number of successive merge operands of a keyword in the
+        // memtable. When it is reached, the write path folds the operands
+        // into a single value. Zero means unbounded.
+        size_t max_successive_merges{0};
+        // Files older than this are compacted again, which folds the merge
+        // operands they contain. Zero keeps the RocksDB default.
+        uint64_t periodic_compaction_seconds{0};
+        // Number of merge operands written for a keyword after which the
+        // keyword is flagged as hot, and its key range compacted by a
+        // background thread. Zero disables the targeted compactions.
+        size_t hot_keyword_threshold{0};
+
+        // Encoding of the lists. Every merge operand is encoded as a
+        // separate segment, and the segments are concatenated by the merge
+        // operator.
+        PostingListCodecType codec{PostingListCodecType::Raw};
+    };
+
+    explicit RocksDBMergeMultiMap(const std::string& path);
+    RocksDBMergeMultiMap(const std::string& path, const Options& index_options);
+    ~RocksDBMergeMultiMap();
 
     std::vector<Index::document_type> search(
         const Index::keyword_type& keyword) const;
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const;
     void insert(const Index::keyword_type& keyword,
                 Index::document_type       document);
+    void insert_batch(const std::vector<Index::entry_type>& entries);
+    // The whole list is written as a single merge operand
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n);
+    // Iterates over the keys of the database
+    void for_each_keyword(const Index::keyword_visitor_type& visitor) const;
+
+    // Block until all the scheduled materializations and compactions are
+    // done
+    void wait_for_background_work() const;
+
+    // Build the lists from the pairs of source with a RocksDBBulkLoader. Every
+    // list is written as a single value, without any merge operand. The
+    // temporary files are written in the bulk_load subdirectory of the
+    // database.
+    RocksDBBulkLoader::Stats bulk_load(
+        const RocksDBBulkLoader::source_type& source,
+        const RocksDBBulkLoader::Options&     options);
 
 private:
+    // Index of the lock protecting keyword in keyword_locks_
+    static size_t lock_stripe(const Index::keyword_type& keyword);
+
+    // Whether the writes have to lock the keyword stripes
+    bool lock_writes() const
+    {
+        return materialization_threshold_ > 0 || hot_keyword_threshold_ > 0;
+    }
+
+    // Count a merge operand written for keyword, and schedule the compaction
+    // of the keyword when it becomes hot. Must be called with the keyword
+    // stripe locked.
+    void record_merge(const Index::keyword_type& keyword);
+
+    void schedule_materializations(std::vector<std::string>&& keywords) const;
+    void schedule_compaction(const std::string& keyword);
+    void background_loop();
+    void materialize(const std::string& keyword);
+    void compact(const std::string& keyword);
+
     std::unique_ptr<rocksdb::DB> db_;
+    const std::string            path_;
+
+    const size_t            materialization_threshold_;
+    const size_t            hot_keyword_threshold_;
+    const PostingListCodec& codec_;
+
+    // Materializing a list is a read followed by a write: the inserts of the
+    // same keyword must not happen in between. The keywords are hashed to a
+    // fixed number of locks, that are only used when materialization or the
+    // hot keyword detection is enabled.
+    static constexpr size_t                kLockStripes = 64;
+    std::array<std::mutex, kLockStripes> keyword_locks_;
+
+    // Number of merge operands written for the keywords of each stripe since
+    // their last compaction or materialization. Protected by the stripe lock.
+    // The counters of a stripe are dropped when it tracks too many keywords:
+    // only the keywords written often enough are flagged as hot.
+    static constexpr size_t kMaxTrackedKeywords = 4096;
+    std::array<std::unordered_map<std::string, size_t>, kLockStripes>
+        insert_counts_;
+
+    // The materializations and the compactions are run by a single
+    // background thread
+    mutable std::mutex              background_mtx_;
+    mutable std::condition_variable background_cv_;
+    mutable std::condition_variable background_done_cv_;
+    mutable std::set<std::string>   pending_materializations_;
+    std::set<std::string>           pending_compactions_;
+    bool                            stop_background_{false};
+    std::thread                     background_thread_;
 };
 } // namespace insecure
 } // namespace sse
\ No newline at end of file
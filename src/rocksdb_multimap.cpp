@@ -2,21 +2,125 @@
 
 #include "utils.hpp"
 
+#include <cstring>
 #include <rocksdb/db.h>
+#include <rocksdb/iterator.h>
 #include <rocksdb/memtablerep.h>
 #include <rocksdb/options.h>
+#include <rocksdb/slice.h>
+#include <rocksdb/slice_transform.h>
 #include <rocksdb/table.h>
+#include <rocksdb/write_batch.h>
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <unordered_map>
 
 namespace sse {
 namespace insecure {
 
+namespace {
+// Keys of the chunked layout. The header of the list of a keyword is stored
+// under 'h' || key, and the i-th chunk of the list under
+// 'c' || escape(key) || i, key being the key of the keyword, and i being
+// encoded in big endian so that the chunks of a list are sorted.
+// The escaping keeps the order of the keys, and makes them prefix-free:
+// without it, the chunks of "a" would be interleaved with the ones of "a\0",
+// and the chunk keys would not be sorted by keyword, as the bulk loader
+// requires. A 0 byte is written as 0 0xFF, and the key ends with 0 1.
+std::string chunk_header_key(const std::string& list_key)
+{
+    std::string key;
+    key.reserve(1 + list_key.size());
+    key.push_back('h');
+    key.append(list_key);
+    return key;
+}
+
+std::string chunk_key(const std::string& list_key, uint64_t i)
+{
+    std::string key;
+    key.reserve(1 + list_key.size() + 2 + sizeof(i));
+    key.push_back('c');
+    for (char c : list_key) {
+        key.push_back(c);
+        if (c == '\0') {
+            key.push_back('\xFF');
+        }
+    }
+    key.push_back('\0');
+    key.push_back('\x01');
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        key.push_back(static_cast<char>((i >> shift) & 0xFF));
+    }
+    return key;
+}
+
+// Number of chunks fetched by a single MultiGet when searching a chunked list
+constexpr size_t kChunkMultiGetSize = 64;
+
+using keyword_groups_type
+    = std::map<Index::keyword_type, std::vector<Index::document_type>>;
+
+// Move the documents of the keywords of groups that have the same key to the
+// first of them. Colliding hashed keywords share their list: their documents
+// must be appended by a single read-modify-write, or the second write would
+// drop the documents of the first one.
+void merge_colliding_keywords(KeywordKeyType       key_type,
+                              keyword_groups_type* groups)
+{
+    std::unordered_map<std::string, std::vector<Index::document_type>*> lists;
+    std::string                                                         buffer;
+
+    for (auto it = groups->begin(); it != groups->end();) {
+        auto inserted = lists.emplace(
+            keyword_key(key_type, it->first, &buffer), &it->second);
+        if (inserted.second) {
+            ++it;
+            continue;
+        }
+
+        std::vector<Index::document_type>* list = inserted.first->second;
+        list->insert(list->end(), it->second.begin(), it->second.end());
+        it = groups->erase(it);
+    }
+}
+} // namespace
+
 RocksDBMultiMap::RocksDBMultiMap(const std::string& path)
+    : RocksDBMultiMap(path, Options())
+{
+}
+
+RocksDBMultiMap::RocksDBMultiMap(const std::string& path,
+                                 const Options&     index_options)
+    : path_(path), chunk_capacity_(index_options.chunk_capacity),
+      codec_(posting_list_codec(index_options.codec)),
+      key_type_(index_options.key_type)
 {
     rocksdb::Options options;
     options.create_if_missing = true;
 
+    if (index_options.plain_table) {
+        const size_t key_width = keyword_key_width(key_type_);
+        if (key_width == 0 || chunk_capacity_ > 0) {
+            throw std::invalid_argument(
+                "The PlainTable format requires hashed keywords, and lists "
+                "that are not chunked");
+        }
+
+        // Every key has the width of a hash: the whole key is the prefix
+        // indexed by the hash table of the files
+        rocksdb::PlainTableOptions plain_options;
+        plain_options.user_key_len = key_width;
+        options.table_factory.reset(
+            rocksdb::NewPlainTableFactory(plain_options));
+        options.prefix_extractor.reset(
+            rocksdb::NewFixedPrefixTransform(key_width));
+        options.allow_mmap_reads = true;
+    }
+
 
     // rocksdb::CuckooTableOptions cuckoo_options;
     // cuckoo_options.identity_as_first_hash = false;
@@ -77,12 +181,22 @@ RocksDBMultiMap::RocksDBMultiMap(const std::string& path)
 std::vector<Index::document_type> RocksDBMultiMap::search(
     const Index::keyword_type& keyword) const
 {
+    if (chunk_capacity_ > 0) {
+        std::vector<Index::document_type> results;
+        search(keyword, [&results](const Index::document_type* docs, size_t n) {
+            results.insert(results.end(), docs, docs + n);
+        });
+        return results;
+    }
+
+    std::string     buffer;
     std::string     data;
-    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), keyword, &data);
+    rocksdb::Status s
+        = db_->Get(rocksdb::ReadOptions(), key(keyword, &buffer), &data);
 
     if (s.ok()) {
         std::vector<Index::document_type> results;
-        if (!Index::deserialize_document_list(data, &results)) {
+        if (!codec_.decode(data.data(), data.size(), &results)) {
             std::cerr << "Corruption!\n";
         }
         return results;
@@ -90,6 +204,127 @@ std::vector<Index::document_type> RocksDBMultiMap::search(
     return {};
 }
 
+void RocksDBMultiMap::search(
+    const Index::keyword_type&          keyword,
+    const Index::document_visitor_type& visitor) const
+{
+    if (chunk_capacity_ > 0) {
+        uint64_t n_chunks = 0;
+        if (!get_chunk_count(keyword, &n_chunks)) {
+            return;
+        }
+
+        std::string        buffer;
+        const std::string& list_key = key(keyword, &buffer);
+
+        // Stream the chunks in order, fetching them by groups
+        for (uint64_t first = 0; first < n_chunks;
+             first += kChunkMultiGetSize) {
+            const size_t count = std::min<uint64_t>(kChunkMultiGetSize,
+                                                    n_chunks - first);
+
+            std::vector<std::string> key_strings;
+            key_strings.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                key_strings.push_back(chunk_key(list_key, first + i));
+            }
+            std::vector<rocksdb::Slice> keys(key_strings.begin(),
+                                             key_strings.end());
+            std::vector<rocksdb::PinnableSlice> values(count);
+            std::vector<rocksdb::Status>        statuses(count);
+
+            db_->MultiGet(rocksdb::ReadOptions(),
+                          db_->DefaultColumnFamily(),
+                          count,
+                          keys.data(),
+                          values.data(),
+                          statuses.data(),
+                          true);
+
+            for (size_t i = 0; i < count; i++) {
+                if (!statuses[i].ok()
+                    || !codec_.visit(
+                        values[i].data(), values[i].size(), visitor)) {
+                    std::cerr << "Corruption!\n";
+                }
+            }
+        }
+        return;
+    }
+
+    // The pinnable slice points directly to the block cache (or to the
+    // memtable) when possible, avoiding any copy of the value.
+    std::string            buffer;
+    rocksdb::PinnableSlice data;
+    rocksdb::Status        s = db_->Get(rocksdb::ReadOptions(),
+                                 db_->DefaultColumnFamily(),
+                                 key(keyword, &buffer),
+                                 &data);
+
+    if (s.ok()) {
+        if (!codec_.visit(data.data(), data.size(), visitor)) {
+            std::cerr << "Corruption!\n";
+        }
+    } else if (!s.IsNotFound()) {
+        std::cerr << "Error when searching keyword " << keyword
+                  << "\nRocksdb status: " << s.ToString() << "\n";
+    }
+}
+
+Index::MultiSearchResult RocksDBMultiMap::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    if (chunk_capacity_ > 0) {
+        // the chunks of every list are already fetched in groups
+        return Index::search_many(keywords);
+    }
+
+    const size_t n_keywords = keywords.size();
+
+    std::vector<std::string>            buffers(n_keywords);
+    std::vector<rocksdb::Slice>         keys;
+    std::vector<rocksdb::PinnableSlice> values(n_keywords);
+    std::vector<rocksdb::Status>        statuses(n_keywords);
+
+    keys.reserve(n_keywords);
+    for (size_t i = 0; i < n_keywords; i++) {
+        keys.emplace_back(key(keywords[i], &buffers[i]));
+    }
+
+    // Batched lookup: the block cache accesses are grouped, and the reads
+    // from disk are issued in parallel
+    db_->MultiGet(rocksdb::ReadOptions(),
+                  db_->DefaultColumnFamily(),
+                  n_keywords,
+                  keys.data(),
+                  values.data(),
+                  statuses.data());
+
+    size_t total_length = 0;
+    for (size_t i = 0; i < n_keywords; i++) {
+        if (statuses[i].ok()) {
+            total_length += values[i].size();
+        }
+    }
+
+    Index::MultiSearchResult result(n_keywords);
+    result.reserve(total_length / sizeof(Index::document_type));
+
+    for (size_t i = 0; i < n_keywords; i++) {
+        if (statuses[i].ok()) {
+            if (!codec_.set_list(
+                    &result, i, values[i].data(), values[i].size())) {
+                std::cerr << "Corruption!\n";
+            }
+        } else if (!statuses[i].IsNotFound()) {
+            std::cerr << "Error when searching keyword " << keywords[i]
+                      << "\nRocksdb status: " << statuses[i].ToString()
+                      << "\n";
+        }
+    }
+    return result;
+}
+
 // void RocksDBMultiMap::insert(const Index::keyword_type& keyword,
 //                              Index::document_type       document)
 // {
@@ -121,18 +356,37 @@ std::vector<Index::document_type> RocksDBMultiMap::search(
 void RocksDBMultiMap::insert(const Index::keyword_type& keyword,
                              Index::document_type       document)
 {
+    if (chunk_capacity_ > 0) {
+        rocksdb::WriteBatch batch;
+        if (!append_chunked(keyword, &document, 1, &batch)) {
+            return;
+        }
+
+        rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
+        if (!s.ok()) {
+            std::cerr << "Unable to insert pair in the database\nkeyword="
+                      << keyword << "\nRocksdb status: " << s.ToString();
+        }
+        return;
+    }
+
     // get the existing results
-    std::string     data;
-    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), keyword, &data);
+    std::string        buffer;
+    const std::string& list_key = key(keyword, &buffer);
+    std::string        data;
+    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), list_key, &data);
 
     if (!s.ok() && !s.IsNotFound()) {
         std::cerr << "Issue when appending a result\n";
     }
 
-    data.append(reinterpret_cast<const char*>(&document), sizeof(document));
+    if (!codec_.append(&document, 1, &data)) {
+        std::cerr << "Corruption!\n";
+        return;
+    }
 
 
-    s = db_->Put(rocksdb::WriteOptions(), keyword, data);
+    s = db_->Put(rocksdb::WriteOptions(), list_key, data);
 
     if (!s.ok()) {
         std::cerr << "Unable to insert pair in the database\nkeyword="
@@ -141,5 +395,260 @@ void RocksDBMultiMap::insert(const Index::keyword_type& keyword,
     }
 }
 
+void RocksDBMultiMap::insert_batch(
+    const std::vector<Index::entry_type>& entries)
+{
+    // Every keyword is read and rewritten only once per batch, and all the
+    // writes are committed atomically, with a single WAL write.
+    rocksdb::WriteBatch batch;
+
+    auto groups = Index::group_by_keyword(entries);
+    if (key_type_ != KeywordKeyType::String) {
+        merge_colliding_keywords(key_type_, &groups);
+    }
+
+    for (const auto& group : groups) {
+        const Index::keyword_type&               keyword   = group.first;
+        const std::vector<Index::document_type>& documents = group.second;
+
+        if (chunk_capacity_ > 0) {
+            if (!append_chunked(
+                    keyword, documents.data(), documents.size(), &batch)) {
+                std::cerr << "Unable to insert a batch of " << entries.size()
+                          << " pairs in the database\n";
+                return;
+            }
+            continue;
+        }
+
+        std::string        buffer;
+        const std::string& list_key = key(keyword, &buffer);
+        std::string        data;
+        rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), list_key, &data);
+
+        if (!s.ok() && !s.IsNotFound()) {
+            std::cerr << "Issue when appending a result\n";
+        }
+
+        if (!codec_.append(documents.data(), documents.size(), &data)) {
+            std::cerr << "Corruption!\n";
+            continue;
+        }
+
+        batch.Put(list_key, data);
+    }
+
+    rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
+
+    if (!s.ok()) {
+        std::cerr << "Unable to insert a batch of " << entries.size()
+                  << " pairs in the database\nRocksdb status: "
+                  << s.ToString() << "\n";
+    }
+}
+
+void RocksDBMultiMap::put_list(const Index::keyword_type&  keyword,
+                               const Index::document_type* documents,
+                               size_t                      n)
+{
+    rocksdb::WriteBatch batch;
+
+    if (chunk_capacity_ > 0) {
+        if (!append_chunked(keyword, documents, n, &batch)) {
+            return;
+        }
+    } else {
+        std::string        buffer;
+        const std::string& list_key = key(keyword, &buffer);
+        std::string        data;
+        rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), list_key, &data);
+
+        if (!s.ok() && !s.IsNotFound()) {
+            std::cerr << "Issue when appending a result\n";
+        }
+
+        if (!codec_.append(documents, n, &data)) {
+            std::cerr << "Corruption!\n";
+            return;
+        }
+        batch.Put(list_key, data);
+    }
+
+    rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
+
+    if (!s.ok()) {
+        std::cerr << "Unable to append a list of " << n
+                  << " documents in the database\nkeyword=" << keyword
+                  << "\nRocksdb status: " << s.ToString() << "\n";
+    }
+}
+
+void RocksDBMultiMap::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    if (key_type_ != KeywordKeyType::String) {
+        throw std::logic_error(path_
+                               + ": the keywords are hashed, and cannot be "
+                                 "enumerated");
+    }
+
+    std::unique_ptr<rocksdb::Iterator> it(
+        db_->NewIterator(rocksdb::ReadOptions()));
+
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        const rocksdb::Slice key = it->key();
+
+        if (chunk_capacity_ == 0) {
+            visitor(key.ToString());
+        } else if (key.size() > 0 && key[0] == 'h') {
+            // Every chunked list has a single header
+            visitor(Index::keyword_type(key.data() + 1, key.size() - 1));
+        }
+    }
+
+    if (!it->status().ok()) {
+        throw std::runtime_error("Unable to iterate over the keywords: "
+                                 + it->status().ToString());
+    }
+}
+
+RocksDBBulkLoader::Stats RocksDBMultiMap::bulk_load(
+    const RocksDBBulkLoader::source_type& source,
+    const RocksDBBulkLoader::Options&     options)
+{
+    if (key_type_ != KeywordKeyType::String) {
+        throw std::logic_error(path_
+                               + ": the lists of hashed keywords cannot be "
+                                 "bulk loaded");
+    }
+
+    RocksDBBulkLoader::encoder_type encoder;
+
+    if (chunk_capacity_ > 0) {
+        // The chunks and the headers are two separate key spaces
+        encoder = [this](const Index::keyword_type&               keyword,
+                         const std::vector<Index::document_type>& documents,
+                         std::vector<RocksDBBulkLoader::sst_entries_type>*
+                             key_spaces) {
+            uint64_t n_chunks = 0;
+            for (size_t offset = 0; offset < documents.size();
+                 offset += chunk_capacity_, n_chunks++) {
+                size_t count
+                    = std::min(chunk_capacity_, documents.size() - offset);
+
+                std::string encoded;
+                codec_.encode(documents.data() + offset, count, &encoded);
+                (*key_spaces)[0].emplace_back(chunk_key(keyword, n_chunks),
+                                              std::move(encoded));
+            }
+
+            (*key_spaces)[1].emplace_back(
+                chunk_header_key(keyword),
+                std::string(reinterpret_cast<const char*>(&n_chunks),
+                            sizeof(n_chunks)));
+        };
+    } else {
+        encoder = [this](const Index::keyword_type&               keyword,
+                         const std::vector<Index::document_type>& documents,
+                         std::vector<RocksDBBulkLoader::sst_entries_type>*
+                             key_spaces) {
+            std::string encoded;
+            codec_.encode(documents.data(), documents.size(), &encoded);
+            (*key_spaces)[0].emplace_back(keyword, std::move(encoded));
+        };
+    }
+
+    RocksDBBulkLoader loader(db_.get(),
+                             path_ + "/bulk_load",
+                             (chunk_capacity_ > 0) ? 2 : 1,
+                             std::move(encoder),
+                             options);
+    return loader.load(source);
+}
+
+bool RocksDBMultiMap::get_chunk_count(const Index::keyword_type& keyword,
+                                      uint64_t*                  n_chunks) const
+{
+    std::string     buffer;
+    std::string     header;
+    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(),
+                                 chunk_header_key(key(keyword, &buffer)),
+                                 &header);
+
+    if (s.IsNotFound()) {
+        return false;
+    }
+    if (!s.ok() || header.size() != sizeof(*n_chunks)) {
+        std::cerr << "Unable to read the header of keyword " << keyword
+                  << "\nRocksdb status: " << s.ToString() << "\n";
+        return false;
+    }
+
+    memcpy(n_chunks, header.data(), sizeof(*n_chunks));
+    return true;
+}
+
+bool RocksDBMultiMap::append_chunked(const Index::keyword_type&  keyword,
+                                     const Index::document_type* documents,
+                                     size_t                      n_documents,
+                                     rocksdb::WriteBatch*        batch) const
+{
+    if (n_documents == 0) {
+        return true;
+    }
+
+    uint64_t                          n_chunks = 0;
+    uint64_t                          tail     = 0;
+    std::vector<Index::document_type> chunk;
+
+    std::string        buffer;
+    const std::string& list_key = key(keyword, &buffer);
+
+    // Only the last chunk is read and rewritten
+    if (get_chunk_count(keyword, &n_chunks) && n_chunks > 0) {
+        tail = n_chunks - 1;
+
+        std::string     data;
+        rocksdb::Status s = db_->Get(
+            rocksdb::ReadOptions(), chunk_key(list_key, tail), &data);
+
+        if (!s.ok() || !codec_.decode(data.data(), data.size(), &chunk)) {
+            std::cerr << "Unable to read the last chunk of keyword \""
+                      << keyword << "\"\nRocksdb status: " << s.ToString()
+                      << "\n";
+            return false;
+        }
+    }
+
+    std::string encoded;
+    size_t      offset = 0;
+
+    // Fill the last chunk, and create new ones if needed
+    while (offset < n_documents) {
+        if (chunk.size() >= chunk_capacity_) {
+            tail++;
+            chunk.clear();
+        }
+
+        size_t count
+            = std::min(chunk_capacity_ - chunk.size(), n_documents - offset);
+        chunk.insert(
+            chunk.end(), documents + offset, documents + offset + count);
+        offset += count;
+
+        encoded.clear();
+        codec_.encode(chunk.data(), chunk.size(), &encoded);
+        batch->Put(chunk_key(list_key, tail), encoded);
+    }
+
+    if (tail + 1 != n_chunks) {
+        n_chunks = tail + 1;
+        batch->Put(chunk_header_key(list_key),
+                   rocksdb::Slice(reinterpret_cast<const char*>(&n_chunks),
+                                  sizeof(n_chunks)));
+    }
+    return true;
+}
+
 } // namespace insecure
-} // namespace sse
\ No newline at end of file
+} // namespace sse
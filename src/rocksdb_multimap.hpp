@@ -1,12 +1,16 @@
 #pragma once
 
 #include "index.hpp"
+#include "keyword_key.hpp"
+#include "posting_list_codec.hpp"
+#include "rocksdb_bulk_loader.hpp"
 
 #include <memory>
 
 namespace rocksdb {
 class DB;
-}
+class WriteBatch;
+} // namespace rocksdb
 
 namespace sse {
 namespace insecure {
@@ -15,15 +19,88 @@ namespace insecure {
 class RocksDBMultiMap : public Index
 {
 public:
-    RocksDBMultiMap(const std::string& path);
+    struct Options
+    {
+        // Maximum number of documents in a chunk of posting list.
+        // If non-zero, the lists are stored as a sequence of fixed-capacity
+        // chunks, plus a header containing the number of chunks. An insertion
+        // then only rewrites the last chunk of the list instead of the whole
+        // list. If zero, every list is stored as a single value.
+        // The same layout (chunked or not) must be used every time a database
+        // is opened. The capacity itself can change between two openings.
+        size_t chunk_capacity{0};
+
+        // Encoding of the lists (or of the chunks)
+        PostingListCodecType codec{PostingListCodecType::Raw};
+
+        // Representation of the keywords in the keys. With hashed keywords,
+        // the keys have a fixed width, but the keywords cannot be enumerated
+        // (for_each_keyword) and the lists cannot be bulk loaded. The same
+        // key type must be used every time a database is opened.
+        KeywordKeyType key_type{KeywordKeyType::String};
+
+        // Store the SST files in the PlainTable format, indexed by a hash
+        // table on the fixed-width keys, for pure point lookups. The files
+        // are mapped in memory. Requires hashed keywords, and lists that are
+        // not chunked.
+        bool plain_table{false};
+    };
+
+    explicit RocksDBMultiMap(const std::string& path);
+    RocksDBMultiMap(const std::string& path, const Options& index_options);
 
     std::vector<Index::document_type> search(
         const Index::keyword_type& keyword) const;
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const;
     void insert(const Index::keyword_type& keyword,
                 Index::document_type       document);
+    void insert_batch(const std::vector<Index::entry_type>& entries);
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n);
+    // Iterates over the keys of the database. Throws std::logic_error with
+    // hashed keywords.
+    void for_each_keyword(const Index::keyword_visitor_type& visitor) const;
+
+    // Build the lists from the pairs of source with a RocksDBBulkLoader,
+    // using the layout and the codec of the index. The temporary files are
+    // written in the bulk_load subdirectory of the database. Throws
+    // std::logic_error with hashed keywords: the loader writes the keys in the
+    // order of the keywords.
+    RocksDBBulkLoader::Stats bulk_load(
+        const RocksDBBulkLoader::source_type& source,
+        const RocksDBBulkLoader::Options&     options);
 
 private:
+    // Append documents to the chunked list of keyword, using batch to write
+    // the modified chunks and header.
+    // Returns false if the last chunk of the list could not be read: the
+    // batch must then not be written, as it would overwrite that chunk.
+    bool append_chunked(const Index::keyword_type&  keyword,
+                        const Index::document_type* documents,
+                        size_t                      n_documents,
+                        rocksdb::WriteBatch*        batch) const;
+
+    // Get the number of chunks of the list of keyword.
+    // Returns false if the keyword is not in the database.
+    bool get_chunk_count(const Index::keyword_type& keyword,
+                         uint64_t*                  n_chunks) const;
+
+    // Key of keyword in the database (see keyword_key())
+    const std::string& key(const Index::keyword_type& keyword,
+                           std::string*               buffer) const
+    {
+        return keyword_key(key_type_, keyword, buffer);
+    }
+
     std::unique_ptr<rocksdb::DB> db_;
+    const std::string            path_;
+    const size_t                 chunk_capacity_;
+    const PostingListCodec&      codec_;
+    const KeywordKeyType         key_type_;
 };
 } // namespace insecure
 } // namespace sse
\ No newline at end of file
@@ -0,0 +1,546 @@
+#include "segmented_index.hpp"
+#include "utils.hpp"
+
+#include <cstdio>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+constexpr auto kManifestName      = "MANIFEST";
+constexpr auto kSegmentPrefix     = "segment_";
+constexpr auto kSegmentSuffix     = ".sse";
+constexpr auto kBackgroundRetries = std::chrono::seconds(1);
+} // namespace
+
+SegmentedIndex::SegmentedIndex(const std::string& path)
+    : SegmentedIndex(path, Options())
+{
+}
+
+SegmentedIndex::SegmentedIndex(const std::string& path,
+                               const Options&     options)
+    : m_path(path), m_segment_documents(options.segment_documents),
+      m_merge_factor(options.merge_factor),
+      m_max_frozen(options.max_frozen_segments), m_codec(options.codec),
+      m_stripe_count(options.stripe_count)
+{
+    if (m_segment_documents == 0) {
+        throw std::invalid_argument("segment_documents must be positive");
+    }
+    if (m_merge_factor < 2) {
+        throw std::invalid_argument("merge_factor must be >= 2");
+    }
+    if (m_max_frozen == 0) {
+        throw std::invalid_argument("max_frozen_segments must be positive");
+    }
+
+    if (!utility::is_directory(m_path)
+        && !utility::create_directory(m_path, static_cast<mode_t>(0700))) {
+        throw std::runtime_error(m_path + ": unable to create directory");
+    }
+
+    load_manifest();
+
+    m_background = std::thread(&SegmentedIndex::background_loop, this);
+}
+
+SegmentedIndex::~SegmentedIndex()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_work_cv.notify_all();
+    m_space_cv.notify_all();
+    m_background.join();
+
+    try {
+        flush();
+    } catch (const std::exception& e) {
+        std::cerr << "Unable to flush the active segment: " << e.what()
+                  << "\n";
+    }
+}
+
+std::vector<Index::document_type> SegmentedIndex::search(
+    const Index::keyword_type& keyword) const
+{
+    std::vector<Index::document_type> result;
+    search(keyword, [&result](const Index::document_type* docs, size_t n) {
+        result.insert(result.end(), docs, docs + n);
+    });
+    return result;
+}
+
+void SegmentedIndex::search(const Index::keyword_type&          keyword,
+                            const Index::document_visitor_type& visitor) const
+{
+    std::shared_ptr<const Version> version = current_version();
+
+    for_each_component(*version, [&keyword, &visitor](const Index& component) {
+        component.search(keyword, visitor);
+    });
+}
+
+Index::MultiSearchResult SegmentedIndex::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    std::shared_ptr<const Version> version = current_version();
+
+    std::vector<Index::MultiSearchResult> parts;
+    size_t                                total_size = 0;
+    for_each_component(
+        *version, [&keywords, &parts, &total_size](const Index& component) {
+            Index::MultiSearchResult part = component.search_many(keywords);
+            if (part.total_size() > 0) {
+                total_size += part.total_size();
+                parts.push_back(std::move(part));
+            }
+        });
+
+    if (parts.size() == 1) {
+        return std::move(parts.front());
+    }
+
+    Index::MultiSearchResult result(keywords.size());
+    result.reserve(total_size);
+
+    std::vector<Index::document_type> list;
+    for (size_t i = 0; i < keywords.size(); i++) {
+        list.clear();
+        for (const auto& part : parts) {
+            list.insert(list.end(),
+                        part.list(i),
+                        part.list(i) + part.list_size(i));
+        }
+        result.set_list(i, list.data(), list.size());
+    }
+    return result;
+}
+
+void SegmentedIndex::insert(const Index::keyword_type& keyword,
+                            Index::document_type       document)
+{
+    insert_active(1, [&keyword, document](ConcurrentHashMultiMap& active) {
+        active.insert(keyword, document);
+    });
+}
+
+void SegmentedIndex::insert_batch(const std::vector<Index::entry_type>& entries)
+{
+    insert_active(entries.size(), [&entries](ConcurrentHashMultiMap& active) {
+        active.insert_batch(entries);
+    });
+}
+
+void SegmentedIndex::put_list(const Index::keyword_type&  keyword,
+                              const Index::document_type* documents,
+                              size_t                      n)
+{
+    insert_active(n, [&keyword, documents, n](ConcurrentHashMultiMap& active) {
+        active.put_list(keyword, documents, n);
+    });
+}
+
+void SegmentedIndex::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    std::shared_ptr<const Version> version = current_version();
+
+    // A keyword can be in several segments
+    std::unordered_set<Index::keyword_type> keywords;
+    for_each_component(*version, [&keywords](const Index& component) {
+        component.for_each_keyword(
+            [&keywords](const Index::keyword_type& keyword) {
+                keywords.insert(keyword);
+            });
+    });
+
+    for (const auto& keyword : keywords) {
+        visitor(keyword);
+    }
+}
+
+void SegmentedIndex::flush()
+{
+    freeze(true);
+
+    {
+        std::lock_guard<std::mutex> work_lock(m_work_mtx);
+        while (flush_frozen()) {
+        }
+    }
+
+    // The new segments can fill a tier
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_pending_work = true;
+    }
+    m_work_cv.notify_one();
+}
+
+void SegmentedIndex::compact()
+{
+    std::lock_guard<std::mutex> work_lock(m_work_mtx);
+    while (merge_once()) {
+    }
+}
+
+size_t SegmentedIndex::segment_count() const
+{
+    return current_version()->segments.size();
+}
+
+std::shared_ptr<const SegmentedIndex::Version> SegmentedIndex::
+    current_version() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(m_version_mtx);
+    return m_version;
+}
+
+template<class F>
+void SegmentedIndex::for_each_component(const Version& version, F&& f)
+{
+    for (const auto& segment : version.segments) {
+        f(*segment);
+    }
+    for (const auto& frozen : version.frozen) {
+        f(*frozen);
+    }
+    f(*version.active);
+}
+
+template<class F>
+void SegmentedIndex::insert_active(size_t n, F&& f)
+{
+    bool full;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(m_version_mtx);
+        f(*m_version->active);
+        full = m_active_documents.fetch_add(n) + n >= m_segment_documents;
+    }
+
+    if (full) {
+        freeze(false);
+    }
+}
+
+void SegmentedIndex::freeze(bool force)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    // m_version is only replaced with m_mtx locked: it can be read without
+    // locking m_version_mtx
+    if (force) {
+        if (m_active_documents == 0) {
+            return;
+        }
+    } else {
+        // Back pressure: the background thread is late
+        m_space_cv.wait(lock, [this]() {
+            return m_stop || m_version->frozen.size() < m_max_frozen;
+        });
+
+        // The segment could have been frozen by another insert meanwhile
+        if (m_active_documents < m_segment_documents) {
+            return;
+        }
+    }
+
+    std::shared_ptr<Version> version = std::make_shared<Version>(*m_version);
+    version->frozen.push_back(version->active);
+
+    ConcurrentHashMultiMap::Options active_options;
+    active_options.stripe_count = m_stripe_count;
+    version->active = std::make_shared<ConcurrentHashMultiMap>(active_options);
+
+    {
+        // Waits for the inserts in the frozen segment
+        std::unique_lock<std::shared_timed_mutex> version_lock(m_version_mtx);
+        m_version          = std::move(version);
+        m_active_documents = 0;
+    }
+
+    m_pending_work = true;
+    lock.unlock();
+    m_work_cv.notify_one();
+}
+
+bool SegmentedIndex::flush_frozen()
+{
+    std::shared_ptr<const Version> version = current_version();
+    if (version->frozen.empty()) {
+        return false;
+    }
+    const ConcurrentHashMultiMap& frozen = *version->frozen.front();
+
+    std::vector<Index::keyword_type> keywords;
+    frozen.for_each_keyword([&keywords](const Index::keyword_type& keyword) {
+        keywords.push_back(keyword);
+    });
+    std::sort(keywords.begin(), keywords.end());
+
+    const std::string path = segment_path(m_next_segment_id++);
+    {
+        MappedMultiMap::Writer writer(path, m_codec);
+
+        std::vector<Index::document_type> list;
+        for (const auto& keyword : keywords) {
+            list.clear();
+            frozen.search(keyword,
+                          [&list](const Index::document_type* docs, size_t n) {
+                              list.insert(list.end(), docs, docs + n);
+                          });
+            writer.add(keyword, list.data(), list.size());
+        }
+        writer.finish();
+    }
+
+    std::vector<segment_ptr> segments = version->segments;
+    try {
+        segments.push_back(std::make_shared<const MappedMultiMap>(path));
+        install(std::move(segments), 1);
+    } catch (...) {
+        std::remove(path.c_str());
+        throw;
+    }
+    return true;
+}
+
+bool SegmentedIndex::merge_once()
+{
+    std::shared_ptr<const Version> version  = current_version();
+    const std::vector<segment_ptr>& current = version->segments;
+
+    // Only consecutive segments are merged, so that the lists remain in
+    // insertion order
+    size_t end = 0;
+    for (size_t i = 0, run = 0; i < current.size(); i++) {
+        if (i > 0 && tier(*current[i]) == tier(*current[i - 1])) {
+            run++;
+        } else {
+            run = 1;
+        }
+        if (run == m_merge_factor) {
+            end = i + 1;
+            break;
+        }
+    }
+    if (end == 0) {
+        return false;
+    }
+    const size_t begin = end - m_merge_factor;
+
+    const std::string path = segment_path(m_next_segment_id++);
+    {
+        MappedMultiMap::Writer writer(path, m_codec);
+
+        // Next entry of every merged segment
+        std::vector<size_t> positions(m_merge_factor, 0);
+        std::vector<Index::keyword_type> heads(m_merge_factor);
+        for (size_t s = 0; s < m_merge_factor; s++) {
+            if (current[begin + s]->keyword_count() > 0) {
+                heads[s] = current[begin + s]->keyword(0);
+            }
+        }
+
+        std::vector<Index::document_type> list;
+        while (true) {
+            const Index::keyword_type* keyword = nullptr;
+            for (size_t s = 0; s < m_merge_factor; s++) {
+                if (positions[s] < current[begin + s]->keyword_count()
+                    && (keyword == nullptr || heads[s] < *keyword)) {
+                    keyword = &heads[s];
+                }
+            }
+            if (keyword == nullptr) {
+                break;
+            }
+            const Index::keyword_type min_keyword = *keyword;
+
+            // Re-encoding the concatenated lists as a single segment of the
+            // codec compresses better than concatenating the encoded lists
+            list.clear();
+            for (size_t s = 0; s < m_merge_factor; s++) {
+                const MappedMultiMap& segment = *current[begin + s];
+                if (positions[s] < segment.keyword_count()
+                    && heads[s] == min_keyword) {
+                    segment.read_list(positions[s], &list);
+                    if (++positions[s] < segment.keyword_count()) {
+                        heads[s] = segment.keyword(positions[s]);
+                    }
+                }
+            }
+            writer.add(min_keyword, list.data(), list.size());
+        }
+        writer.finish();
+    }
+
+    std::vector<segment_ptr> segments(current.begin(), current.begin() + begin);
+    try {
+        segments.push_back(std::make_shared<const MappedMultiMap>(path));
+        segments.insert(segments.end(), current.begin() + end, current.end());
+        install(std::move(segments), 0);
+    } catch (...) {
+        std::remove(path.c_str());
+        throw;
+    }
+
+    // The merged segments remain mapped until the searches using them are
+    // over
+    for (size_t s = begin; s < end; s++) {
+        std::remove(current[s]->path().c_str());
+    }
+    return true;
+}
+
+size_t SegmentedIndex::tier(const MappedMultiMap& segment) const
+{
+    size_t t        = 0;
+    size_t capacity = m_segment_documents * m_merge_factor;
+    while (segment.document_count() >= capacity && t < 64) {
+        t++;
+        capacity *= m_merge_factor;
+    }
+    return t;
+}
+
+std::string SegmentedIndex::segment_path(uint64_t id) const
+{
+    return m_path + "/" + kSegmentPrefix + std::to_string(id)
+           + kSegmentSuffix;
+}
+
+void SegmentedIndex::install(std::vector<segment_ptr> segments,
+                             size_t                   flushed_frozen)
+{
+    write_manifest(segments);
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+
+    std::shared_ptr<Version> version = std::make_shared<Version>(*m_version);
+    version->segments                = std::move(segments);
+    version->frozen.erase(version->frozen.begin(),
+                          version->frozen.begin() + flushed_frozen);
+    {
+        std::unique_lock<std::shared_timed_mutex> version_lock(m_version_mtx);
+        m_version = std::move(version);
+    }
+    m_space_cv.notify_all();
+}
+
+void SegmentedIndex::load_manifest()
+{
+    std::shared_ptr<Version> version = std::make_shared<Version>();
+
+    ConcurrentHashMultiMap::Options active_options;
+    active_options.stripe_count = m_stripe_count;
+    version->active = std::make_shared<ConcurrentHashMultiMap>(active_options);
+
+    const std::string manifest_path = m_path + "/" + kManifestName;
+    if (utility::is_file(manifest_path)) {
+        std::ifstream manifest(manifest_path);
+        if (!manifest) {
+            throw std::runtime_error(manifest_path
+                                     + ": unable to read the manifest");
+        }
+
+        const std::string prefix(kSegmentPrefix);
+        const std::string suffix(kSegmentSuffix);
+
+        std::string name;
+        while (std::getline(manifest, name)) {
+            const size_t suffix_offset = name.size() - suffix.size();
+            if (name.size() <= prefix.size() + suffix.size()
+                || name.compare(0, prefix.size(), prefix) != 0
+                || name.compare(suffix_offset, suffix.size(), suffix) != 0) {
+                throw std::runtime_error(manifest_path
+                                         + ": corrupted manifest");
+            }
+
+            const std::string id = name.substr(
+                prefix.size(), name.size() - prefix.size() - suffix.size());
+            if (id.find_first_not_of("0123456789") != std::string::npos) {
+                throw std::runtime_error(manifest_path
+                                         + ": corrupted manifest");
+            }
+            m_next_segment_id
+                = std::max<uint64_t>(m_next_segment_id, std::stoull(id) + 1);
+
+            version->segments.push_back(
+                std::make_shared<const MappedMultiMap>(m_path + "/" + name));
+        }
+    }
+
+    m_version = std::move(version);
+}
+
+void SegmentedIndex::write_manifest(
+    const std::vector<segment_ptr>& segments) const
+{
+    const std::string manifest_path = m_path + "/" + kManifestName;
+    const std::string tmp_path      = manifest_path + ".tmp";
+
+    {
+        std::ofstream manifest(tmp_path, std::ios::trunc);
+        for (const auto& segment : segments) {
+            manifest << segment->path().substr(m_path.size() + 1) << "\n";
+        }
+        manifest.close();
+        if (!manifest) {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error(tmp_path
+                                     + ": unable to write the manifest");
+        }
+    }
+
+    if (std::rename(tmp_path.c_str(), manifest_path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error(manifest_path
+                                 + ": unable to move the manifest");
+    }
+}
+
+void SegmentedIndex::background_loop()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    while (true) {
+        m_work_cv.wait(lock, [this]() { return m_stop || m_pending_work; });
+        if (m_stop) {
+            break;
+        }
+        m_pending_work = false;
+        lock.unlock();
+
+        bool failed = false;
+        try {
+            // The flushes go first: they unblock the inserts
+            std::lock_guard<std::mutex> work_lock(m_work_mtx);
+            while (flush_frozen() || merge_once()) {
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Unable to write a segment: " << e.what() << "\n";
+            failed = true;
+        }
+
+        lock.lock();
+        if (failed) {
+            m_work_cv.wait_for(
+                lock, kBackgroundRetries, [this]() { return m_stop; });
+            m_pending_work = true;
+        }
+    }
+}
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "concurrent_hash_multimap.hpp"
+#include "index.hpp"
+#include "mapped_multimap.hpp"
+#include "posting_list_codec.hpp"
+
+#include <condition_variable>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Log-structured index engine, specialized for append-only document lists.
+//
+// The inserts go to an active segment, a ConcurrentHashMultiMap. Once it
+// holds Options::segment_documents documents, the active segment is frozen
+// and replaced by an empty one, and a background thread writes the frozen
+// segment to an immutable, compressed MappedMultiMap file. The segments are
+// merged by tiers: merge_factor consecutive segments of a same size tier are
+// merged in a segment of the next tier, so that every document is rewritten
+// a logarithmic number of times. The segments of the index are listed, from
+// the oldest to the newest, by a manifest file that is atomically replaced
+// after every flush and merge.
+//
+// A search queries the segments, the frozen segments and the active segment,
+// from the oldest to the newest, and concatenates their lists: the documents
+// of a keyword are returned in insertion order. The searches do not take any
+// lock while reading the segments, and the segments replaced by a merge are
+// unmapped once the last search using them is over.
+//
+// The documents of the active and frozen segments are lost if the process
+// dies before they are flushed. Call flush() at the durability points.
+class SegmentedIndex : public Index
+{
+public:
+    struct Options
+    {
+        // Number of documents of the active segment that triggers its flush
+        size_t segment_documents{1 << 20};
+        // Number of segments of a same tier merged together. The segments of
+        // tier t have about segment_documents * merge_factor^t documents.
+        size_t merge_factor{4};
+        // Number of frozen segments waiting for their flush before the
+        // inserts block
+        size_t max_frozen_segments{2};
+        // Codec of the new segments
+        PostingListCodecType codec{PostingListCodecType::BitPacked};
+        // Number of stripes of the active segment
+        size_t stripe_count{64};
+    };
+
+    // Open the index at path, creating the directory if needed. Throws
+    // std::runtime_error if the manifest or a segment cannot be read.
+    explicit SegmentedIndex(const std::string& path);
+    SegmentedIndex(const std::string& path, const Options& options);
+    // Flushes the active segment
+    ~SegmentedIndex() override;
+
+    SegmentedIndex(const SegmentedIndex&) = delete;
+    SegmentedIndex& operator=(const SegmentedIndex&) = delete;
+
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const override;
+    // The visitor is called with the list of every segment containing the
+    // keyword. It must not block (see ConcurrentHashMultiMap).
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document) override;
+    void insert_batch(const std::vector<Index::entry_type>& entries) override;
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n) override;
+    // The keywords of all the segments are collected before being visited:
+    // the visitor can access the index
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    // Freeze the active segment, and write all the frozen segments. Returns
+    // once they are written. Throws std::runtime_error on a write error, in
+    // which case the documents remain in memory.
+    void flush();
+
+    // Run the pending merges, until no tier has merge_factor consecutive
+    // segments
+    void compact();
+
+    // Number of immutable segments, not counting the frozen ones
+    size_t segment_count() const;
+
+private:
+    using memtable_ptr = std::shared_ptr<ConcurrentHashMultiMap>;
+    using segment_ptr  = std::shared_ptr<const MappedMultiMap>;
+
+    // State of the index, replaced as a whole by the freezes, flushes and
+    // merges. The components are ordered from the oldest to the newest.
+    struct Version
+    {
+        std::vector<segment_ptr>  segments;
+        std::vector<memtable_ptr> frozen;
+        memtable_ptr              active;
+    };
+
+    std::shared_ptr<const Version> current_version() const;
+
+    // Call f(component) for every component of version, from the oldest to
+    // the newest
+    template<class F>
+    static void for_each_component(const Version& version, F&& f);
+
+    // Call f(active segment) while no freeze can happen, and count the n
+    // inserted documents. Then freeze the active segment if it is full.
+    template<class F>
+    void insert_active(size_t n, F&& f);
+
+    // Replace the active segment by an empty one, if it is full or if force
+    // is set and it is not empty. Waits if too many segments are frozen,
+    // unless force is set.
+    void freeze(bool force);
+
+    // Write the oldest frozen segment. Returns false if there is none. Must
+    // be called with m_work_mtx locked.
+    bool flush_frozen();
+
+    // Run one merge. Returns false if there is none to run. Must be called
+    // with m_work_mtx locked.
+    bool merge_once();
+
+    // Tier of a segment, from its number of documents
+    size_t tier(const MappedMultiMap& segment) const;
+
+    std::string segment_path(uint64_t id) const;
+
+    // Write the manifest listing segments, and publish the version made of
+    // segments and of the current frozen segments, minus the flushed_frozen
+    // oldest ones. Must be called with m_work_mtx locked.
+    void install(std::vector<segment_ptr> segments, size_t flushed_frozen);
+
+    void load_manifest();
+    void write_manifest(const std::vector<segment_ptr>& segments) const;
+
+    void background_loop();
+
+    const std::string          m_path;
+    const size_t               m_segment_documents;
+    const size_t               m_merge_factor;
+    const size_t               m_max_frozen;
+    const PostingListCodecType m_codec;
+    const size_t               m_stripe_count;
+
+    // Protects m_version. Shared by the inserts in the active segment, so
+    // that a freeze waits for the inserts in progress.
+    mutable std::shared_timed_mutex m_version_mtx;
+    std::shared_ptr<const Version>  m_version;
+    // Documents inserted in the active segment
+    std::atomic<size_t> m_active_documents{0};
+
+    // Serializes the flushes and the merges, that change the segments
+    std::mutex m_work_mtx;
+    // Identifier of the next segment file. Protected by m_work_mtx.
+    uint64_t m_next_segment_id{0};
+
+    // Protects the freezes and the state of the background thread
+    std::mutex              m_mtx;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_space_cv;
+    bool                    m_pending_work{false};
+    bool                    m_stop{false};
+    std::thread             m_background;
+};
+
+} // namespace insecure
+} // namespace sse
@@ -0,0 +1,211 @@
+#include "sharded_index.hpp"
+
+#include "utils.hpp"
+
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace sse {
+namespace insecure {
+
+ShardedIndex::ShardedIndex(const std::string& path,
+                           shard_factory_type shard_factory)
+    : ShardedIndex(path, std::move(shard_factory), Options())
+{
+}
+
+ShardedIndex::ShardedIndex(const std::string& path,
+                           shard_factory_type shard_factory,
+                           const Options&     options)
+    : m_lock_shards(options.lock_shards)
+{
+    if (options.shard_count == 0) {
+        throw std::invalid_argument("shard_count must be >= 1");
+    }
+
+    if (!utility::is_directory(path)
+        && !utility::create_directory(path, static_cast<mode_t>(0700))) {
+        throw std::runtime_error(path + ": unable to create directory");
+    }
+
+    m_shards.reserve(options.shard_count);
+    for (size_t i = 0; i < options.shard_count; i++) {
+        std::unique_ptr<Shard> shard(new Shard());
+        shard->index.reset(shard_factory(path + "/shard_" + std::to_string(i)));
+        m_shards.push_back(std::move(shard));
+    }
+}
+
+size_t ShardedIndex::shard_index(const Index::keyword_type& keyword) const
+{
+    // The low bits of FNV-1a are poorly mixed, and they choose the shard
+    return utility::mix64(utility::stable_hash(keyword)) % m_shards.size();
+}
+
+std::unique_lock<std::mutex> ShardedIndex::lock_shard(Shard& shard) const
+{
+    if (m_lock_shards) {
+        return std::unique_lock<std::mutex>(shard.mtx);
+    }
+    return std::unique_lock<std::mutex>();
+}
+
+std::vector<Index::document_type> ShardedIndex::search(
+    const Index::keyword_type& keyword) const
+{
+    Shard&                       shard = *m_shards[shard_index(keyword)];
+    std::unique_lock<std::mutex> lock  = lock_shard(shard);
+
+    return shard.index->search(keyword);
+}
+
+void ShardedIndex::search(const Index::keyword_type&          keyword,
+                          const Index::document_visitor_type& visitor) const
+{
+    Shard&                       shard = *m_shards[shard_index(keyword)];
+    std::unique_lock<std::mutex> lock  = lock_shard(shard);
+
+    shard.index->search(keyword, visitor);
+}
+
+Index::MultiSearchResult ShardedIndex::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    const size_t n_shards = m_shards.size();
+
+    // keywords of each shard, and their position in the query
+    std::vector<std::vector<Index::keyword_type>> shard_keywords(n_shards);
+    std::vector<std::vector<size_t>>              shard_positions(n_shards);
+    std::vector<bool>                             run(n_shards, false);
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        size_t s = shard_index(keywords[i]);
+        shard_keywords[s].push_back(keywords[i]);
+        shard_positions[s].push_back(i);
+        run[s] = true;
+    }
+
+    std::vector<Index::MultiSearchResult> shard_results(n_shards);
+    run_on_shards(run, [&](size_t s) {
+        std::unique_lock<std::mutex> lock = lock_shard(*m_shards[s]);
+        shard_results[s] = m_shards[s]->index->search_many(shard_keywords[s]);
+    });
+
+    size_t total_size = 0;
+    for (const auto& shard_result : shard_results) {
+        total_size += shard_result.total_size();
+    }
+
+    Index::MultiSearchResult result(keywords.size());
+    result.reserve(total_size);
+    for (size_t s = 0; s < n_shards; s++) {
+        for (size_t j = 0; j < shard_positions[s].size(); j++) {
+            result.set_list(shard_positions[s][j],
+                            shard_results[s].list(j),
+                            shard_results[s].list_size(j));
+        }
+    }
+    return result;
+}
+
+void ShardedIndex::insert(const Index::keyword_type& keyword,
+                          Index::document_type       document)
+{
+    Shard&                       shard = *m_shards[shard_index(keyword)];
+    std::unique_lock<std::mutex> lock  = lock_shard(shard);
+
+    shard.index->insert(keyword, document);
+}
+
+void ShardedIndex::insert_batch(const std::vector<Index::entry_type>& entries)
+{
+    const size_t n_shards = m_shards.size();
+
+    std::vector<std::vector<Index::entry_type>> shard_entries(n_shards);
+    std::vector<bool>                           run(n_shards, false);
+
+    for (const auto& entry : entries) {
+        size_t s = shard_index(entry.first);
+        shard_entries[s].push_back(entry);
+        run[s] = true;
+    }
+
+    run_on_shards(run, [&](size_t s) {
+        std::unique_lock<std::mutex> lock = lock_shard(*m_shards[s]);
+        m_shards[s]->index->insert_batch(shard_entries[s]);
+    });
+}
+
+void ShardedIndex::put_list(const Index::keyword_type&  keyword,
+                            const Index::document_type* documents,
+                            size_t                      n)
+{
+    Shard&                       shard = *m_shards[shard_index(keyword)];
+    std::unique_lock<std::mutex> lock  = lock_shard(shard);
+
+    shard.index->put_list(keyword, documents, n);
+}
+
+void ShardedIndex::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    // The shards have disjoint keywords
+    std::vector<Index::keyword_type> keywords;
+    for (const auto& shard : m_shards) {
+        keywords.clear();
+        {
+            std::unique_lock<std::mutex> lock = lock_shard(*shard);
+            shard->index->for_each_keyword(
+                [&keywords](const Index::keyword_type& keyword) {
+                    keywords.push_back(keyword);
+                });
+        }
+        for (const auto& keyword : keywords) {
+            visitor(keyword);
+        }
+    }
+}
+
+void ShardedIndex::run_on_shards(const std::vector<bool>&           run,
+                                 const std::function<void(size_t)>& job) const
+{
+    std::vector<std::exception_ptr> errors(run.size());
+    std::vector<std::thread>        threads;
+
+    auto guarded_job = [&job, &errors](size_t s) {
+        try {
+            job(s);
+        } catch (...) {
+            errors[s] = std::current_exception();
+        }
+    };
+
+    // The last shard is processed by the calling thread
+    size_t last = run.size();
+    for (size_t s = 0; s < run.size(); s++) {
+        if (!run[s]) {
+            continue;
+        }
+        if (last != run.size()) {
+            threads.emplace_back(guarded_job, last);
+        }
+        last = s;
+    }
+    if (last != run.size()) {
+        guarded_job(last);
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+} // namespace insecure
+} // namespace sse
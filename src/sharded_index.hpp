@@ -0,0 +1,83 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Index partitioning the keywords across several backend instances.
+//
+// Each shard is a backend created by the factory in its own subdirectory
+// (shard_0, shard_1, ...) of the index path, and a keyword always goes to
+// the shard selected by a hash of the keyword that does not depend on the
+// platform, so that an existing index can be reopened with the same number
+// of shards. The batched operations are split per shard and the parts are
+// run in parallel.
+class ShardedIndex : public Index
+{
+public:
+    using shard_factory_type = std::function<Index*(const std::string& path)>;
+
+    struct Options
+    {
+        size_t shard_count{8};
+        // Serialize the accesses to each shard. Required by the backends that
+        // are not thread safe.
+        bool lock_shards{true};
+    };
+
+    ShardedIndex(const std::string& path, shard_factory_type shard_factory);
+    ShardedIndex(const std::string& path,
+                 shard_factory_type shard_factory,
+                 const Options&     options);
+
+    using Index::search;
+
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const override;
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document) override;
+    void insert_batch(const std::vector<Index::entry_type>& entries) override;
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n) override;
+    // The keywords of a shard are copied before being visited: the visitor
+    // can access the index
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    size_t shard_count() const
+    {
+        return m_shards.size();
+    }
+    size_t shard_index(const Index::keyword_type& keyword) const;
+
+private:
+    struct Shard
+    {
+        std::unique_ptr<Index> index;
+        std::mutex             mtx;
+    };
+
+    std::unique_lock<std::mutex> lock_shard(Shard& shard) const;
+
+    // Call job(i) for every shard i such that run[i] is true, in parallel
+    void run_on_shards(const std::vector<bool>&           run,
+                       const std::function<void(size_t)>& job) const;
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    const bool                          m_lock_shards;
+};
+
+} // namespace insecure
+} // namespace sse
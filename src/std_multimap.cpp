@@ -1,28 +1,155 @@
 #include "std_multimap.hpp"
 
+#include "mapped_multimap.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+
 namespace sse {
 namespace insecure {
 
 std::vector<Index::document_type> StdMultiMap::search(
     const Index::keyword_type& keyword) const
 {
-    auto range = m_multimap.equal_range(keyword);
+    // A single traversal of the tree: count() would look the range up again
+    auto range = equal_range(keyword);
 
     std::vector<Index::document_type> result;
 
-    result.reserve(m_multimap.count(keyword));
-
     for (auto it = range.first; it != range.second; ++it) {
         result.push_back(it->second);
     }
     return result;
 }
 
+void StdMultiMap::search(const Index::keyword_type&          keyword,
+                         const Index::document_visitor_type& visitor) const
+{
+    // The documents are not contiguous in the multimap: gather them by chunks
+    // in a buffer on the stack
+    constexpr size_t     kBufferSize = 512;
+    Index::document_type buffer[kBufferSize];
+    size_t               n = 0;
+
+    auto range = equal_range(keyword);
+
+    for (auto it = range.first; it != range.second; ++it) {
+        buffer[n++] = it->second;
+
+        if (n == kBufferSize) {
+            visitor(buffer, n);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        visitor(buffer, n);
+    }
+}
+
+Index::MultiSearchResult StdMultiMap::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    Index::MultiSearchResult result(keywords.size());
+
+    std::vector<Index::document_type> list;
+    for (size_t i = 0; i < keywords.size(); i++) {
+        auto range = equal_range(keywords[i]);
+
+        list.clear();
+        for (auto it = range.first; it != range.second; ++it) {
+            list.push_back(it->second);
+        }
+        result.set_list(i, list.data(), list.size());
+    }
+    return result;
+}
+
 
 void StdMultiMap::insert(const Index::keyword_type& keyword,
                          Index::document_type       document)
 {
-    m_multimap.insert(std::make_pair(keyword, document));
+    m_multimap.emplace(m_dictionary.intern(keyword), document);
+}
+
+void StdMultiMap::put_list(const Index::keyword_type&  keyword,
+                           const Index::document_type* documents,
+                           size_t                      n)
+{
+    // Every document is inserted right before the end of the range of
+    // keyword: the hint makes each insertion constant time, instead of a
+    // traversal of the tree per document
+    const KeywordDictionary::id_type id   = m_dictionary.intern(keyword);
+    auto                             hint = m_multimap.upper_bound(id);
+    for (size_t i = 0; i < n; i++) {
+        m_multimap.emplace_hint(hint, id, documents[i]);
+    }
+}
+
+void StdMultiMap::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    for (size_t id = 0; id < m_dictionary.size(); id++) {
+        visitor(
+            m_dictionary.keyword(static_cast<KeywordDictionary::id_type>(id)));
+    }
+}
+
+size_t StdMultiMap::memory_usage() const
+{
+    // Every pair is allocated in its own tree node, with the color and the
+    // three links of the node
+    constexpr size_t kNodeSize
+        = 4 * sizeof(void*) + sizeof(decltype(m_multimap)::value_type);
+
+    return m_multimap.size() * kNodeSize + m_dictionary.memory_usage();
+}
+
+void StdMultiMap::save(const std::string& path) const
+{
+    // The multimap is ordered by identifier, that is by insertion order of
+    // the keywords: the snapshot needs them by value
+    std::vector<KeywordDictionary::id_type> ids(m_dictionary.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        ids[i] = static_cast<KeywordDictionary::id_type>(i);
+    }
+    std::sort(ids.begin(),
+              ids.end(),
+              [this](KeywordDictionary::id_type a,
+                     KeywordDictionary::id_type b) {
+                  const size_t a_length = m_dictionary.length(a);
+                  const size_t b_length = m_dictionary.length(b);
+
+                  int cmp = std::memcmp(m_dictionary.data(a),
+                                        m_dictionary.data(b),
+                                        std::min(a_length, b_length));
+                  return (cmp != 0) ? (cmp < 0) : (a_length < b_length);
+              });
+
+    MappedMultiMap::Writer writer(path);
+
+    std::vector<Index::document_type> list;
+    for (KeywordDictionary::id_type id : ids) {
+        auto range = m_multimap.equal_range(id);
+
+        list.clear();
+        for (auto it = range.first; it != range.second; ++it) {
+            list.push_back(it->second);
+        }
+        writer.add(m_dictionary.keyword(id), list.data(), list.size());
+    }
+    writer.finish();
+}
+
+std::pair<StdMultiMap::multimap_type::const_iterator,
+          StdMultiMap::multimap_type::const_iterator>
+StdMultiMap::equal_range(const Index::keyword_type& keyword) const
+{
+    KeywordDictionary::id_type id = m_dictionary.find(keyword);
+    if (id == KeywordDictionary::kNotFound) {
+        return std::make_pair(m_multimap.end(), m_multimap.end());
+    }
+    return m_multimap.equal_range(id);
 }
 
 
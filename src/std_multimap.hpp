@@ -1,12 +1,17 @@
 #pragma once
 
 #include "index.hpp"
+#include "keyword_dictionary.hpp"
 
 #include <map>
+#include <string>
 
 namespace sse {
 namespace insecure {
 
+// In-memory index storing every pair in a std::multimap. The keywords are
+// interned in a KeywordDictionary, and the multimap is keyed by their
+// identifiers.
 class StdMultiMap : public Index
 {
 public:
@@ -15,11 +20,35 @@ public:
 
     std::vector<Index::document_type> search(
         const Index::keyword_type& keyword) const;
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const;
     void insert(const Index::keyword_type& keyword,
                 Index::document_type       document);
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n);
+    void for_each_keyword(const Index::keyword_visitor_type& visitor) const;
+
+    // Estimation of the memory used by the index
+    size_t memory_usage() const;
+
+    // Write the index to a snapshot at path, that can be mapped by a
+    // MappedMultiMap. The mapped snapshot is read-only. Throws
+    // std::runtime_error on a write error.
+    void save(const std::string& path) const;
 
 private:
-    std::multimap<Index::keyword_type, Index::document_type> m_multimap;
+    using multimap_type
+        = std::multimap<KeywordDictionary::id_type, Index::document_type>;
+
+    // Pairs of keyword, empty if the keyword is not in the dictionary
+    std::pair<multimap_type::const_iterator, multimap_type::const_iterator>
+    equal_range(const Index::keyword_type& keyword) const;
+
+    KeywordDictionary m_dictionary;
+    multimap_type     m_multimap;
 };
 
 } // namespace insecure
@@ -181,5 +181,38 @@ std::string hex_string(const uint32_t& a)
     return out.str();
 }
 
+std::string errno_string()
+{
+    return std::string(strerror(errno));
+}
+
+uint64_t stable_hash(const std::string& in)
+{
+    return stable_hash(in.data(), in.size(), 0);
+}
+
+uint64_t stable_hash(const char* data, size_t length, uint64_t seed)
+{
+    constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325ULL;
+    constexpr uint64_t kPrime       = 0x100000001b3ULL;
+
+    uint64_t h = kOffsetBasis ^ seed;
+    for (size_t i = 0; i < length; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= kPrime;
+    }
+    return h;
+}
+
+uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
 } // namespace utility
 } // namespace sse
\ No newline at end of file
@@ -66,5 +66,19 @@ std::ostream& print_hex(std::ostream& out, const std::array<uint8_t, N>& a)
 std::string hex_string(const uint64_t& a);
 std::string hex_string(const uint32_t& a);
 
+// Description of errno
+std::string errno_string();
+
+// 64 bits FNV-1a hash. Unlike std::hash, its value does not depend on the
+// platform or the standard library, and can be persisted.
+uint64_t stable_hash(const std::string& in);
+// FNV-1a hash of length bytes of data, from the offset basis xored with seed.
+// stable_hash(in) is stable_hash(in.data(), in.size(), 0).
+uint64_t stable_hash(const char* data, size_t length, uint64_t seed);
+
+// Finalizer of splitmix64: a bijection that spreads every bit of x on the
+// whole word. The low bits of FNV-1a are poorly mixed.
+uint64_t mix64(uint64_t x);
+
 } // namespace utility
 } // namespace sse
\ No newline at end of file
@@ -1,13 +1,89 @@
 #include "wiredtiger_multimap.hpp"
 
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
 #include <exception>
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
 namespace sse {
 namespace insecure {
 
+namespace {
+constexpr auto kBlobTableURI   = "table:index";
+constexpr auto kHeaderTableURI = "table:chunk_headers";
+constexpr auto kChunkTableURI  = "table:chunks";
+
+constexpr auto kRowTableURI      = "table:document_rows";
+constexpr auto kSequenceTableURI = "table:sequence";
+constexpr auto kSequenceKey      = "next_sequence";
+
+// Number of sequence numbers reserved at once
+constexpr uint64_t kSequenceBlockSize = 1 << 16;
+
+// Number of documents passed at once to the visitors by the range scans
+constexpr size_t kScanBlockSize = 512;
+
+constexpr size_t kMaxTransactionAttempts = 1000;
+
+// Format of the keys of the keywords in the tables
+std::string keyword_key_format(KeywordKeyType key_type)
+{
+    switch (key_type) {
+    case KeywordKeyType::Hash64:
+        return "Q";
+    case KeywordKeyType::Hash128:
+        return "QQ";
+    case KeywordKeyType::String:
+    default:
+        return "S";
+    }
+}
+} // namespace
+
+class WiredTigerMultimap::SessionLease
+{
+public:
+    explicit SessionLease(const WiredTigerMultimap& map)
+        : m_map(map), m_session(map.acquire_session())
+    {
+    }
+
+    ~SessionLease()
+    {
+        m_map.release_session(std::move(m_session));
+    }
+
+    Session& operator*() const
+    {
+        return *m_session;
+    }
+    Session* operator->() const
+    {
+        return m_session.get();
+    }
+
+private:
+    const WiredTigerMultimap& m_map;
+    std::unique_ptr<Session>  m_session;
+};
+
 WiredTigerMultimap::WiredTigerMultimap(const std::string& path)
+    : WiredTigerMultimap(path, Options())
+{
+}
+
+WiredTigerMultimap::WiredTigerMultimap(const std::string& path,
+                                       const Options&     options)
+    : m_path(path), m_chunk_capacity(options.chunk_capacity),
+      m_codec(posting_list_codec(options.codec)),
+      m_append_mode(options.append_mode),
+      m_document_rows(options.document_rows), m_key_type(options.key_type)
 {
     // Open a connection to the database, creating it if necessary.
     int ret = wiredtiger_open(path.c_str(), NULL, "create", &m_wt_connection);
@@ -18,9 +94,11 @@ WiredTigerMultimap::WiredTigerMultimap(const std::string& path)
     }
 
 
-    // Open a session handle for the database.
+    // Create the tables. The sessions of the pool are opened afterwards.
+    WT_SESSION* wt_session = nullptr;
+
     ret = m_wt_connection->open_session(
-        m_wt_connection, NULL, NULL, &m_wt_session);
+        m_wt_connection, NULL, NULL, &wt_session);
 
     if (ret != 0) {
         throw std::runtime_error(
@@ -28,21 +106,81 @@ WiredTigerMultimap::WiredTigerMultimap(const std::string& path)
             + std::to_string(ret));
     }
 
+    const std::string key_format = keyword_key_format(m_key_type);
+
+    if (m_document_rows) {
+        // The rows of a keyword share the prefix of their keys
+        const std::string config = "key_format=" + key_format
+                                   + "Q,value_format=Q,prefix_compression=true";
+        ret = wt_session->create(wt_session, kRowTableURI, config.c_str());
+
+        if (ret == 0) {
+            ret = wt_session->create(
+                wt_session, kSequenceTableURI, "key_format=S,value_format=Q");
+        }
+    } else if (m_chunk_capacity > 0) {
+        const std::string header_config
+            = "key_format=" + key_format
+              + ",value_format=Q,access_pattern_hint=random";
+        const std::string chunk_config
+            = "key_format=" + key_format
+              + "Q,value_format=u,access_pattern_hint=random";
 
-    // Create the table
-    ret = m_wt_session->create(
-        m_wt_session,
-        "table:index",
-        "key_format=S,value_format=u,access_pattern_hint=random");
+        ret = wt_session->create(
+            wt_session, kHeaderTableURI, header_config.c_str());
+
+        if (ret == 0) {
+            ret = wt_session->create(
+                wt_session, kChunkTableURI, chunk_config.c_str());
+        }
+    } else {
+        const std::string config
+            = "key_format=" + key_format
+              + ",value_format=u,access_pattern_hint=random";
+        ret = wt_session->create(wt_session, kBlobTableURI, config.c_str());
+    }
+
+    wt_session->close(wt_session, NULL);
 
     if (ret != 0) {
         throw std::runtime_error("Unable to create a table. Error code: "
                                  + std::to_string(ret));
     }
 
-    // Open the cursor
-    ret = m_wt_session->open_cursor(
-        m_wt_session, "table:index", NULL, NULL, &m_wt_cursor);
+    if (m_document_rows) {
+        ret = m_wt_connection->open_session(
+            m_wt_connection, NULL, NULL, &m_sequence_session);
+
+        if (ret != 0) {
+            throw std::runtime_error(
+                "Unable to open a database session. Error code: "
+                + std::to_string(ret));
+        }
+        open_cursor(m_sequence_session, kSequenceTableURI, &m_sequence_cursor);
+
+        // Start after the last reserved block
+        m_sequence_cursor->set_key(m_sequence_cursor, kSequenceKey);
+        ret = m_sequence_cursor->search(m_sequence_cursor);
+        if (ret == 0) {
+            ret = m_sequence_cursor->get_value(m_sequence_cursor,
+                                               &m_sequence_limit);
+        }
+        m_sequence_cursor->reset(m_sequence_cursor);
+
+        if (ret != 0 && ret != WT_NOTFOUND) {
+            throw std::runtime_error(
+                "Unable to read the sequence number. Error code: "
+                + std::to_string(ret));
+        }
+        m_next_sequence = m_sequence_limit;
+    }
+}
+
+void WiredTigerMultimap::open_cursor(WT_SESSION* wt_session,
+                                     const char* uri,
+                                     WT_CURSOR** cursor) const
+{
+    int ret = wt_session->open_cursor(wt_session, uri, NULL, NULL, cursor);
 
     if (ret != 0) {
         throw std::runtime_error("Unable to open a cursor. Error code: "
@@ -50,21 +188,240 @@ WiredTigerMultimap::WiredTigerMultimap(const std::string& path)
     }
 }
 
+std::vector<const char*> WiredTigerMultimap::table_uris() const
+{
+    if (m_document_rows) {
+        return {kRowTableURI};
+    }
+    if (m_chunk_capacity > 0) {
+        return {kHeaderTableURI, kChunkTableURI};
+    }
+    return {kBlobTableURI};
+}
+
+WiredTigerMultimap::TableKey WiredTigerMultimap::table_key(
+    const Index::keyword_type& keyword) const
+{
+    TableKey key;
+    switch (m_key_type) {
+    case KeywordKeyType::Hash64:
+        key.words[0] = HashedKeyword64(keyword).word(0);
+        break;
+    case KeywordKeyType::Hash128: {
+        HashedKeyword128 hash(keyword);
+        key.words[0] = hash.word(0);
+        key.words[1] = hash.word(1);
+        break;
+    }
+    case KeywordKeyType::String:
+    default:
+        key.keyword = keyword.c_str();
+        break;
+    }
+    return key;
+}
+
+void WiredTigerMultimap::set_key(WT_CURSOR* cursor, const TableKey& key) const
+{
+    switch (m_key_type) {
+    case KeywordKeyType::Hash64:
+        cursor->set_key(cursor, key.words[0]);
+        break;
+    case KeywordKeyType::Hash128:
+        cursor->set_key(cursor, key.words[0], key.words[1]);
+        break;
+    case KeywordKeyType::String:
+    default:
+        cursor->set_key(cursor, key.keyword);
+        break;
+    }
+}
+
+void WiredTigerMultimap::set_key(WT_CURSOR*      cursor,
+                                 const TableKey& key,
+                                 uint64_t        n) const
+{
+    switch (m_key_type) {
+    case KeywordKeyType::Hash64:
+        cursor->set_key(cursor, key.words[0], n);
+        break;
+    case KeywordKeyType::Hash128:
+        cursor->set_key(cursor, key.words[0], key.words[1], n);
+        break;
+    case KeywordKeyType::String:
+    default:
+        cursor->set_key(cursor, key.keyword, n);
+        break;
+    }
+}
+
+int WiredTigerMultimap::get_key(WT_CURSOR*      cursor,
+                                const TableKey& key,
+                                bool*           match,
+                                uint64_t*       n) const
+{
+    int ret = 0;
+    switch (m_key_type) {
+    case KeywordKeyType::Hash64: {
+        uint64_t word = 0;
+        ret           = cursor->get_key(cursor, &word, n);
+        *match        = (word == key.words[0]);
+        break;
+    }
+    case KeywordKeyType::Hash128: {
+        uint64_t words[2] = {0, 0};
+        ret    = cursor->get_key(cursor, &words[0], &words[1], n);
+        *match = (words[0] == key.words[0] && words[1] == key.words[1]);
+        break;
+    }
+    case KeywordKeyType::String:
+    default: {
+        const char* keyword = nullptr;
+        ret                 = cursor->get_key(cursor, &keyword, n);
+        *match = (keyword != nullptr && std::strcmp(keyword, key.keyword) == 0);
+        break;
+    }
+    }
+    return ret;
+}
+
 WiredTigerMultimap::~WiredTigerMultimap()
 {
+    // Closing the connection closes all the sessions and their cursors
     m_wt_connection->close(m_wt_connection, NULL);
 
     m_wt_connection = nullptr;
-    m_wt_session    = nullptr;
-    m_wt_cursor     = nullptr;
+    m_sessions.clear();
+}
+
+std::unique_ptr<WiredTigerMultimap::Session> WiredTigerMultimap::
+    acquire_session() const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sessions_mtx);
+        if (!m_sessions.empty()) {
+            std::unique_ptr<Session> session = std::move(m_sessions.back());
+            m_sessions.pop_back();
+            return session;
+        }
+    }
+
+    // All the sessions are in use: open a new one
+    std::unique_ptr<Session> session(new Session());
+
+    int ret = m_wt_connection->open_session(
+        m_wt_connection, NULL, NULL, &session->wt_session);
+
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Unable to open a database session. Error code: "
+            + std::to_string(ret));
+    }
+
+    try {
+        if (m_document_rows) {
+            open_cursor(
+                session->wt_session, kRowTableURI, &session->row_cursor);
+        } else if (m_chunk_capacity > 0) {
+            open_cursor(
+                session->wt_session, kHeaderTableURI, &session->header_cursor);
+            open_cursor(
+                session->wt_session, kChunkTableURI, &session->chunk_cursor);
+        } else {
+            open_cursor(session->wt_session, kBlobTableURI, &session->cursor);
+        }
+    } catch (...) {
+        session->wt_session->close(session->wt_session, NULL);
+        throw;
+    }
+    return session;
+}
+
+void WiredTigerMultimap::release_session(
+    std::unique_ptr<Session> session) const
+{
+    std::lock_guard<std::mutex> lock(m_sessions_mtx);
+    m_sessions.push_back(std::move(session));
+}
+
+void WiredTigerMultimap::close_idle_sessions()
+{
+    std::lock_guard<std::mutex> lock(m_sessions_mtx);
+
+    for (const auto& session : m_sessions) {
+        int ret = session->wt_session->close(session->wt_session, NULL);
+        if (ret != 0) {
+            std::cerr << "Unable to close a database session. Error code: "
+                      << std::to_string(ret) << "\n";
+        }
+    }
+    m_sessions.clear();
+}
+
+int WiredTigerMultimap::run_transaction(
+    Session&                    session,
+    const std::function<int()>& body) const
+{
+    WT_SESSION* wt_session = session.wt_session;
+    int         ret        = 0;
+
+    for (size_t attempt = 0; attempt < kMaxTransactionAttempts; attempt++) {
+        if (attempt > 0) {
+            // let the conflicting transaction complete
+            std::this_thread::yield();
+        }
+
+        ret = wt_session->begin_transaction(wt_session, NULL);
+        if (ret != 0) {
+            throw std::runtime_error(
+                "Unable to begin a transaction. Error code: "
+                + std::to_string(ret));
+        }
+
+        try {
+            ret = body();
+        } catch (...) {
+            wt_session->rollback_transaction(wt_session, NULL);
+            throw;
+        }
+
+        if (ret == 0) {
+            // A failed commit rolls the transaction back
+            ret = wt_session->commit_transaction(wt_session, NULL);
+        } else {
+            wt_session->rollback_transaction(wt_session, NULL);
+        }
+
+        if (ret != WT_ROLLBACK) {
+            break;
+        }
+    }
+    return ret;
 }
 
 std::vector<Index::document_type> WiredTigerMultimap::search(
     const Index::keyword_type& keyword) const
 {
-    m_wt_cursor->set_key(m_wt_cursor, keyword.c_str());
+    SessionLease lease(*this);
 
-    int ret = m_wt_cursor->search(m_wt_cursor);
+    if (m_document_rows || m_chunk_capacity > 0) {
+        std::vector<Index::document_type> results;
+        auto collect = [&results](const Index::document_type* docs, size_t n) {
+            results.insert(results.end(), docs, docs + n);
+        };
+
+        if (m_document_rows) {
+            search_rows(*lease, keyword, collect);
+        } else {
+            search_chunked(*lease, keyword, collect);
+        }
+        return results;
+    }
+
+    WT_CURSOR* cursor = lease->cursor;
+    set_key(cursor, table_key(keyword));
+
+    int ret = cursor->search(cursor);
 
     if (ret == WT_NOTFOUND) {
         return {};
@@ -77,7 +434,7 @@ std::vector<Index::document_type> WiredTigerMultimap::search(
     }
 
     WT_ITEM value;
-    ret = m_wt_cursor->get_value(m_wt_cursor, &value);
+    ret = cursor->get_value(cursor, &value);
     if (ret != 0) {
         throw std::runtime_error(
             "Search: Error when getting the value for keyword \"" + keyword
@@ -85,78 +442,903 @@ std::vector<Index::document_type> WiredTigerMultimap::search(
     }
 
     std::vector<Index::document_type> results;
-    if (!Index::deserialize_document_list(
+    if (!m_codec.decode(
             reinterpret_cast<const char*>(value.data), value.size, &results)) {
         std::cerr << "Corruption!\n";
     }
 
-    ret = m_wt_cursor->reset(m_wt_cursor);
+    ret = cursor->reset(cursor);
     if (ret != 0) {
         std::cerr << "Search: Error when reseting the cursor for keyword \""
                   << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
     }
     return results;
 }
+
+void WiredTigerMultimap::search(
+    const Index::keyword_type&          keyword,
+    const Index::document_visitor_type& visitor) const
+{
+    SessionLease lease(*this);
+
+    if (m_document_rows) {
+        search_rows(*lease, keyword, visitor);
+        return;
+    }
+    if (m_chunk_capacity > 0) {
+        search_chunked(*lease, keyword, visitor);
+        return;
+    }
+
+    WT_CURSOR* cursor = lease->cursor;
+    set_key(cursor, table_key(keyword));
+
+    int ret = cursor->search(cursor);
+
+    if (ret == WT_NOTFOUND) {
+        return;
+    }
+
+    if (ret != 0) {
+        throw std::runtime_error("Search: Error when searching keyword \""
+                                 + keyword
+                                 + "\"\ncode: " + std::to_string(ret));
+    }
+
+    // The item points to WiredTiger's buffer, which remains valid until the
+    // cursor is reset.
+    WT_ITEM value;
+    ret = cursor->get_value(cursor, &value);
+    if (ret != 0) {
+        cursor->reset(cursor);
+        throw std::runtime_error(
+            "Search: Error when getting the value for keyword \"" + keyword
+            + "\"\ncode: " + std::to_string(ret));
+    }
+
+    bool valid = true;
+    try {
+        valid = m_codec.visit(
+            reinterpret_cast<const char*>(value.data), value.size, visitor);
+    } catch (...) {
+        cursor->reset(cursor);
+        throw;
+    }
+
+    if (!valid) {
+        std::cerr << "Corruption!\n";
+    }
+
+    ret = cursor->reset(cursor);
+    if (ret != 0) {
+        std::cerr << "Search: Error when reseting the cursor for keyword \""
+                  << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
+    }
+}
+
+Index::MultiSearchResult WiredTigerMultimap::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    if (m_document_rows || m_chunk_capacity > 0) {
+        return Index::search_many(keywords);
+    }
+
+    std::vector<TableKey> keys;
+    keys.reserve(keywords.size());
+    for (const Index::keyword_type& keyword : keywords) {
+        keys.push_back(table_key(keyword));
+    }
+
+    // Search the keys in the order of the table, so that the cursor moves
+    // forward in the tree, and successive searches hit the same pages.
+    std::vector<size_t> order(keywords.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (m_key_type == KeywordKeyType::String) {
+        std::sort(order.begin(), order.end(), [&keywords](size_t a, size_t b) {
+            return keywords[a] < keywords[b];
+        });
+    } else {
+        std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+            return std::lexicographical_compare(std::begin(keys[a].words),
+                                                std::end(keys[a].words),
+                                                std::begin(keys[b].words),
+                                                std::end(keys[b].words));
+        });
+    }
+
+    Index::MultiSearchResult result(keywords.size());
+
+    SessionLease lease(*this);
+    WT_CURSOR*   cursor = lease->cursor;
+
+    for (size_t i : order) {
+        const Index::keyword_type& keyword = keywords[i];
+
+        set_key(cursor, keys[i]);
+
+        int ret = cursor->search(cursor);
+
+        if (ret == WT_NOTFOUND) {
+            continue;
+        }
+
+        if (ret != 0) {
+            cursor->reset(cursor);
+            throw std::runtime_error("Search: Error when searching keyword \""
+                                     + keyword
+                                     + "\"\ncode: " + std::to_string(ret));
+        }
+
+        WT_ITEM value;
+        ret = cursor->get_value(cursor, &value);
+        if (ret != 0) {
+            cursor->reset(cursor);
+            throw std::runtime_error(
+                "Search: Error when getting the value for keyword \"" + keyword
+                + "\"\ncode: " + std::to_string(ret));
+        }
+
+        if (!m_codec.set_list(&result,
+                              i,
+                              reinterpret_cast<const char*>(value.data),
+                              value.size)) {
+            std::cerr << "Corruption!\n";
+        }
+    }
+
+    int ret = cursor->reset(cursor);
+    if (ret != 0) {
+        std::cerr << "Search: Error when reseting the cursor\ncode: "
+                  << std::to_string(ret) << "\n";
+    }
+    return result;
+}
+
 void WiredTigerMultimap::insert(const Index::keyword_type& keyword,
                                 Index::document_type       document)
 {
-    m_wt_cursor->set_key(m_wt_cursor, keyword.c_str());
+    SessionLease lease(*this);
+    Session&     session = *lease;
 
-    int ret = m_wt_cursor->search(m_wt_cursor);
+    // The list is read and rewritten (as well as the header of the chunked
+    // layout): the transaction prevents concurrent inserts from losing
+    // documents
+    int ret = run_transaction(session, [&]() {
+        return append(session, keyword, &document, 1);
+    });
 
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Insert: Unable to append to the list of keyword \"" + keyword
+            + "\". The transaction was rolled back. Error code: "
+            + std::to_string(ret));
+    }
+}
+
+void WiredTigerMultimap::insert_batch(
+    const std::vector<Index::entry_type>& entries)
+{
+    const auto groups = Index::group_by_keyword(entries);
+
+    SessionLease lease(*this);
+    Session&     session = *lease;
+
+    // Apply the whole batch in a single transaction, and update every keyword
+    // only once
+    std::string failed_keyword;
+    int         ret = run_transaction(session, [&]() {
+        for (const auto& group : groups) {
+            int append_ret = append(session,
+                                    group.first,
+                                    group.second.data(),
+                                    group.second.size());
+            if (append_ret != 0) {
+                failed_keyword = group.first;
+                return append_ret;
+            }
+        }
+        return 0;
+    });
+
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Insert batch: Unable to append the list of keyword \""
+            + failed_keyword
+            + "\". The transaction was rolled back. Error code: "
+            + std::to_string(ret));
+    }
+}
+
+void WiredTigerMultimap::put_list(const Index::keyword_type&  keyword,
+                                  const Index::document_type* documents,
+                                  size_t                      n)
+{
+    SessionLease lease(*this);
+    Session&     session = *lease;
+
+    int ret = run_transaction(
+        session, [&]() { return append(session, keyword, documents, n); });
+
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Put list: Unable to append the list of keyword \"" + keyword
+            + "\". The transaction was rolled back. Error code: "
+            + std::to_string(ret));
+    }
+}
+
+void WiredTigerMultimap::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    if (m_key_type != KeywordKeyType::String) {
+        throw std::logic_error(m_path
+                               + ": the keywords are hashed, and cannot be "
+                                 "enumerated");
+    }
+
+    SessionLease lease(*this);
+
+    WT_CURSOR* cursor = lease->cursor;
+    if (m_document_rows) {
+        cursor = lease->row_cursor;
+    } else if (m_chunk_capacity > 0) {
+        cursor = lease->header_cursor;
+    }
+
+    Index::keyword_type keyword;
+    bool                first = true;
+
+    int ret = cursor->next(cursor);
+    try {
+        for (; ret == 0; ret = cursor->next(cursor)) {
+            const char* row_keyword = nullptr;
+            uint64_t    sequence    = 0;
+
+            if (m_document_rows) {
+                // The rows of a keyword are consecutive
+                ret = cursor->get_key(cursor, &row_keyword, &sequence);
+                if (ret == 0 && !first && keyword == row_keyword) {
+                    continue;
+                }
+            } else {
+                ret = cursor->get_key(cursor, &row_keyword);
+            }
+            if (ret != 0) {
+                break;
+            }
+
+            keyword = row_keyword;
+            first   = false;
+            visitor(keyword);
+        }
+    } catch (...) {
+        cursor->reset(cursor);
+        throw;
+    }
+    cursor->reset(cursor);
+
+    if (ret != WT_NOTFOUND) {
+        throw std::runtime_error(
+            "Unable to iterate over the keywords. Error code: "
+            + std::to_string(ret));
+    }
+}
+
+ExternalSorter::Stats WiredTigerMultimap::bulk_load(
+    const ExternalSorter::source_type& source,
+    const ExternalSorter::Options&     options)
+{
+    ExternalSorter sorter(m_path + "/bulk_load", options);
+    sorter.sort(source);
+
+    const std::vector<const char*> uris = table_uris();
+
+    // Close the cursors of the pool, that would prevent the bulk cursors from
+    // being opened
+    close_idle_sessions();
+
+    WT_SESSION* wt_session = nullptr;
+
+    int ret = m_wt_connection->open_session(
+        m_wt_connection, NULL, NULL, &wt_session);
+
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Unable to open a database session. Error code: "
+            + std::to_string(ret));
+    }
+
+    try {
+        // A bulk cursor can only be opened on an empty table
+        bool empty_tables = true;
+        for (const char* uri : uris) {
+            WT_CURSOR* cursor = nullptr;
+            open_cursor(wt_session, uri, &cursor);
+
+            ret = cursor->next(cursor);
+            cursor->close(cursor);
+
+            if (ret != 0 && ret != WT_NOTFOUND) {
+                throw std::runtime_error(
+                    std::string("Bulk load: Error when reading ") + uri
+                    + "\ncode: " + std::to_string(ret));
+            }
+            empty_tables = empty_tables && (ret == WT_NOTFOUND);
+        }
+
+        // The hashed keys are not in the order of the sorted keywords, that
+        // the bulk cursors require
+        if (!empty_tables || m_key_type != KeywordKeyType::String) {
+            wt_session->close(wt_session, NULL);
+            wt_session = nullptr;
+
+            SessionLease lease(*this);
+            Session&     session = *lease;
+
+            sorter.merge([&](ExternalSorter::list_type&& list) {
+                int append_ret = run_transaction(session, [&]() {
+                    return append(session,
+                                  list.first,
+                                  list.second.data(),
+                                  list.second.size());
+                });
+
+                if (append_ret != 0) {
+                    throw std::runtime_error(
+                        "Bulk load: Unable to append the list of keyword \""
+                        + list.first
+                        + "\". Error code: " + std::to_string(append_ret));
+                }
+                return true;
+            });
+            return sorter.stats();
+        }
+
+        std::vector<WT_CURSOR*> cursors(uris.size(), nullptr);
+        for (size_t i = 0; i < uris.size(); i++) {
+            ret = wt_session->open_cursor(
+                wt_session, uris[i], NULL, "bulk", &cursors[i]);
+
+            if (ret != 0) {
+                throw std::runtime_error(
+                    std::string("Unable to open a bulk cursor on ") + uris[i]
+                    + ". Error code: " + std::to_string(ret));
+            }
+        }
+
+        uint64_t sequence = 0;
+        if (m_document_rows) {
+            sequence = reserve_sequence(sorter.stats().entry_count);
+        }
+
+        sorter.merge([&](ExternalSorter::list_type&& list) {
+            bulk_insert(cursors, list, &sequence);
+            return true;
+        });
+
+        // Closing the bulk cursors completes the load
+        for (WT_CURSOR* cursor : cursors) {
+            ret = cursor->close(cursor);
+            if (ret != 0) {
+                throw std::runtime_error(
+                    "Unable to close a bulk cursor. Error code: "
+                    + std::to_string(ret));
+            }
+        }
+    } catch (...) {
+        if (wt_session != nullptr) {
+            wt_session->close(wt_session, NULL);
+        }
+        throw;
+    }
+
+    wt_session->close(wt_session, NULL);
+    return sorter.stats();
+}
+
+void WiredTigerMultimap::bulk_insert(const std::vector<WT_CURSOR*>&   cursors,
+                                     const ExternalSorter::list_type& list,
+                                     uint64_t*                        sequence)
+{
+    const Index::keyword_type&               keyword   = list.first;
+    const std::vector<Index::document_type>& documents = list.second;
+    const TableKey                           key       = table_key(keyword);
+
+    int ret = 0;
+
+    if (m_document_rows) {
+        WT_CURSOR* cursor = cursors[0];
+
+        for (size_t i = 0; i < documents.size() && ret == 0; i++) {
+            set_key(cursor, key, (*sequence)++);
+            cursor->set_value(cursor, documents[i]);
+            ret = cursor->insert(cursor);
+        }
+    } else if (m_chunk_capacity > 0) {
+        WT_CURSOR* header_cursor = cursors[0];
+        WT_CURSOR* chunk_cursor  = cursors[1];
+
+        std::string encoded;
+        uint64_t    n_chunks = 0;
+
+        for (size_t offset = 0; offset < documents.size() && ret == 0;
+             offset += m_chunk_capacity, n_chunks++) {
+            size_t count
+                = std::min(m_chunk_capacity, documents.size() - offset);
+
+            encoded.clear();
+            m_codec.encode(documents.data() + offset, count, &encoded);
+
+            WT_ITEM value;
+            value.data = encoded.data();
+            value.size = encoded.size();
+
+            set_key(chunk_cursor, key, n_chunks);
+            chunk_cursor->set_value(chunk_cursor, &value);
+            ret = chunk_cursor->insert(chunk_cursor);
+        }
+
+        if (ret == 0) {
+            set_key(header_cursor, key);
+            header_cursor->set_value(header_cursor, n_chunks);
+            ret = header_cursor->insert(header_cursor);
+        }
+    } else {
+        WT_CURSOR* cursor = cursors[0];
+
+        std::string encoded;
+        m_codec.encode(documents.data(), documents.size(), &encoded);
+
+        WT_ITEM value;
+        value.data = encoded.data();
+        value.size = encoded.size();
+
+        set_key(cursor, key);
+        cursor->set_value(cursor, &value);
+        ret = cursor->insert(cursor);
+    }
+
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Bulk load: Error when inserting the list of keyword \"" + keyword
+            + "\"\ncode: " + std::to_string(ret));
+    }
+}
+
+int WiredTigerMultimap::append(Session&                    session,
+                               const Index::keyword_type&  keyword,
+                               const Index::document_type* documents,
+                               size_t                      n_documents)
+{
+    if (m_document_rows) {
+        return append_rows(session, keyword, documents, n_documents);
+    }
+    if (m_chunk_capacity > 0) {
+        return append_chunked(session, keyword, documents, n_documents);
+    }
+    return append_blob(session, keyword, documents, n_documents);
+}
+
+int WiredTigerMultimap::append_blob(Session&                    session,
+                                    const Index::keyword_type&  keyword,
+                                    const Index::document_type* documents,
+                                    size_t                      n_documents)
+{
+    WT_CURSOR* cursor = session.cursor;
+
+    set_key(cursor, table_key(keyword));
+
+    int ret = cursor->search(cursor);
+
+    if (ret == WT_ROLLBACK) {
+        return ret;
+    }
     if ((ret != 0) && (ret != WT_NOTFOUND)) {
         throw std::runtime_error("Insert: Error when searching keyword \""
                                  + keyword
                                  + "\"\ncode: " + std::to_string(ret));
     }
 
-    bool                  insert_new_entry = (ret == WT_NOTFOUND);
-    WT_ITEM               value;
-    Index::document_type* doc_list = nullptr;
+    bool        insert_new_entry = (ret == WT_NOTFOUND);
+    WT_ITEM     value;
+    std::string encoded;
+    int         update_ret = 0;
 
     if (insert_new_entry) {
-        value.data = &document;
-        value.size = sizeof(document);
+        m_codec.encode(documents, n_documents, &encoded);
     } else {
-        ret = m_wt_cursor->get_value(m_wt_cursor, &value);
+        ret = cursor->get_value(cursor, &value);
 
         if (ret != 0) {
             std::cerr << "Insert: Error when getting the value for keyword \""
                       << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
-            return;
+            cursor->reset(cursor);
+            return ret;
         }
 
-        size_t n_elts = value.size / sizeof(document);
+        if (m_append_mode == AppendMode::Modify) {
+            // The encoded lists are concatenable: the new documents are
+            // written as a new segment at the end of the value, and
+            // WiredTiger only logs and caches this delta
+            m_codec.encode(documents, n_documents, &encoded);
 
-        doc_list = new Index::document_type[n_elts + 1];
-        const Index::document_type* old_list
-            = reinterpret_cast<const Index::document_type*>(value.data);
+            WT_MODIFY modification;
+            modification.data.data = encoded.data();
+            modification.data.size = encoded.size();
+            modification.offset    = value.size;
+            modification.size      = 0;
 
+            update_ret = cursor->modify(cursor, &modification, 1);
+        } else {
+            encoded.assign(reinterpret_cast<const char*>(value.data),
+                           value.size);
 
-        std::copy(old_list, old_list + n_elts, doc_list);
-        doc_list[n_elts] = document;
+            if (!m_codec.append(documents, n_documents, &encoded)) {
+                std::cerr << "Insert: Corrupted list for keyword \""
+                          << keyword << "\"\n";
+                cursor->reset(cursor);
+                return EINVAL;
+            }
+        }
+    }
+
+    if (insert_new_entry || m_append_mode == AppendMode::Rewrite) {
+        value.data = encoded.data();
+        value.size = encoded.size();
 
-        value.data = doc_list;
-        value.size += sizeof(document);
+        cursor->set_value(cursor, &value);
+        update_ret = cursor->update(cursor);
     }
 
-    m_wt_cursor->set_value(m_wt_cursor, &value);
-    ret = m_wt_cursor->update(m_wt_cursor);
-    if (ret != 0) {
+    // conflicts are retried by the caller
+    if (update_ret != 0 && update_ret != WT_ROLLBACK) {
         std::cerr << "Insert: Error when updating the value for keyword \""
-                  << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
+                  << keyword << "\"\ncode: " << std::to_string(update_ret)
+                  << "\n";
     }
 
 
-    ret = m_wt_cursor->reset(m_wt_cursor);
+    ret = cursor->reset(cursor);
     if (ret != 0) {
         std::cerr << "Insert: Error when reseting the cursor for keyword \""
                   << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
     }
 
-    delete[] doc_list;
+    return update_ret;
 }
 
+int WiredTigerMultimap::get_chunk_count(
+    Session&                   session,
+    const Index::keyword_type& keyword,
+    uint64_t*                  n_chunks) const
+{
+    WT_CURSOR* header_cursor = session.header_cursor;
+
+    set_key(header_cursor, table_key(keyword));
+
+    int ret = header_cursor->search(header_cursor);
+
+    if (ret == WT_NOTFOUND || ret == WT_ROLLBACK) {
+        return ret;
+    }
+
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Error when searching the header of keyword \"" + keyword
+            + "\"\ncode: " + std::to_string(ret));
+    }
+
+    ret = header_cursor->get_value(header_cursor, n_chunks);
+    header_cursor->reset(header_cursor);
+
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Error when getting the header of keyword \"" + keyword
+            + "\"\ncode: " + std::to_string(ret));
+    }
+    return 0;
+}
+
+void WiredTigerMultimap::search_chunked(
+    Session&                            session,
+    const Index::keyword_type&          keyword,
+    const Index::document_visitor_type& visitor) const
+{
+    uint64_t n_chunks = 0;
+    int      ret      = get_chunk_count(session, keyword, &n_chunks);
+
+    if (ret == WT_NOTFOUND) {
+        return;
+    }
+    if (ret != 0) {
+        throw std::runtime_error(
+            "Search: Error when searching the header of keyword \"" + keyword
+            + "\"\ncode: " + std::to_string(ret));
+    }
+    if (n_chunks == 0) {
+        return;
+    }
+
+    WT_CURSOR*     chunk_cursor = session.chunk_cursor;
+    const TableKey key          = table_key(keyword);
+
+    // The chunks of a list are consecutive in the table: position the cursor
+    // on the first one, and walk forward.
+    set_key(chunk_cursor, key, 0);
+
+    ret = chunk_cursor->search(chunk_cursor);
+
+    try {
+        for (uint64_t i = 0; i < n_chunks; i++) {
+            if (ret != 0) {
+                throw std::runtime_error("Search: Missing chunk "
+                                         + std::to_string(i) + " of keyword \""
+                                         + keyword
+                                         + "\"\ncode: " + std::to_string(ret));
+            }
+
+            bool     match       = false;
+            uint64_t chunk_index = 0;
+            WT_ITEM  value;
+
+            ret = get_key(chunk_cursor, key, &match, &chunk_index);
+            if (ret == 0) {
+                ret = chunk_cursor->get_value(chunk_cursor, &value);
+            }
+            if (ret != 0 || chunk_index != i || !match) {
+                throw std::runtime_error(
+                    "Search: Error when reading chunk " + std::to_string(i)
+                    + " of keyword \"" + keyword
+                    + "\"\ncode: " + std::to_string(ret));
+            }
+
+            if (!m_codec.visit(reinterpret_cast<const char*>(value.data),
+                               value.size,
+                               visitor)) {
+                std::cerr << "Corruption!\n";
+            }
+
+            ret = chunk_cursor->next(chunk_cursor);
+        }
+    } catch (...) {
+        chunk_cursor->reset(chunk_cursor);
+        throw;
+    }
+
+    ret = chunk_cursor->reset(chunk_cursor);
+    if (ret != 0) {
+        std::cerr << "Search: Error when reseting the cursor for keyword \""
+                  << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
+    }
+}
+
+int WiredTigerMultimap::append_chunked(
+    Session&                    session,
+    const Index::keyword_type&  keyword,
+    const Index::document_type* documents,
+    size_t                      n_documents)
+{
+    // A header is only written with the chunk it counts
+    if (n_documents == 0) {
+        return 0;
+    }
+
+    WT_CURSOR* header_cursor = session.header_cursor;
+    WT_CURSOR* chunk_cursor  = session.chunk_cursor;
+
+    uint64_t                          n_chunks = 0;
+    uint64_t                          tail     = 0;
+    std::vector<Index::document_type> chunk;
+    const TableKey                    key = table_key(keyword);
+
+    int ret = get_chunk_count(session, keyword, &n_chunks);
+    if (ret == WT_ROLLBACK) {
+        return ret;
+    }
+    const bool has_header = (ret == 0);
+    ret                   = 0;
+
+    // Only the last chunk is read and rewritten
+    if (has_header && n_chunks > 0) {
+        tail = n_chunks - 1;
+
+        set_key(chunk_cursor, key, tail);
+        ret = chunk_cursor->search(chunk_cursor);
+
+        WT_ITEM value;
+        if (ret == 0) {
+            ret = chunk_cursor->get_value(chunk_cursor, &value);
+        }
+        if (ret == 0
+            && !m_codec.decode(reinterpret_cast<const char*>(value.data),
+                               value.size,
+                               &chunk)) {
+            ret = EINVAL;
+        }
+        if (ret != 0) {
+            if (ret != WT_ROLLBACK) {
+                std::cerr << "Insert: Error when reading the last chunk of \""
+                          << keyword << "\"\ncode: " << std::to_string(ret)
+                          << "\n";
+            }
+            chunk_cursor->reset(chunk_cursor);
+            return ret;
+        }
+    }
+
+    std::string encoded;
+    size_t      offset = 0;
+
+    // Fill the last chunk, and create new ones if needed
+    while (offset < n_documents) {
+        if (chunk.size() >= m_chunk_capacity) {
+            tail++;
+            chunk.clear();
+        }
+
+        size_t count
+            = std::min(m_chunk_capacity - chunk.size(), n_documents - offset);
+        chunk.insert(
+            chunk.end(), documents + offset, documents + offset + count);
+        offset += count;
+
+        encoded.clear();
+        m_codec.encode(chunk.data(), chunk.size(), &encoded);
+
+        WT_ITEM value;
+        value.data = encoded.data();
+        value.size = encoded.size();
+
+        set_key(chunk_cursor, key, tail);
+        chunk_cursor->set_value(chunk_cursor, &value);
+        ret = chunk_cursor->update(chunk_cursor);
+
+        if (ret != 0) {
+            if (ret != WT_ROLLBACK) {
+                std::cerr << "Insert: Error when updating chunk " << tail
+                          << " of keyword \"" << keyword
+                          << "\"\ncode: " << std::to_string(ret) << "\n";
+            }
+            chunk_cursor->reset(chunk_cursor);
+            return ret;
+        }
+    }
+    chunk_cursor->reset(chunk_cursor);
+
+    if (tail + 1 != n_chunks) {
+        n_chunks = tail + 1;
+
+        set_key(header_cursor, key);
+        header_cursor->set_value(header_cursor, n_chunks);
+        ret = header_cursor->update(header_cursor);
+        header_cursor->reset(header_cursor);
+
+        if (ret != 0 && ret != WT_ROLLBACK) {
+            std::cerr << "Insert: Error when updating the header of keyword \""
+                      << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
+        }
+    }
+    return ret;
+}
+
+int WiredTigerMultimap::append_rows(Session&                    session,
+                                    const Index::keyword_type&  keyword,
+                                    const Index::document_type* documents,
+                                    size_t                      n_documents)
+{
+    WT_CURSOR*     cursor   = session.row_cursor;
+    uint64_t       sequence = reserve_sequence(n_documents);
+    const TableKey key      = table_key(keyword);
+
+    // Blind writes: the keys are unique
+    for (size_t i = 0; i < n_documents; i++) {
+        set_key(cursor, key, sequence + i);
+        cursor->set_value(cursor, documents[i]);
+
+        int ret = cursor->insert(cursor);
+        if (ret != 0) {
+            if (ret != WT_ROLLBACK) {
+                std::cerr << "Insert: Error when inserting a row of keyword \""
+                          << keyword << "\"\ncode: " << std::to_string(ret)
+                          << "\n";
+            }
+            cursor->reset(cursor);
+            return ret;
+        }
+    }
+    cursor->reset(cursor);
+    return 0;
+}
+
+void WiredTigerMultimap::search_rows(
+    Session&                            session,
+    const Index::keyword_type&          keyword,
+    const Index::document_visitor_type& visitor) const
+{
+    WT_CURSOR*     cursor = session.row_cursor;
+    const TableKey key    = table_key(keyword);
+
+    // Position the cursor on the first row of the keyword, and scan forward
+    int exact = 0;
+    set_key(cursor, key, 0);
+    int ret = cursor->search_near(cursor, &exact);
+    if (ret == 0 && exact < 0) {
+        ret = cursor->next(cursor);
+    }
+
+    Index::document_type block[kScanBlockSize];
+    size_t               n = 0;
+
+    try {
+        while (ret == 0) {
+            bool     match    = false;
+            uint64_t sequence = 0;
+
+            ret = get_key(cursor, key, &match, &sequence);
+            if (ret != 0 || !match) {
+                break;
+            }
+
+            ret = cursor->get_value(cursor, &block[n]);
+            if (ret != 0) {
+                break;
+            }
+            if (++n == kScanBlockSize) {
+                visitor(block, n);
+                n = 0;
+            }
+
+            ret = cursor->next(cursor);
+        }
+
+        if (ret != 0 && ret != WT_NOTFOUND) {
+            throw std::runtime_error("Search: Error when scanning keyword \""
+                                     + keyword
+                                     + "\"\ncode: " + std::to_string(ret));
+        }
+        if (n > 0) {
+            visitor(block, n);
+        }
+    } catch (...) {
+        cursor->reset(cursor);
+        throw;
+    }
+
+    ret = cursor->reset(cursor);
+    if (ret != 0) {
+        std::cerr << "Search: Error when reseting the cursor for keyword \""
+                  << keyword << "\"\ncode: " << std::to_string(ret) << "\n";
+    }
+}
+
+uint64_t WiredTigerMultimap::reserve_sequence(size_t n)
+{
+    std::lock_guard<std::mutex> lock(m_sequence_mtx);
+
+    if (m_next_sequence + n > m_sequence_limit) {
+        // Persist the end of a new block before using it. The write is not
+        // part of the caller's transaction: a rolled back insert only wastes
+        // its sequence numbers.
+        const uint64_t limit
+            = m_next_sequence + std::max<uint64_t>(n, kSequenceBlockSize);
+
+        m_sequence_cursor->set_key(m_sequence_cursor, kSequenceKey);
+        m_sequence_cursor->set_value(m_sequence_cursor, limit);
+        int ret = m_sequence_cursor->update(m_sequence_cursor);
+        m_sequence_cursor->reset(m_sequence_cursor);
+
+        if (ret != 0) {
+            throw std::runtime_error(
+                "Unable to reserve sequence numbers. Error code: "
+                + std::to_string(ret));
+        }
+        m_sequence_limit = limit;
+    }
+
+    uint64_t first = m_next_sequence;
+    m_next_sequence += n;
+    return first;
+}
 
 } // namespace insecure
 } // namespace sse
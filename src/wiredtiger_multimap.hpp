@@ -1,28 +1,237 @@
 #pragma once
 
+#include "external_sorter.hpp"
 #include "index.hpp"
+#include "keyword_key.hpp"
+#include "posting_list_codec.hpp"
 
 #include <wiredtiger.h>
 
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace sse {
 namespace insecure {
 
 
+// Index storing the lists in WiredTiger.
+//
+// The index is thread safe. WiredTiger sessions (and their cursors) can only
+// be used by one thread at a time: every operation checks a session out of a
+// pool, and opens a new one if all of them are in use. Inserts run in
+// transactions, retried when they conflict with a concurrent insert to the
+// same keyword.
 class WiredTigerMultimap : public Index
 {
 public:
-    WiredTigerMultimap(const std::string& path);
+    enum class AppendMode
+    {
+        // Read the list, and write it back with the new documents
+        Rewrite,
+        // Write the new documents as a partial update of the list
+        // (WT_CURSOR::modify). The codec does not merge the appended
+        // segments with the existing ones.
+        Modify,
+    };
+
+    struct Options
+    {
+        // Maximum number of documents in a chunk of posting list.
+        // If non-zero, the lists are stored as a sequence of fixed-capacity
+        // chunks keyed by (keyword, chunk number), plus a header containing
+        // the number of chunks. An insertion then only rewrites the last chunk
+        // of the list instead of the whole list. If zero, every list is stored
+        // as a single value.
+        // The two layouts use different tables: the same layout must be used
+        // every time a database is opened.
+        size_t chunk_capacity{0};
+
+        // Encoding of the lists (or of the chunks)
+        PostingListCodecType codec{PostingListCodecType::Raw};
+
+        // How documents are appended to an existing list, when the lists
+        // are not chunked
+        AppendMode append_mode{AppendMode::Modify};
+
+        // If true, every document is stored in its own row, keyed by
+        // (keyword, sequence number), and a list is read with a range scan.
+        // Inserts are then blind writes, that never read the list.
+        // chunk_capacity, codec and append_mode are ignored. This layout also
+        // uses its own tables.
+        bool document_rows{false};
+
+        // Representation of the keywords in the keys of the tables. The
+        // hashed keywords are stored as one (Hash64) or two (Hash128)
+        // integers, compared without reading any string, but they cannot be
+        // enumerated (for_each_keyword), and bulk_load then appends the
+        // lists as insert_batch. The same representation must be used every
+        // time a database is opened.
+        KeywordKeyType key_type{KeywordKeyType::String};
+    };
+
+    explicit WiredTigerMultimap(const std::string& path);
+    WiredTigerMultimap(const std::string& path, const Options& options);
     ~WiredTigerMultimap() override;
 
     std::vector<Index::document_type> search(
         const Index::keyword_type& keyword) const override;
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
     void insert(const Index::keyword_type& keyword,
                 Index::document_type       document) override;
+    void insert_batch(const std::vector<Index::entry_type>& entries) override;
+    void put_list(const Index::keyword_type&  keyword,
+                  const Index::document_type* documents,
+                  size_t                      n) override;
+    // Scans the table of the list headers, or the rows of the documents.
+    // Throws std::logic_error with hashed keywords.
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    // Build the lists from the pairs of source, sorted by an ExternalSorter
+    // in the bulk_load subdirectory of the database.
+    // If the tables of the layout are empty, the lists are written with bulk
+    // cursors, that append the rows in key order without searching the trees
+    // or splitting pages. Otherwise, every list is appended as by
+    // insert_batch. The index must not be used by other threads during the
+    // load: the bulk cursors require an exclusive access to the tables.
+    ExternalSorter::Stats bulk_load(const ExternalSorter::source_type& source,
+                                    const ExternalSorter::Options&     options);
 
 private:
+    // A session and the cursors of the layout
+    struct Session
+    {
+        WT_SESSION* wt_session{nullptr};
+        WT_CURSOR*  cursor{nullptr};
+
+        // Cursors of the chunked layout
+        WT_CURSOR* header_cursor{nullptr};
+        WT_CURSOR* chunk_cursor{nullptr};
+
+        // Cursor of the document rows layout
+        WT_CURSOR* row_cursor{nullptr};
+    };
+
+    // RAII checkout of a session from the pool
+    class SessionLease;
+
+    std::unique_ptr<Session> acquire_session() const;
+    void release_session(std::unique_ptr<Session> session) const;
+
+    void open_cursor(WT_SESSION* wt_session,
+                     const char* uri,
+                     WT_CURSOR** cursor) const;
+
+    // The tables of the layout
+    std::vector<const char*> table_uris() const;
+
+    // Key of a keyword in the tables: the keyword, or the words of its hash
+    struct TableKey
+    {
+        const char* keyword{nullptr};
+        uint64_t    words[2]{0, 0};
+    };
+
+    // The key must not outlive keyword
+    TableKey table_key(const Index::keyword_type& keyword) const;
+
+    // Set the key of cursor to key, followed by n in the tables of the
+    // chunks and of the document rows
+    void set_key(WT_CURSOR* cursor, const TableKey& key) const;
+    void set_key(WT_CURSOR* cursor, const TableKey& key, uint64_t n) const;
+
+    // Check if the current row of cursor, in the tables of the chunks or of
+    // the document rows, belongs to key, and get the number that follows it.
+    // Returns the error code of WT_CURSOR::get_key.
+    int get_key(WT_CURSOR*      cursor,
+                const TableKey& key,
+                bool*           match,
+                uint64_t*       n) const;
+
+    // Close the idle sessions of the pool, and their cursors
+    void close_idle_sessions();
+
+    // Write a list with the bulk cursors of the tables of the layout, opened
+    // in the order of table_uris(). *sequence is the next sequence number of
+    // the document rows.
+    void bulk_insert(const std::vector<WT_CURSOR*>&   cursors,
+                     const ExternalSorter::list_type& list,
+                     uint64_t*                        sequence);
+
+    // Run body in a transaction of session, and commit it if body returns 0.
+    // The transaction is retried as long as it conflicts with another one
+    // (WT_ROLLBACK), up to kMaxTransactionAttempts times.
+    // Returns the error code of the last attempt.
+    int run_transaction(Session&                    session,
+                        const std::function<int()>& body) const;
+
+    // Append n_documents documents to the list of keyword, in the current
+    // transaction of session. Returns 0, or the error code, which is logged
+    // unless it is a conflict.
+    int append(Session&                    session,
+               const Index::keyword_type&  keyword,
+               const Index::document_type* documents,
+               size_t                      n_documents);
+
+    int append_blob(Session&                    session,
+                    const Index::keyword_type&  keyword,
+                    const Index::document_type* documents,
+                    size_t                      n_documents);
+    int append_chunked(Session&                    session,
+                       const Index::keyword_type&  keyword,
+                       const Index::document_type* documents,
+                       size_t                      n_documents);
+
+    int append_rows(Session&                    session,
+                    const Index::keyword_type&  keyword,
+                    const Index::document_type* documents,
+                    size_t                      n_documents);
+
+    void search_chunked(Session&                            session,
+                        const Index::keyword_type&          keyword,
+                        const Index::document_visitor_type& visitor) const;
+
+    void search_rows(Session&                            session,
+                     const Index::keyword_type&          keyword,
+                     const Index::document_visitor_type& visitor) const;
+
+    // Reserve n consecutive sequence numbers for the document rows, and
+    // return the first one
+    uint64_t reserve_sequence(size_t n);
+
+    // Get the number of chunks of the list of keyword.
+    // Returns 0, WT_NOTFOUND if the keyword is not in the database, or
+    // WT_ROLLBACK. Throws on other errors.
+    int get_chunk_count(Session&                   session,
+                        const Index::keyword_type& keyword,
+                        uint64_t*                  n_chunks) const;
+
     WT_CONNECTION* m_wt_connection{nullptr};
-    WT_SESSION*    m_wt_session{nullptr};
-    WT_CURSOR*     m_wt_cursor{nullptr};
+
+    // Idle sessions
+    mutable std::mutex                            m_sessions_mtx;
+    mutable std::vector<std::unique_ptr<Session>> m_sessions;
+
+    const std::string       m_path;
+    const size_t            m_chunk_capacity;
+    const PostingListCodec& m_codec;
+    const AppendMode        m_append_mode;
+    const bool              m_document_rows;
+    const KeywordKeyType    m_key_type;
+
+    // Sequence numbers of the document rows: they are reserved by blocks,
+    // and the end of the last reserved block is persisted, so that a
+    // sequence number is never reused after a restart
+    std::mutex  m_sequence_mtx;
+    WT_SESSION* m_sequence_session{nullptr};
+    WT_CURSOR*  m_sequence_cursor{nullptr};
+    uint64_t    m_next_sequence{0};
+    uint64_t    m_sequence_limit{0};
 };
 
 } // namespace insecure
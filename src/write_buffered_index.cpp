@@ -0,0 +1,298 @@
+#include "write_buffered_index.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace sse {
+namespace insecure {
+
+namespace {
+// Estimated memory overhead of a buffered keyword, besides the keyword itself
+// and its documents
+constexpr size_t kKeywordOverhead = 64;
+
+// Maximum delay before a failed flush is retried
+constexpr auto kFlushRetryDelay = std::chrono::seconds(1);
+} // namespace
+
+WriteBufferedIndex::WriteBufferedIndex(std::unique_ptr<Index> backend)
+    : WriteBufferedIndex(std::move(backend), Options())
+{
+}
+
+WriteBufferedIndex::WriteBufferedIndex(std::unique_ptr<Index> backend,
+                                       const Options&         options)
+    : m_backend(std::move(backend)), m_capacity(options.buffer_capacity_bytes),
+      m_flush_interval(options.flush_interval)
+{
+    // The inserts wait for the buffer to drop below twice the capacity
+    if (m_capacity == 0) {
+        throw std::invalid_argument("buffer_capacity_bytes must be positive");
+    }
+
+    m_flusher = std::thread(&WriteBufferedIndex::flusher_loop, this);
+}
+
+WriteBufferedIndex::~WriteBufferedIndex()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_buffer_mtx);
+        m_stop = true;
+    }
+    m_flusher_cv.notify_all();
+    m_flusher.join();
+
+    try {
+        flush();
+    } catch (const std::exception& e) {
+        std::cerr << "Unable to flush the buffered inserts: " << e.what()
+                  << "\n";
+    }
+}
+
+std::vector<Index::document_type> WriteBufferedIndex::search(
+    const Index::keyword_type& keyword) const
+{
+    std::shared_lock<std::shared_timed_mutex> backend_lock(m_backend_mtx);
+
+    std::vector<Index::document_type> result = m_backend->search(keyword);
+
+    std::lock_guard<std::mutex> lock(m_buffer_mtx);
+    append_buffered(keyword, &result);
+
+    return result;
+}
+
+void WriteBufferedIndex::search(
+    const Index::keyword_type&          keyword,
+    const Index::document_visitor_type& visitor) const
+{
+    std::vector<Index::document_type> buffered;
+    {
+        std::shared_lock<std::shared_timed_mutex> backend_lock(m_backend_mtx);
+
+        m_backend->search(keyword, visitor);
+
+        std::lock_guard<std::mutex> lock(m_buffer_mtx);
+        append_buffered(keyword, &buffered);
+    }
+
+    // the buffered tail is visited without holding any lock
+    if (!buffered.empty()) {
+        visitor(buffered.data(), buffered.size());
+    }
+}
+
+void WriteBufferedIndex::for_each_keyword(
+    const Index::keyword_visitor_type& visitor) const
+{
+    std::vector<Index::keyword_type> keywords;
+    {
+        std::shared_lock<std::shared_timed_mutex> backend_lock(m_backend_mtx);
+
+        // The buffered keywords can also be in the backend
+        std::unordered_set<Index::keyword_type> unique_keywords;
+        m_backend->for_each_keyword(
+            [&unique_keywords](const Index::keyword_type& keyword) {
+                unique_keywords.insert(keyword);
+            });
+
+        std::lock_guard<std::mutex> lock(m_buffer_mtx);
+        for (const buffer_type* buffer : {&m_flushing, &m_active}) {
+            for (const auto& kw_list : *buffer) {
+                unique_keywords.insert(kw_list.first);
+            }
+        }
+        keywords.assign(unique_keywords.begin(), unique_keywords.end());
+    }
+
+    for (const auto& keyword : keywords) {
+        visitor(keyword);
+    }
+}
+
+Index::MultiSearchResult WriteBufferedIndex::search_many(
+    const std::vector<Index::keyword_type>& keywords) const
+{
+    std::shared_lock<std::shared_timed_mutex> backend_lock(m_backend_mtx);
+
+    Index::MultiSearchResult backend_result = m_backend->search_many(keywords);
+
+    std::vector<std::vector<Index::document_type>> tails(keywords.size());
+    size_t                                         tails_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_buffer_mtx);
+        for (size_t i = 0; i < keywords.size(); i++) {
+            append_buffered(keywords[i], &tails[i]);
+            tails_size += tails[i].size();
+        }
+    }
+    backend_lock.unlock();
+
+    if (tails_size == 0) {
+        return backend_result;
+    }
+
+    Index::MultiSearchResult result(keywords.size());
+    result.reserve(backend_result.total_size() + tails_size);
+
+    for (size_t i = 0; i < keywords.size(); i++) {
+        std::vector<Index::document_type> list = backend_result.list_vector(i);
+        list.insert(list.end(), tails[i].begin(), tails[i].end());
+
+        result.set_list(i, list.data(), list.size());
+    }
+    return result;
+}
+
+void WriteBufferedIndex::insert(const Index::keyword_type& keyword,
+                                Index::document_type       document)
+{
+    std::unique_lock<std::mutex> lock(m_buffer_mtx);
+
+    buffer_document(keyword, document);
+    wait_for_space(lock);
+}
+
+void WriteBufferedIndex::insert_batch(
+    const std::vector<Index::entry_type>& entries)
+{
+    std::unique_lock<std::mutex> lock(m_buffer_mtx);
+
+    for (const auto& entry : entries) {
+        buffer_document(entry.first, entry.second);
+    }
+    wait_for_space(lock);
+}
+
+void WriteBufferedIndex::flush()
+{
+    std::lock_guard<std::mutex> flush_lock(m_flush_mtx);
+
+    {
+        std::lock_guard<std::mutex> lock(m_buffer_mtx);
+        if (m_active.empty()) {
+            return;
+        }
+        m_flushing.swap(m_active);
+        m_active_bytes = 0;
+    }
+    m_space_cv.notify_all();
+
+    // Documents of a same keyword are kept in insertion order
+    std::vector<Index::entry_type> entries;
+    for (const auto& list : m_flushing) {
+        for (Index::document_type document : list.second) {
+            entries.emplace_back(list.first, document);
+        }
+    }
+
+    std::unique_lock<std::shared_timed_mutex> backend_lock(m_backend_mtx);
+    try {
+        m_backend->insert_batch(entries);
+    } catch (...) {
+        // put the documents back in front of the ones inserted meanwhile
+        std::lock_guard<std::mutex> lock(m_buffer_mtx);
+        for (auto& list : m_flushing) {
+            std::vector<Index::document_type>& active = m_active[list.first];
+            active.insert(
+                active.begin(), list.second.begin(), list.second.end());
+
+            m_active_bytes
+                += kKeywordOverhead + list.first.size()
+                   + list.second.size() * sizeof(Index::document_type);
+        }
+        m_flushing.clear();
+        // the inserts waiting for space wait for the next flush
+        m_space_cv.notify_all();
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock(m_buffer_mtx);
+    m_flushing.clear();
+}
+
+size_t WriteBufferedIndex::buffered_bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_buffer_mtx);
+    return m_active_bytes;
+}
+
+void WriteBufferedIndex::append_buffered(
+    const Index::keyword_type&         keyword,
+    std::vector<Index::document_type>* list) const
+{
+    // The documents being flushed were inserted before the active ones
+    for (const buffer_type* buffer : {&m_flushing, &m_active}) {
+        auto it = buffer->find(keyword);
+        if (it != buffer->end()) {
+            list->insert(list->end(), it->second.begin(), it->second.end());
+        }
+    }
+}
+
+void WriteBufferedIndex::buffer_document(const Index::keyword_type& keyword,
+                                         Index::document_type       document)
+{
+    auto it = m_active.find(keyword);
+    if (it == m_active.end()) {
+        it = m_active.emplace(keyword, std::vector<Index::document_type>())
+                 .first;
+        m_active_bytes += kKeywordOverhead + keyword.size();
+    }
+    it->second.push_back(document);
+    m_active_bytes += sizeof(Index::document_type);
+}
+
+void WriteBufferedIndex::wait_for_space(std::unique_lock<std::mutex>& lock)
+{
+    if (m_active_bytes >= m_capacity) {
+        m_flusher_cv.notify_one();
+    }
+
+    // Back pressure: the flusher is late
+    m_space_cv.wait(lock, [this]() {
+        return m_active_bytes < 2 * m_capacity || m_stop;
+    });
+}
+
+void WriteBufferedIndex::flusher_loop()
+{
+    std::unique_lock<std::mutex> lock(m_buffer_mtx);
+
+    while (!m_stop) {
+        m_flusher_cv.wait_for(lock, m_flush_interval, [this]() {
+            return m_stop || m_active_bytes >= m_capacity;
+        });
+
+        if (m_stop) {
+            break;
+        }
+
+        lock.unlock();
+        bool failed = false;
+        try {
+            flush();
+        } catch (const std::exception& e) {
+            std::cerr << "Unable to flush the buffered inserts: " << e.what()
+                      << "\n";
+            failed = true;
+        }
+        lock.lock();
+
+        // The buffer is still full after a failure: wait before retrying
+        if (failed) {
+            m_flusher_cv.wait_for(
+                lock,
+                std::min<std::chrono::milliseconds>(m_flush_interval,
+                                                    kFlushRetryDelay),
+                [this]() { return m_stop; });
+        }
+    }
+}
+
+} // namespace insecure
+} // namespace sse
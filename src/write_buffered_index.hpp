@@ -0,0 +1,116 @@
+#pragma once
+
+#include "index.hpp"
+
+#include <condition_variable>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sse {
+namespace insecure {
+
+// Decorator coalescing the inserts of a backend.
+//
+// The inserts are accumulated per keyword in memory, and written to the
+// backend with a single insert_batch call by a background flusher, once the
+// buffer exceeds its memory budget or after a time interval. Searches merge
+// the buffered documents with the lists of the backend, so that the buffer is
+// invisible to the readers, except for durability: the buffered documents are
+// lost if the process dies before they are flushed. Call flush() at the
+// durability points.
+class WriteBufferedIndex : public Index
+{
+public:
+    struct Options
+    {
+        // Memory used by the buffered inserts that triggers a flush. The
+        // inserts block when twice this amount is buffered. Must be positive.
+        size_t buffer_capacity_bytes{16 * 1024 * 1024};
+        // Maximum time an insert stays in the buffer
+        std::chrono::milliseconds flush_interval{1000};
+    };
+
+    explicit WriteBufferedIndex(std::unique_ptr<Index> backend);
+    WriteBufferedIndex(std::unique_ptr<Index> backend, const Options& options);
+    // Flushes the buffer
+    ~WriteBufferedIndex() override;
+
+    using Index::search;
+
+    std::vector<Index::document_type> search(
+        const Index::keyword_type& keyword) const override;
+    void search(const Index::keyword_type&          keyword,
+                const Index::document_visitor_type& visitor) const override;
+    Index::MultiSearchResult search_many(
+        const std::vector<Index::keyword_type>& keywords) const override;
+    void insert(const Index::keyword_type& keyword,
+                Index::document_type       document) override;
+    void insert_batch(const std::vector<Index::entry_type>& entries) override;
+    // The keywords of the backend and of the buffer are collected before
+    // being visited: the visitor can access the index
+    void for_each_keyword(
+        const Index::keyword_visitor_type& visitor) const override;
+
+    // Write all the buffered inserts to the backend, and return once they are
+    // written. Throws if the backend throws, in which case the inserts remain
+    // buffered.
+    void flush();
+
+    // Memory used by the buffered inserts
+    size_t buffered_bytes() const;
+
+private:
+    using buffer_type
+        = std::unordered_map<Index::keyword_type,
+                             std::vector<Index::document_type>>;
+
+    // Append the buffered documents of keyword to list. Must be called with
+    // m_buffer_mtx locked.
+    void append_buffered(const Index::keyword_type&         keyword,
+                         std::vector<Index::document_type>* list) const;
+
+    // Add a document to the active buffer. Must be called with m_buffer_mtx
+    // locked.
+    void buffer_document(const Index::keyword_type& keyword,
+                         Index::document_type       document);
+
+    // Wake up the flusher if the buffer is full, and wait for it if the
+    // buffer is more than full. lock must hold m_buffer_mtx.
+    void wait_for_space(std::unique_lock<std::mutex>& lock);
+
+    void flusher_loop();
+
+    std::unique_ptr<Index>          m_backend;
+    const size_t                    m_capacity;
+    const std::chrono::milliseconds m_flush_interval;
+
+    // Locked exclusively while a flush moves documents from m_flushing to
+    // the backend, and shared by the searches: a search never sees the
+    // documents being flushed twice (or not at all).
+    mutable std::shared_timed_mutex m_backend_mtx;
+
+    // Serializes the flushes
+    std::mutex m_flush_mtx;
+
+    mutable std::mutex      m_buffer_mtx;
+    std::condition_variable m_flusher_cv;
+    std::condition_variable m_space_cv;
+
+    // Inserts received since the last flush
+    buffer_type m_active;
+    size_t      m_active_bytes{0};
+    // Inserts being written to the backend
+    buffer_type m_flushing;
+
+    bool        m_stop{false};
+    std::thread m_flusher;
+};
+
+} // namespace insecure
+} // namespace sse
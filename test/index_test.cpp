@@ -1,16 +1,36 @@
 
 
+#include "cached_index.hpp"
+#include "concurrent_hash_multimap.hpp"
+#include "external_sorter.hpp"
+#include "frozen_index.hpp"
+#include "hash_multimap.hpp"
 #include "index.hpp"
+#include "index_builder.hpp"
+#include "mapped_multimap.hpp"
 
 #include "rocksdb_merge_multimap.hpp"
 #include "rocksdb_multimap.hpp"
+#include "segmented_index.hpp"
+#include "sharded_index.hpp"
 #include "std_multimap.hpp"
 #include "utility.hpp"
 #include "utils.hpp"
 #include "wiredtiger_multimap.hpp"
+#include "write_buffered_index.hpp"
+
+#include <cstdio>
+#include <cstring>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
 #include <memory>
+#include <numeric>
+#include <set>
+#include <thread>
 #include <utility>
 
 #include <gtest/gtest.h>
@@ -24,16 +44,71 @@ sse::insecure::Index* create_std_multimap(const std::string& path)
     return new sse::insecure::StdMultiMap();
 }
 
+sse::insecure::Index* create_hash_multimap(const std::string& path)
+{
+    (void)path;
+    return new sse::insecure::HashMultiMap();
+}
+
+sse::insecure::Index* create_concurrent_hash_multimap(const std::string& path)
+{
+    (void)path;
+    // few stripes, so that the stripes contain several keywords
+    sse::insecure::ConcurrentHashMultiMap::Options options;
+    options.stripe_count = 2;
+    return new sse::insecure::ConcurrentHashMultiMap(options);
+}
+
 sse::insecure::Index* create_rocksdb_multimap(const std::string& path)
 {
     return new sse::insecure::RocksDBMultiMap(path);
 }
 
+sse::insecure::Index* create_rocksdb_chunked_multimap(const std::string& path)
+{
+    // small chunks, so that the tests span several chunks
+    sse::insecure::RocksDBMultiMap::Options options;
+    options.chunk_capacity = 3;
+    return new sse::insecure::RocksDBMultiMap(path, options);
+}
+
+sse::insecure::Index* create_rocksdb_compressed_multimap(
+    const std::string& path)
+{
+    sse::insecure::RocksDBMultiMap::Options options;
+    options.codec = sse::insecure::PostingListCodecType::BitPacked;
+    return new sse::insecure::RocksDBMultiMap(path, options);
+}
+
+sse::insecure::Index* create_rocksdb_hashed_multimap(const std::string& path)
+{
+    sse::insecure::RocksDBMultiMap::Options options;
+    options.key_type    = sse::insecure::KeywordKeyType::Hash64;
+    options.plain_table = true;
+    return new sse::insecure::RocksDBMultiMap(path, options);
+}
+
 sse::insecure::Index* create_rocksdb_merge_multimap(const std::string& path)
 {
     return new sse::insecure::RocksDBMergeMultiMap(path);
 }
 
+sse::insecure::Index* create_rocksdb_merge_compressed_multimap(
+    const std::string& path)
+{
+    sse::insecure::RocksDBMergeMultiMap::Options options;
+    options.codec = sse::insecure::PostingListCodecType::DeltaVarint;
+    return new sse::insecure::RocksDBMergeMultiMap(path, options);
+}
+
+sse::insecure::Index* create_rocksdb_materialized_multimap(
+    const std::string& path)
+{
+    sse::insecure::RocksDBMergeMultiMap::Options options;
+    options.materialization_threshold = 2;
+    return new sse::insecure::RocksDBMergeMultiMap(path, options);
+}
+
 sse::insecure::Index* create_wiredtiger_multimap(const std::string& path)
 {
     // create the directory
@@ -41,6 +116,108 @@ sse::insecure::Index* create_wiredtiger_multimap(const std::string& path)
     return new sse::insecure::WiredTigerMultimap(path);
 }
 
+sse::insecure::Index* create_wiredtiger_chunked_multimap(
+    const std::string& path)
+{
+    utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.chunk_capacity = 3;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+sse::insecure::Index* create_wiredtiger_rows_multimap(const std::string& path)
+{
+    utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.document_rows = true;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+sse::insecure::Index* create_wiredtiger_hashed_multimap(const std::string& path)
+{
+    utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.chunk_capacity = 3;
+    options.key_type       = sse::insecure::KeywordKeyType::Hash128;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+sse::insecure::Index* create_wiredtiger_rewrite_multimap(
+    const std::string& path)
+{
+    utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.append_mode
+        = sse::insecure::WiredTigerMultimap::AppendMode::Rewrite;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+sse::insecure::Index* create_wiredtiger_compressed_multimap(
+    const std::string& path)
+{
+    utility::create_directory(path, static_cast<mode_t>(0700));
+
+    sse::insecure::WiredTigerMultimap::Options options;
+    options.codec = sse::insecure::PostingListCodecType::BitPacked;
+    return new sse::insecure::WiredTigerMultimap(path, options);
+}
+
+sse::insecure::Index* create_cached_rocksdb_multimap(const std::string& path)
+{
+    // small cache, so that the tests also go through evictions
+    sse::insecure::CachedIndex::Options options;
+    options.capacity_bytes = 16 * 1024;
+    options.shard_count    = 4;
+    return new sse::insecure::CachedIndex(
+        std::unique_ptr<sse::insecure::Index>(
+            new sse::insecure::RocksDBMultiMap(path)),
+        options);
+}
+
+sse::insecure::Index* create_buffered_rocksdb_multimap(const std::string& path)
+{
+    // small buffer, so that the tests also go through background flushes
+    sse::insecure::WriteBufferedIndex::Options options;
+    options.buffer_capacity_bytes = 256;
+    options.flush_interval        = std::chrono::milliseconds(10);
+    return new sse::insecure::WriteBufferedIndex(
+        std::unique_ptr<sse::insecure::Index>(
+            new sse::insecure::RocksDBMultiMap(path)),
+        options);
+}
+
+sse::insecure::Index* create_sharded_rocksdb_multimap(const std::string& path)
+{
+    sse::insecure::ShardedIndex::Options options;
+    options.shard_count = 3;
+    return new sse::insecure::ShardedIndex(
+        path, &create_rocksdb_multimap, options);
+}
+
+sse::insecure::Index* create_sharded_wiredtiger_multimap(
+    const std::string& path)
+{
+    sse::insecure::ShardedIndex::Options options;
+    options.shard_count = 3;
+    return new sse::insecure::ShardedIndex(
+        path, &create_wiredtiger_multimap, options);
+}
+
+sse::insecure::Index* create_segmented_index(const std::string& path)
+{
+    // tiny segments, so that the tests go through flushes and merges
+    sse::insecure::SegmentedIndex::Options options;
+    options.segment_documents = 4;
+    options.merge_factor      = 2;
+    options.stripe_count      = 2;
+    options.codec = sse::insecure::PostingListCodecType::DeltaVarint;
+    return new sse::insecure::SegmentedIndex(path, options);
+}
+
 class IndexTest
     : public ::testing::TestWithParam<std::pair<CreateIndexFunc*, std::string>>
 {
@@ -70,6 +247,1302 @@ TEST_P(IndexTest, basic_insertion)
     sse::test::test_search_correctness(index_.get(), test_db);
 }
 
+TEST_P(IndexTest, batch_insertion)
+{
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1, 2, 3}}, {"kw_2", {0, 4}}, {"kw_3", {5}}};
+
+    // one document is inserted before the batch, to check that the batch
+    // appends to the existing lists
+    index_->insert("kw_1", 0);
+
+    std::vector<sse::insecure::Index::entry_type> batch;
+    sse::test::iterate_database(
+        test_db, [&batch](const std::string& kw, uint64_t doc) {
+            if (kw != "kw_1" || doc != 0) {
+                batch.emplace_back(kw, doc);
+            }
+        });
+    // interleave the keywords
+    std::reverse(batch.begin(), batch.end());
+
+    index_->insert_batch(batch);
+
+    sse::test::test_search_correctness(index_.get(), test_db);
+}
+
+TEST_P(IndexTest, put_list)
+{
+    std::vector<uint64_t> list(1000);
+    std::iota(list.begin(), list.end(), 0);
+
+    // the list is appended to the existing documents
+    index_->insert("kw_1", 1000);
+    index_->insert("kw_2", 0);
+    index_->put_list("kw_1", list.data(), list.size());
+    index_->put_list("kw_3", list.data(), 1);
+
+    list.insert(list.begin(), 1000);
+    EXPECT_EQ(index_->search("kw_1"), list);
+    EXPECT_EQ(index_->search("kw_2"), std::vector<uint64_t>({0}));
+    EXPECT_EQ(index_->search("kw_3"), std::vector<uint64_t>({0}));
+
+    // an empty list does not create a list that cannot be read back
+    index_->put_list("kw_4", list.data(), 0);
+    EXPECT_EQ(index_->search("kw_4"), std::vector<uint64_t>());
+    index_->insert("kw_4", 1);
+    EXPECT_EQ(index_->search("kw_4"), std::vector<uint64_t>({1}));
+}
+
+TEST_P(IndexTest, for_each_keyword)
+{
+    std::multiset<std::string> expected;
+    for (size_t k = 0; k < 50; k++) {
+        const std::string keyword = "kw_" + std::to_string(k);
+        for (uint64_t d = 0; d <= k % 3; d++) {
+            index_->insert(keyword, d);
+        }
+        expected.insert(keyword);
+    }
+
+    // every keyword is visited once, whatever the size of its list
+    std::multiset<std::string> keywords;
+    try {
+        index_->for_each_keyword([&keywords](const std::string& keyword) {
+            keywords.insert(keyword);
+        });
+    } catch (const std::logic_error&) {
+        // the hashed keywords cannot be enumerated
+        EXPECT_NE(GetParam().second.find("Hashed"), std::string::npos);
+        return;
+    }
+    EXPECT_EQ(keywords, expected);
+}
+
+TEST_P(IndexTest, insertion_order)
+{
+    std::vector<uint64_t> expected;
+    for (uint64_t i = 0; i < 100; i++) {
+        index_->insert("kw", i);
+        expected.push_back(i);
+    }
+
+    EXPECT_EQ(index_->search("kw"), expected);
+}
+
+TEST_P(IndexTest, search_many)
+{
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1}}, {"kw_2", {0}}, {"kw_3", {2, 3, 4}}};
+
+    sse::test::insert_database(index_.get(), test_db);
+
+    // unsorted, with a duplicate and a missing keyword
+    const std::vector<std::string> keywords
+        = {"kw_3", "kw_1", "missing", "kw_3", "kw_2"};
+
+    const auto result = index_->search_many(keywords);
+
+    ASSERT_EQ(result.size(), keywords.size());
+    for (size_t i = 0; i < keywords.size(); i++) {
+        const auto list = result.list_vector(i);
+        const std::set<uint64_t> res_set(list.begin(), list.end());
+
+        std::set<uint64_t> expected_set;
+        auto               it = test_db.find(keywords[i]);
+        if (it != test_db.end()) {
+            expected_set.insert(it->second.begin(), it->second.end());
+        }
+
+        EXPECT_EQ(res_set, expected_set);
+    }
+    EXPECT_EQ(result.total_size(), 9u);
+}
+
+TEST_P(IndexTest, visitor_search)
+{
+    std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1}}, {"kw_2", {0}}};
+
+    // a list long enough to be visited in several chunks
+    for (uint64_t i = 0; i < 2000; i++) {
+        test_db["kw_3"].push_back(i);
+    }
+
+    sse::test::insert_database(index_.get(), test_db);
+
+    for (const auto& it : test_db) {
+        std::set<uint64_t> res_set;
+        size_t             count = 0;
+
+        index_->search(it.first,
+                       [&res_set, &count](const uint64_t* docs, size_t n) {
+                           res_set.insert(docs, docs + n);
+                           count += n;
+                       });
+
+        const std::set<uint64_t> expected_set(it.second.begin(),
+                                              it.second.end());
+        EXPECT_EQ(res_set, expected_set);
+        EXPECT_EQ(count, it.second.size());
+    }
+
+    bool called = false;
+    index_->search("missing",
+                   [&called](const uint64_t*, size_t) { called = true; });
+    EXPECT_FALSE(called);
+}
+
+TEST(Index, visit_unaligned_document_list)
+{
+    constexpr size_t n = 1500;
+
+    std::vector<uint64_t> list(n);
+    std::iota(list.begin(), list.end(), 0);
+
+    // copy the list at an odd offset
+    std::string data(1 + n * sizeof(uint64_t), 0);
+    memcpy(&data[1], list.data(), n * sizeof(uint64_t));
+
+    std::vector<uint64_t> visited;
+    bool                  valid = sse::insecure::Index::visit_document_list(
+        data.data() + 1,
+        n * sizeof(uint64_t),
+        [&visited](const uint64_t* docs, size_t count) {
+            visited.insert(visited.end(), docs, docs + count);
+        });
+
+    EXPECT_TRUE(valid);
+    EXPECT_EQ(visited, list);
+
+    // truncated data
+    visited.clear();
+    valid = sse::insecure::Index::visit_document_list(
+        data.data() + 1,
+        n * sizeof(uint64_t) - 1,
+        [&visited](const uint64_t* docs, size_t count) {
+            visited.insert(visited.end(), docs, docs + count);
+        });
+    EXPECT_FALSE(valid);
+    EXPECT_EQ(visited.size(), n - 1);
+}
+
+TEST(HashMultiMap, growth_and_memory_usage)
+{
+    sse::insecure::HashMultiMap index;
+    EXPECT_EQ(index.memory_usage(), 0u);
+
+    // enough keywords to rehash the table several times, and long enough
+    // lists to move them from the inline storage to the heap
+    const size_t n_keywords = 5000;
+    for (uint64_t d = 0; d < 4; d++) {
+        for (size_t k = 0; k < n_keywords; k++) {
+            index.insert("keyword_" + std::to_string(k), d * n_keywords + k);
+        }
+        if (d == 1) {
+            // the lists are still inline
+            EXPECT_LT(index.memory_usage(), 2 * n_keywords * 64);
+        }
+    }
+    EXPECT_EQ(index.keyword_count(), n_keywords);
+
+    // the postings themselves take 32 bytes per keyword
+    EXPECT_GE(index.memory_usage(), n_keywords * 32);
+
+    for (size_t k = 0; k < n_keywords; k++) {
+        const std::vector<uint64_t> expected
+            = {k, n_keywords + k, 2 * n_keywords + k, 3 * n_keywords + k};
+        ASSERT_EQ(index.search("keyword_" + std::to_string(k)), expected);
+    }
+
+    // a visitor search does not split the lists
+    size_t n_calls = 0;
+    index.search("keyword_0",
+                 [&n_calls](const uint64_t*, size_t n) {
+                     EXPECT_EQ(n, 4u);
+                     n_calls++;
+                 });
+    EXPECT_EQ(n_calls, 1u);
+
+    // the multimap allocates a tree node per pair
+    sse::insecure::StdMultiMap std_index;
+    for (size_t k = 0; k < n_keywords; k++) {
+        const std::string     keyword = "keyword_" + std::to_string(k);
+        std::vector<uint64_t> list    = index.search(keyword);
+        std_index.put_list(keyword, list.data(), list.size());
+    }
+    EXPECT_GT(std_index.memory_usage(), index.memory_usage());
+
+    // reserving does not lose the existing lists
+    index.reserve(4 * n_keywords);
+    EXPECT_EQ(index.search("keyword_1").size(), 4u);
+    EXPECT_TRUE(index.search("keyword_").empty());
+}
+
+TEST(MappedMultiMap, snapshot)
+{
+    const std::string path       = "mapped_multimap_test.snapshot";
+    const size_t      n_keywords = 1000;
+
+    // the keywords are interned in an order that is not the one of their
+    // values
+    sse::insecure::StdMultiMap                   index;
+    std::map<std::string, std::vector<uint64_t>> expected;
+    for (size_t k = n_keywords; k > 0; k--) {
+        const std::string keyword = "kw_" + std::to_string(k);
+        for (uint64_t d = 0; d < k % 7; d++) {
+            index.insert(keyword, k * 100 + d);
+            expected[keyword].push_back(k * 100 + d);
+        }
+    }
+    index.insert("", 42);
+    expected[""].push_back(42);
+
+    index.save(path);
+    {
+        sse::insecure::MappedMultiMap snapshot(path);
+        EXPECT_EQ(snapshot.keyword_count(), expected.size());
+
+        for (const auto& kw_list : expected) {
+            ASSERT_EQ(snapshot.search(kw_list.first), kw_list.second);
+        }
+        EXPECT_TRUE(snapshot.search("kw_0").empty());
+        EXPECT_TRUE(snapshot.search("kw_1000_").empty());
+
+        // the lists are visited in place
+        size_t n_calls = 0;
+        snapshot.search("kw_6", [&n_calls](const uint64_t* docs, size_t n) {
+            EXPECT_EQ(n, 6u);
+            EXPECT_EQ(docs[5], 605u);
+            n_calls++;
+        });
+        EXPECT_EQ(n_calls, 1u);
+
+        auto result = snapshot.search_many({"kw_13", "missing", "kw_7", ""});
+        EXPECT_EQ(result.list_vector(0), expected["kw_13"]);
+        EXPECT_EQ(result.list_size(1), 0u);
+        EXPECT_EQ(result.list_size(2), 0u);
+        EXPECT_EQ(result.list_vector(3), std::vector<uint64_t>({42}));
+
+        EXPECT_THROW(snapshot.insert("kw_1", 1), std::logic_error);
+
+        // an existing snapshot is replaced, and the mapping of the old one
+        // stays valid
+        sse::insecure::StdMultiMap other;
+        other.insert("kw_1", 1);
+        other.save(path);
+        EXPECT_EQ(snapshot.search("kw_1"), expected["kw_1"]);
+    }
+    {
+        sse::insecure::MappedMultiMap snapshot(path);
+        EXPECT_EQ(snapshot.keyword_count(), 1u);
+        EXPECT_EQ(snapshot.search("kw_1"), std::vector<uint64_t>({1}));
+    }
+
+    // the keywords must be added in increasing order
+    {
+        sse::insecure::MappedMultiMap::Writer writer(path);
+        const uint64_t                        doc = 1;
+        writer.add("b", &doc, 1);
+        EXPECT_THROW(writer.add("a", &doc, 1), std::invalid_argument);
+        EXPECT_THROW(writer.add("b", &doc, 1), std::invalid_argument);
+    }
+    // an unfinished writer leaves the previous snapshot intact
+    EXPECT_EQ(sse::insecure::MappedMultiMap(path).keyword_count(), 1u);
+
+    // the codec of the lists is stored in the snapshot
+    {
+        std::vector<uint64_t> list(300);
+        std::iota(list.begin(), list.end(), 1000);
+
+        sse::insecure::MappedMultiMap::Writer writer(
+            path, sse::insecure::PostingListCodecType::BitPacked);
+        writer.add("a", list.data(), list.size());
+        writer.add("b", list.data(), 1);
+        writer.finish();
+
+        sse::insecure::MappedMultiMap snapshot(path);
+        EXPECT_EQ(snapshot.codec(),
+                  sse::insecure::PostingListCodecType::BitPacked);
+        EXPECT_EQ(snapshot.document_count(), list.size() + 1);
+        EXPECT_EQ(snapshot.search("a"), list);
+        EXPECT_EQ(snapshot.keyword(1), "b");
+
+        std::vector<uint64_t> read;
+        snapshot.read_list(1, &read);
+        EXPECT_EQ(read, std::vector<uint64_t>({1000}));
+    }
+
+    // truncated files are rejected
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << "SSESNAP1";
+    }
+    EXPECT_THROW(sse::insecure::MappedMultiMap snapshot(path),
+                 std::runtime_error);
+    EXPECT_THROW(sse::insecure::MappedMultiMap snapshot("missing.snapshot"),
+                 std::runtime_error);
+
+    std::remove(path.c_str());
+}
+
+// Index without for_each_keyword
+class SearchOnlyIndex : public sse::insecure::Index
+{
+public:
+    using Index::search;
+
+    std::vector<document_type> search(const keyword_type&) const override
+    {
+        return {};
+    }
+    void insert(const keyword_type&, document_type) override
+    {
+    }
+};
+
+TEST(FrozenIndex, build_and_search)
+{
+    const std::string db_path     = "frozen_index_test_db";
+    const std::string frozen_path = "frozen_index_test.frozen";
+    const size_t      n_keywords  = 3000;
+
+    // built from a persistent backend, with lists of various sizes
+    std::map<std::string, std::vector<uint64_t>> expected;
+    {
+        std::unique_ptr<sse::insecure::Index> source(
+            create_rocksdb_chunked_multimap(db_path));
+        for (size_t k = 0; k < n_keywords; k++) {
+            const std::string keyword = "kw_" + std::to_string(k);
+            for (uint64_t d = 0; d < (k * 7) % 13; d++) {
+                expected[keyword].push_back(k * 100 + d);
+            }
+            expected[keyword].push_back(k);
+            source->put_list(
+                keyword, expected[keyword].data(), expected[keyword].size());
+        }
+
+        sse::insecure::FrozenIndex::BuildOptions options;
+        options.bucket_size = 5;
+        const auto stats
+            = sse::insecure::FrozenIndex::build(*source, frozen_path, options);
+        EXPECT_EQ(stats.keyword_count, n_keywords);
+        EXPECT_EQ(stats.bucket_count, n_keywords / 5);
+        EXPECT_GE(stats.seed_count, 1u);
+        EXPECT_EQ(stats.file_size % options.alignment, 0u);
+    }
+    utility::remove_directory(db_path);
+
+    for (bool direct_io : {false, true}) {
+        sse::insecure::FrozenIndex::Options options;
+        options.direct_io = direct_io;
+        sse::insecure::FrozenIndex index(frozen_path, options);
+        EXPECT_EQ(index.keyword_count(), n_keywords);
+
+        for (const auto& kw_list : expected) {
+            ASSERT_EQ(index.search(kw_list.first), kw_list.second);
+        }
+        // keywords that are mapped to a slot anyway
+        for (size_t k = n_keywords; k < 2 * n_keywords; k++) {
+            ASSERT_TRUE(index.search("kw_" + std::to_string(k)).empty());
+        }
+        EXPECT_TRUE(index.search("").empty());
+
+        size_t n_calls = 0;
+        index.search("kw_2", [&n_calls](const uint64_t* docs, size_t n) {
+            EXPECT_EQ(n, 2u);
+            EXPECT_EQ(docs[0], 200u);
+            n_calls++;
+        });
+        EXPECT_EQ(n_calls, 1u);
+
+        auto result = index.search_many({"kw_7", "missing", "kw_0"});
+        EXPECT_EQ(result.list_vector(0), expected["kw_7"]);
+        EXPECT_EQ(result.list_size(1), 0u);
+        EXPECT_EQ(result.list_vector(2), std::vector<uint64_t>({0}));
+
+        std::set<std::string> keywords;
+        index.for_each_keyword(
+            [&keywords](const std::string& kw) { keywords.insert(kw); });
+        EXPECT_EQ(keywords.size(), n_keywords);
+        EXPECT_EQ(*keywords.begin(), expected.begin()->first);
+
+        EXPECT_THROW(index.insert("kw_1", 1), std::logic_error);
+    }
+
+    // an empty index
+    {
+        sse::insecure::StdMultiMap empty;
+        sse::insecure::FrozenIndex::build(empty, frozen_path);
+
+        sse::insecure::FrozenIndex index(frozen_path);
+        EXPECT_EQ(index.keyword_count(), 0u);
+        EXPECT_TRUE(index.search("kw_1").empty());
+    }
+
+    // the backends that cannot enumerate their keywords are rejected
+    {
+        SearchOnlyIndex source;
+        EXPECT_THROW(sse::insecure::FrozenIndex::build(source, frozen_path),
+                     std::logic_error);
+    }
+
+    {
+        std::ofstream out(frozen_path, std::ios::binary | std::ios::trunc);
+        out << std::string(4096, 'x');
+    }
+    EXPECT_THROW(sse::insecure::FrozenIndex index(frozen_path),
+                 std::runtime_error);
+
+    std::remove(frozen_path.c_str());
+}
+
+TEST(ConcurrentHashMultiMap, concurrent_inserts_and_searches)
+{
+    const size_t n_writers = 4;
+    const size_t n_readers = 4;
+    const size_t n_docs    = 2000;
+
+    sse::insecure::ConcurrentHashMultiMap::Options options;
+    options.stripe_count = 4;
+    sse::insecure::ConcurrentHashMultiMap index(options);
+
+    std::atomic<size_t> n_done_writers{0};
+    std::atomic<bool>   prefix_error{false};
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_writers; t++) {
+        threads.emplace_back([&, t]() {
+            for (uint64_t d = 0; d < n_docs; d++) {
+                // every writer has its own keywords, and all of them append
+                // to the shared keyword
+                const std::string own = "own_" + std::to_string(t);
+
+                index.insert(own, d);
+                index.insert(own + "_" + std::to_string(d), d);
+                index.insert("shared", t * n_docs + d);
+            }
+            n_done_writers++;
+        });
+    }
+    for (size_t t = 0; t < n_readers; t++) {
+        threads.emplace_back([&, t]() {
+            const std::string keyword = "own_" + std::to_string(t % n_writers);
+
+            // the lists of a single writer are always read as a prefix of
+            // the final list
+            while (n_done_writers < n_writers) {
+                index.search(keyword, [&](const uint64_t* docs, size_t n) {
+                    for (size_t i = 0; i < n; i++) {
+                        if (docs[i] != i) {
+                            prefix_error = true;
+                        }
+                    }
+                });
+                index.search("shared");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_FALSE(prefix_error);
+
+    std::vector<uint64_t> expected(n_docs);
+    std::iota(expected.begin(), expected.end(), 0);
+    for (size_t t = 0; t < n_writers; t++) {
+        EXPECT_EQ(index.search("own_" + std::to_string(t)), expected);
+    }
+
+    std::vector<uint64_t> shared = index.search("shared");
+    std::sort(shared.begin(), shared.end());
+    expected.resize(n_writers * n_docs);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(shared, expected);
+
+    EXPECT_EQ(index.keyword_count(), n_writers * (n_docs + 1) + 1);
+}
+
+TEST(SegmentedIndex, flushes_merges_and_reopening)
+{
+    const std::string path      = "segmented_index_test";
+    const size_t      n_writers = 2;
+    const size_t      n_docs    = 3000;
+
+    sse::insecure::SegmentedIndex::Options options;
+    options.segment_documents = 200;
+    options.merge_factor      = 3;
+
+    std::vector<uint64_t> expected(n_docs);
+    std::iota(expected.begin(), expected.end(), 0);
+
+    {
+        sse::insecure::SegmentedIndex index(path, options);
+
+        std::atomic<size_t> n_done_writers{0};
+        std::atomic<bool>   prefix_error{false};
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < n_writers; t++) {
+            threads.emplace_back([&, t]() {
+                const std::string own = "own_" + std::to_string(t);
+                for (uint64_t d = 0; d < n_docs; d++) {
+                    index.insert(own, d);
+                    index.insert("kw_" + std::to_string(d % 97), d);
+                }
+                n_done_writers++;
+            });
+        }
+        threads.emplace_back([&]() {
+            // the lists are read as a prefix of the final list, while the
+            // active segment is frozen, flushed and merged
+            while (n_done_writers < n_writers) {
+                uint64_t next = 0;
+                index.search("own_0", [&](const uint64_t* docs, size_t n) {
+                    for (size_t i = 0; i < n; i++) {
+                        if (docs[i] != next++) {
+                            prefix_error = true;
+                        }
+                    }
+                });
+            }
+        });
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        EXPECT_FALSE(prefix_error);
+
+        index.flush();
+        index.compact();
+        EXPECT_GE(index.segment_count(), 1u);
+        EXPECT_LT(index.segment_count(), 2 * n_writers * n_docs / 200);
+
+        for (size_t t = 0; t < n_writers; t++) {
+            EXPECT_EQ(index.search("own_" + std::to_string(t)), expected);
+        }
+        std::vector<uint64_t> kw_0 = index.search("kw_0");
+        EXPECT_EQ(kw_0.size(), n_writers * ((n_docs + 96) / 97));
+
+        auto result = index.search_many({"own_1", "missing", "kw_0"});
+        EXPECT_EQ(result.list_vector(0), expected);
+        EXPECT_EQ(result.list_size(1), 0u);
+        EXPECT_EQ(result.list_vector(2), kw_0);
+
+        size_t n_keywords = 0;
+        index.for_each_keyword(
+            [&n_keywords](const std::string&) { n_keywords++; });
+        EXPECT_EQ(n_keywords, n_writers + 97);
+
+        // documents left in the active segment, flushed by the destructor
+        index.insert("own_0", n_docs);
+    }
+    EXPECT_TRUE(utility::is_file(path + "/MANIFEST"));
+
+    // the codec of a segment is stored in the segment
+    options.codec = sse::insecure::PostingListCodecType::Raw;
+    {
+        sse::insecure::SegmentedIndex index(path, options);
+
+        expected.push_back(n_docs);
+        EXPECT_EQ(index.search("own_0"), expected);
+        expected.pop_back();
+        EXPECT_EQ(index.search("own_1"), expected);
+
+        index.insert("own_1", n_docs);
+        index.flush();
+    }
+    {
+        sse::insecure::SegmentedIndex index(path, options);
+
+        expected.push_back(n_docs);
+        EXPECT_EQ(index.search("own_1"), expected);
+    }
+
+    {
+        std::ofstream manifest(path + "/MANIFEST", std::ios::app);
+        manifest << "not_a_segment\n";
+    }
+    EXPECT_THROW(sse::insecure::SegmentedIndex index(path, options),
+                 std::runtime_error);
+
+    utility::remove_directory(path);
+}
+
+TEST(CachedIndex, hits_and_invalidation)
+{
+    sse::insecure::CachedIndex::Options options;
+    options.capacity_bytes = 4 * 1024;
+    options.shard_count    = 1;
+
+    sse::insecure::CachedIndex index(
+        std::unique_ptr<sse::insecure::Index>(new sse::insecure::StdMultiMap()),
+        options);
+
+    index.insert_batch({{"a", 1}, {"a", 2}, {"b", 3}});
+
+    EXPECT_EQ(index.search("a"), std::vector<uint64_t>({1, 2}));
+    EXPECT_EQ(index.hits(), 0u);
+    EXPECT_EQ(index.misses(), 1u);
+
+    EXPECT_EQ(index.search("a"), std::vector<uint64_t>({1, 2}));
+    EXPECT_EQ(index.hits(), 1u);
+
+    // an insert invalidates the cached list
+    index.insert("a", 4);
+    EXPECT_EQ(index.search("a"), std::vector<uint64_t>({1, 2, 4}));
+    EXPECT_EQ(index.misses(), 2u);
+
+    // a list larger than the cache is never cached
+    std::vector<sse::insecure::Index::entry_type> large;
+    for (uint64_t i = 0; i < 1024; i++) {
+        large.emplace_back("large", i);
+    }
+    index.insert_batch(large);
+    EXPECT_EQ(index.search("large").size(), 1024u);
+    EXPECT_EQ(index.search("large").size(), 1024u);
+    EXPECT_EQ(index.misses(), 4u);
+
+    // the cache never exceeds its capacity
+    for (uint64_t i = 0; i < 100; i++) {
+        index.insert("kw" + std::to_string(i), i);
+        index.search("kw" + std::to_string(i));
+    }
+    EXPECT_LE(index.memory_usage(), options.capacity_bytes);
+    EXPECT_GT(index.memory_usage(), 0u);
+}
+
+TEST(WriteBufferedIndex, buffered_inserts)
+{
+    // the flusher never wakes up by itself
+    sse::insecure::WriteBufferedIndex::Options options;
+    options.buffer_capacity_bytes = 1024 * 1024;
+    options.flush_interval        = std::chrono::hours(1);
+
+    auto* backend = new sse::insecure::StdMultiMap();
+    sse::insecure::WriteBufferedIndex index(
+        std::unique_ptr<sse::insecure::Index>(backend), options);
+
+    backend->insert("a", 1);
+    index.insert("a", 2);
+    index.insert_batch({{"a", 3}, {"b", 4}});
+
+    // the buffered inserts are visible, but not in the backend yet
+    EXPECT_GT(index.buffered_bytes(), 0u);
+    EXPECT_EQ(backend->search("a"), std::vector<uint64_t>({1}));
+    EXPECT_EQ(index.search("a"), std::vector<uint64_t>({1, 2, 3}));
+    EXPECT_EQ(index.search("b"), std::vector<uint64_t>({4}));
+
+    std::vector<uint64_t> visited;
+    index.search("a", [&visited](const uint64_t* docs, size_t n) {
+        visited.insert(visited.end(), docs, docs + n);
+    });
+    EXPECT_EQ(visited, std::vector<uint64_t>({1, 2, 3}));
+
+    sse::insecure::Index::MultiSearchResult many
+        = index.search_many({"b", "c", "a"});
+    EXPECT_EQ(many.list_vector(0), std::vector<uint64_t>({4}));
+    EXPECT_EQ(many.list_size(1), 0u);
+    EXPECT_EQ(many.list_vector(2), std::vector<uint64_t>({1, 2, 3}));
+
+    index.flush();
+
+    EXPECT_EQ(index.buffered_bytes(), 0u);
+    EXPECT_EQ(backend->search("a"), std::vector<uint64_t>({1, 2, 3}));
+    EXPECT_EQ(backend->search("b"), std::vector<uint64_t>({4}));
+    EXPECT_EQ(index.search("a"), std::vector<uint64_t>({1, 2, 3}));
+
+    // the inserts would wait forever for space in an empty buffer
+    options.buffer_capacity_bytes = 0;
+    EXPECT_THROW(sse::insecure::WriteBufferedIndex(
+                     std::unique_ptr<sse::insecure::Index>(
+                         new sse::insecure::StdMultiMap()),
+                     options),
+                 std::invalid_argument);
+}
+
+// Backend whose first batch insertion fails
+class FailingOnceIndex : public sse::insecure::StdMultiMap
+{
+public:
+    void insert_batch(const std::vector<entry_type>& entries) override
+    {
+        if (!m_failed.exchange(true)) {
+            throw std::runtime_error("FailingOnceIndex: failed batch");
+        }
+        sse::insecure::StdMultiMap::insert_batch(entries);
+    }
+
+private:
+    std::atomic<bool> m_failed{false};
+};
+
+TEST(WriteBufferedIndex, failed_flush)
+{
+    // the inserts fill the buffer several times, and wait for the flusher
+    sse::insecure::WriteBufferedIndex::Options options;
+    options.buffer_capacity_bytes = 4096;
+    options.flush_interval        = std::chrono::milliseconds(10);
+
+    auto* backend = new FailingOnceIndex();
+    sse::insecure::WriteBufferedIndex index(
+        std::unique_ptr<sse::insecure::Index>(backend), options);
+
+    // the first flush fails, and is retried after a delay: the inserts
+    // resume, and no document is lost
+    std::vector<uint64_t> expected;
+    for (uint64_t d = 0; d < 5000; d++) {
+        index.insert("kw_" + std::to_string(d % 10), d);
+        if (d % 10 == 3) {
+            expected.push_back(d);
+        }
+    }
+    EXPECT_EQ(index.search("kw_3"), expected);
+
+    index.flush();
+    EXPECT_EQ(backend->search("kw_3"), expected);
+}
+
+TEST(Utility, stable_hash)
+{
+    // the hashes are persisted by the frozen indexes and the hashed keys:
+    // they are the reference FNV-1a values
+    EXPECT_EQ(sse::utility::stable_hash(""), 0xcbf29ce484222325ULL);
+    EXPECT_EQ(sse::utility::stable_hash("a"), 0xaf63dc4c8601ec8cULL);
+    EXPECT_EQ(sse::utility::stable_hash("foobar"), 0x85944171f73967e8ULL);
+    EXPECT_EQ(sse::utility::stable_hash("foobar", 6, 0),
+              sse::utility::stable_hash("foobar"));
+    EXPECT_NE(sse::utility::stable_hash("foobar", 6, 1),
+              sse::utility::stable_hash("foobar"));
+
+    EXPECT_EQ(sse::utility::mix64(0), 0u);
+    EXPECT_NE(sse::utility::mix64(1), sse::utility::mix64(2));
+}
+
+TEST(ShardedIndex, routing_and_concurrent_inserts)
+{
+    const std::string path       = "sharded_index_test";
+    const size_t      n_keywords = 50;
+    const size_t      n_threads  = 4;
+    const size_t      n_docs     = 20;
+
+    sse::insecure::ShardedIndex::Options options;
+    options.shard_count = 4;
+
+    std::unique_ptr<sse::insecure::ShardedIndex> index(
+        new sse::insecure::ShardedIndex(
+            path, &create_rocksdb_multimap, options));
+
+    // every thread inserts its own documents for all the keywords, in
+    // batches spanning all the shards
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([&index, t]() {
+            for (uint64_t d = 0; d < n_docs; d++) {
+                std::vector<sse::insecure::Index::entry_type> batch;
+                for (size_t k = 0; k < n_keywords; k++) {
+                    batch.emplace_back(std::to_string(k), t * n_docs + d);
+                }
+                index->insert_batch(batch);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<std::string> keywords;
+    for (size_t k = 0; k < n_keywords; k++) {
+        keywords.push_back(std::to_string(k));
+    }
+
+    std::vector<uint64_t> expected(n_threads * n_docs);
+    std::iota(expected.begin(), expected.end(), 0);
+
+    sse::insecure::Index::MultiSearchResult many = index->search_many(keywords);
+    for (size_t k = 0; k < n_keywords; k++) {
+        std::vector<uint64_t> list = many.list_vector(k);
+        std::sort(list.begin(), list.end());
+        EXPECT_EQ(list, expected);
+    }
+
+    // the routing is persisted: it must not change
+    EXPECT_EQ(index->shard_index("0"), 2u);
+    EXPECT_EQ(index->shard_index("1"), 3u);
+    EXPECT_EQ(index->shard_index("3"), 1u);
+    EXPECT_EQ(index->shard_index("keyword"), 0u);
+
+    std::vector<size_t> keyword_shards;
+    for (const auto& keyword : keywords) {
+        keyword_shards.push_back(index->shard_index(keyword));
+    }
+    index.reset(nullptr);
+
+    // a shard only contains its own keywords
+    for (size_t s = 0; s < options.shard_count; s++) {
+        std::unique_ptr<sse::insecure::Index> shard(
+            create_rocksdb_multimap(path + "/shard_" + std::to_string(s)));
+        for (size_t k = 0; k < n_keywords; k++) {
+            EXPECT_EQ(shard->search(keywords[k]).empty(),
+                      keyword_shards[k] != s);
+        }
+    }
+
+    // the keywords are routed to the same shards when the index is reopened
+    index.reset(new sse::insecure::ShardedIndex(
+        path, &create_rocksdb_multimap, options));
+    for (const auto& keyword : keywords) {
+        EXPECT_EQ(index->search(keyword).size(), expected.size());
+    }
+    index.reset(nullptr);
+
+    utility::remove_directory(path);
+}
+
+TEST(RocksDBMergeMultiMap, read_triggered_materialization)
+{
+    const std::string path = "rocksdb_materialization_test";
+    const size_t      n    = 10;
+
+    std::unique_ptr<sse::insecure::RocksDBMergeMultiMap> index(
+        static_cast<sse::insecure::RocksDBMergeMultiMap*>(
+            create_rocksdb_materialized_multimap(path)));
+
+    std::vector<uint64_t> expected(n);
+    std::iota(expected.begin(), expected.end(), 0);
+    for (uint64_t doc : expected) {
+        index->insert("kw", doc);
+    }
+
+    // the first search folds all the operands and schedules the write back
+    sse::insecure::rocksdb_merge_counter_ = 0;
+    EXPECT_EQ(index->search("kw"), expected);
+    EXPECT_GE(sse::insecure::rocksdb_merge_counter_.load(), n);
+
+    index->wait_for_background_work();
+
+    // the list is now stored as a plain value
+    sse::insecure::rocksdb_merge_counter_ = 0;
+    EXPECT_EQ(index->search("kw"), expected);
+    EXPECT_EQ(sse::insecure::rocksdb_merge_counter_.load(), 0u);
+
+    // later inserts are still merged on top of the materialized list
+    index->insert("kw", n);
+    expected.push_back(n);
+    EXPECT_EQ(index->search("kw"), expected);
+
+    index.reset(nullptr);
+    utility::remove_directory(path);
+}
+
+TEST(RocksDBMergeMultiMap, hot_keyword_compaction)
+{
+    const std::string path = "rocksdb_hot_keyword_test";
+    const size_t      n    = 10;
+
+    sse::insecure::RocksDBMergeMultiMap::Options options;
+    options.hot_keyword_threshold = 5;
+    std::unique_ptr<sse::insecure::RocksDBMergeMultiMap> index(
+        new sse::insecure::RocksDBMergeMultiMap(path, options));
+
+    std::vector<uint64_t> expected(n);
+    std::iota(expected.begin(), expected.end(), 0);
+    for (uint64_t doc : expected) {
+        index->insert("hot", doc);
+    }
+    index->insert_batch({{"cold", 0}, {"cold", 1}});
+
+    // every fifth insert of the hot keyword triggers a compaction of its key
+    index->wait_for_background_work();
+
+    sse::insecure::rocksdb_merge_counter_ = 0;
+    EXPECT_EQ(index->search("hot"), expected);
+    EXPECT_EQ(sse::insecure::rocksdb_merge_counter_.load(), 0u);
+
+    EXPECT_EQ(index->search("cold"), std::vector<uint64_t>({0, 1}));
+
+    index.reset(nullptr);
+    utility::remove_directory(path);
+}
+
+// Source of the documents first_doc to end_doc - 1, with skewed keywords so
+// that the lists span several sorted runs. The pairs are also appended to
+// expected.
+sse::insecure::ExternalSorter::source_type bulk_load_source(
+    uint64_t                                      first_doc,
+    uint64_t                                      end_doc,
+    std::map<std::string, std::vector<uint64_t>>* expected)
+{
+    const size_t n_keywords = 20;
+
+    return [first_doc, end_doc, expected, n_keywords](
+               sse::insecure::Index::entry_type* entry) mutable {
+        if (first_doc == end_doc) {
+            return false;
+        }
+        entry->first  = std::to_string((first_doc * first_doc) % n_keywords);
+        entry->second = first_doc++;
+        (*expected)[entry->first].push_back(entry->second);
+        return true;
+    };
+}
+
+// Bulk load pairs spread over several runs and SST files in index, and check
+// the resulting lists
+template<class BulkIndex>
+void check_bulk_load(BulkIndex* index, const std::string& path)
+{
+    const size_t n_entries = 2000;
+
+    sse::insecure::RocksDBBulkLoader::Options options;
+    options.run_capacity_bytes = 4096;
+    options.target_file_size   = 1024;
+    options.thread_count       = 3;
+
+    std::map<std::string, std::vector<uint64_t>> expected;
+
+    sse::insecure::RocksDBBulkLoader::Stats stats = index->bulk_load(
+        bulk_load_source(0, n_entries, &expected), options);
+
+    EXPECT_EQ(stats.entry_count, n_entries);
+    EXPECT_EQ(stats.keyword_count, expected.size());
+    EXPECT_GT(stats.run_count, 1u);
+    EXPECT_GT(stats.file_count, 1u);
+    EXPECT_FALSE(utility::exists(path + "/bulk_load"));
+
+    for (const auto& list : expected) {
+        EXPECT_EQ(index->search(list.first), list.second);
+    }
+
+    // the loaded lists can be appended to
+    index->insert("0", n_entries);
+    expected["0"].push_back(n_entries);
+    EXPECT_EQ(index->search("0"), expected["0"]);
+}
+
+TEST(RocksDBMultiMap, hashed_keywords)
+{
+    using sse::insecure::HashedKeyword128;
+    using sse::insecure::HashedKeyword64;
+    using sse::insecure::KeywordKeyType;
+
+    const std::string path = "rocksdb_hashed_test";
+
+    // the keys have a fixed width, and their bytes are the words in big endian
+    std::string buffer;
+    EXPECT_EQ(sse::insecure::keyword_key(KeywordKeyType::String, "kw", &buffer),
+              "kw");
+    EXPECT_EQ(sse::insecure::keyword_key(KeywordKeyType::Hash64, "kw", &buffer)
+                  .size(),
+              8u);
+    EXPECT_EQ(static_cast<unsigned char>(buffer[0]),
+              HashedKeyword64("kw").word(0) >> 56);
+    EXPECT_EQ(sse::insecure::keyword_key(KeywordKeyType::Hash128, "", &buffer)
+                  .size(),
+              16u);
+    EXPECT_EQ(HashedKeyword128("kw").word(0), HashedKeyword64("kw").word(0));
+    EXPECT_NE(HashedKeyword64("kw").word(0), HashedKeyword64("kw2").word(0));
+
+    // the PlainTable format requires fixed-width keys
+    std::unique_ptr<sse::insecure::Index>   index;
+    sse::insecure::RocksDBMultiMap::Options options;
+    options.plain_table = true;
+    EXPECT_THROW(index.reset(new sse::insecure::RocksDBMultiMap(path, options)),
+                 std::invalid_argument);
+
+    options.key_type       = KeywordKeyType::Hash64;
+    options.chunk_capacity = 3;
+    EXPECT_THROW(index.reset(new sse::insecure::RocksDBMultiMap(path, options)),
+                 std::invalid_argument);
+    utility::remove_directory(path);
+
+    // the loader writes the keys in the order of the keywords
+    index.reset(create_rocksdb_hashed_multimap(path));
+    std::map<std::string, std::vector<uint64_t>> expected;
+    EXPECT_THROW(static_cast<sse::insecure::RocksDBMultiMap*>(index.get())
+                     ->bulk_load(bulk_load_source(0, 10, &expected),
+                                 sse::insecure::RocksDBBulkLoader::Options()),
+                 std::logic_error);
+
+    index.reset(nullptr);
+    utility::remove_directory(path);
+}
+
+TEST(RocksDBBulkLoader, bulk_load)
+{
+    const std::string path = "rocksdb_bulk_load_test";
+
+    for (CreateIndexFunc* factory : {&create_rocksdb_multimap,
+                                     &create_rocksdb_chunked_multimap,
+                                     &create_rocksdb_compressed_multimap}) {
+        std::unique_ptr<sse::insecure::Index> index((*factory)(path));
+
+        check_bulk_load(
+            static_cast<sse::insecure::RocksDBMultiMap*>(index.get()), path);
+
+        index.reset(nullptr);
+        utility::remove_directory(path);
+    }
+
+    for (CreateIndexFunc* factory :
+         {&create_rocksdb_merge_multimap,
+          &create_rocksdb_merge_compressed_multimap}) {
+        std::unique_ptr<sse::insecure::RocksDBMergeMultiMap> index(
+            static_cast<sse::insecure::RocksDBMergeMultiMap*>(
+                (*factory)(path)));
+
+        check_bulk_load(index.get(), path);
+
+        // the lists are stored as plain values
+        sse::insecure::rocksdb_merge_counter_ = 0;
+        index->search("1");
+        EXPECT_EQ(sse::insecure::rocksdb_merge_counter_.load(), 0u);
+
+        index.reset(nullptr);
+        utility::remove_directory(path);
+    }
+}
+
+TEST(RocksDBBulkLoader, prefix_keywords)
+{
+    const std::string path      = "rocksdb_bulk_load_prefix_test";
+    const size_t      n_entries = 600;
+
+    // the keywords are prefixes of each other, and their lists are written
+    // to different SST files: without escaping, the chunks of the second
+    // keyword would be sorted between the ones of the first keyword
+    const std::vector<std::string> keywords = {
+        "a", "a" + std::string(7, '\0') + "\x01", "a" + std::string(8, '\0')};
+
+    std::unique_ptr<sse::insecure::Index> index(
+        create_rocksdb_chunked_multimap(path));
+
+    sse::insecure::RocksDBBulkLoader::Options options;
+    options.target_file_size = 1024;
+    options.thread_count     = 3;
+
+    std::map<std::string, std::vector<uint64_t>> expected;
+    uint64_t                                     doc = 0;
+
+    sse::insecure::RocksDBBulkLoader::Stats stats
+        = static_cast<sse::insecure::RocksDBMultiMap*>(index.get())
+              ->bulk_load(
+                  [&](sse::insecure::Index::entry_type* entry) {
+                      if (doc == n_entries) {
+                          return false;
+                      }
+                      entry->first  = keywords[doc % keywords.size()];
+                      entry->second = doc++;
+                      expected[entry->first].push_back(entry->second);
+                      return true;
+                  },
+                  options);
+
+    EXPECT_EQ(stats.keyword_count, keywords.size());
+    EXPECT_GT(stats.file_count, 1u);
+    for (const auto& list : expected) {
+        EXPECT_EQ(index->search(list.first), list.second);
+    }
+
+    index->insert(keywords[1], n_entries);
+    expected[keywords[1]].push_back(n_entries);
+    EXPECT_EQ(index->search(keywords[1]), expected[keywords[1]]);
+    EXPECT_EQ(index->search(keywords[2]), expected[keywords[2]]);
+
+    index.reset(nullptr);
+    utility::remove_directory(path);
+}
+
+TEST(IndexBuilder, parallel_build)
+{
+    const std::string path      = "index_builder_test";
+    const size_t      n_entries = 5000;
+
+    sse::insecure::IndexBuilder::Options options;
+    options.thread_count = 4;
+    options.oversampling = 8;
+
+    // the multimap does not support concurrent puts
+    for (CreateIndexFunc* factory :
+         {&create_std_multimap,
+          &create_rocksdb_multimap,
+          &create_rocksdb_chunked_multimap,
+          &create_rocksdb_merge_multimap,
+          &create_wiredtiger_multimap,
+          &create_wiredtiger_rows_multimap,
+          &create_sharded_rocksdb_multimap}) {
+        options.concurrent_puts = (factory != &create_std_multimap);
+
+        std::unique_ptr<sse::insecure::Index> index((*factory)(path));
+        sse::insecure::IndexBuilder           builder(options);
+
+        std::map<std::string, std::vector<uint64_t>> expected;
+
+        // the built lists are appended to the existing lists
+        index->insert("0", n_entries);
+        expected["0"].push_back(n_entries);
+
+        sse::insecure::IndexBuilder::Stats stats = builder.build(
+            bulk_load_source(0, n_entries, &expected), index.get());
+
+        EXPECT_EQ(stats.entry_count, n_entries);
+        EXPECT_EQ(stats.keyword_count, expected.size());
+        EXPECT_GT(stats.bucket_count, 1u);
+        EXPECT_LE(stats.bucket_count, options.thread_count);
+
+        for (const auto& list : expected) {
+            EXPECT_EQ(index->search(list.first), list.second);
+        }
+
+        index.reset(nullptr);
+        utility::remove_directory(path);
+    }
+
+    // an empty source
+    sse::insecure::StdMultiMap         index;
+    sse::insecure::IndexBuilder::Stats stats
+        = sse::insecure::IndexBuilder(options).build(
+            [](sse::insecure::Index::entry_type*) { return false; }, &index);
+    EXPECT_EQ(stats.entry_count, 0u);
+    EXPECT_EQ(stats.keyword_count, 0u);
+}
+
+TEST(WiredTigerMultimap, concurrent_inserts)
+{
+    const size_t n_threads = 4;
+    const size_t n_docs    = 50;
+
+    for (CreateIndexFunc* factory :
+         {&create_wiredtiger_multimap,
+          &create_wiredtiger_chunked_multimap,
+          &create_wiredtiger_rows_multimap,
+          &create_wiredtiger_hashed_multimap}) {
+        const std::string path = "wiredtiger_concurrency_test";
+
+        std::unique_ptr<sse::insecure::Index> index((*factory)(path));
+
+        // all the threads append to the same keyword, and conflict
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < n_threads; t++) {
+            threads.emplace_back([&index, t]() {
+                for (uint64_t d = 0; d < n_docs; d += 2) {
+                    index->insert("shared", t * n_docs + d);
+                    index->insert_batch({{"shared", t * n_docs + d + 1},
+                                         {std::to_string(t), d}});
+                    index->search("shared");
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        std::vector<uint64_t> expected(n_threads * n_docs);
+        std::iota(expected.begin(), expected.end(), 0);
+
+        std::vector<uint64_t> list = index->search("shared");
+        std::sort(list.begin(), list.end());
+        EXPECT_EQ(list, expected);
+
+        for (size_t t = 0; t < n_threads; t++) {
+            EXPECT_EQ(index->search(std::to_string(t)).size(), n_docs / 2);
+        }
+
+        index.reset(nullptr);
+        utility::remove_directory(path);
+    }
+}
+
+TEST(WiredTigerMultimap, document_rows)
+{
+    const std::string path = "wiredtiger_rows_test";
+
+    std::unique_ptr<sse::insecure::Index> index(
+        create_wiredtiger_rows_multimap(path));
+
+    // the keywords are prefixes of each other
+    std::vector<sse::insecure::Index::entry_type> batch;
+    std::vector<uint64_t>                         expected;
+    for (uint64_t d = 0; d < 1200; d++) {
+        batch.emplace_back("a", d);
+        expected.push_back(d);
+    }
+    index->insert_batch(batch);
+    index->insert("ab", 1);
+    index->insert("", 2);
+
+    EXPECT_EQ(index->search("a"), expected);
+    EXPECT_EQ(index->search("ab"), std::vector<uint64_t>({1}));
+    EXPECT_EQ(index->search(""), std::vector<uint64_t>({2}));
+    EXPECT_TRUE(index->search("abc").empty());
+
+    // the scan is visited by blocks
+    size_t n_calls = 0;
+    index->search("a", [&n_calls](const uint64_t*, size_t) { n_calls++; });
+    EXPECT_GT(n_calls, 1u);
+
+    // the sequence numbers are not reused after a restart: the new documents
+    // are still appended at the end of the lists
+    index.reset(create_wiredtiger_rows_multimap(path));
+    index->insert("a", 0);
+    expected.push_back(0);
+    EXPECT_EQ(index->search("a"), expected);
+
+    index.reset(nullptr);
+    utility::remove_directory(path);
+}
+
+TEST(WiredTigerMultimap, bulk_load)
+{
+    const std::string path      = "wiredtiger_bulk_load_test";
+    const size_t      n_entries = 2000;
+
+    sse::insecure::ExternalSorter::Options options;
+    options.run_capacity_bytes = 4096;
+    options.thread_count       = 3;
+
+    for (CreateIndexFunc* factory :
+         {&create_wiredtiger_multimap,
+          &create_wiredtiger_chunked_multimap,
+          &create_wiredtiger_rows_multimap,
+          &create_wiredtiger_compressed_multimap,
+          &create_wiredtiger_hashed_multimap}) {
+        std::unique_ptr<sse::insecure::Index> index((*factory)(path));
+        sse::insecure::WiredTigerMultimap*    wt_index
+            = static_cast<sse::insecure::WiredTigerMultimap*>(index.get());
+
+        std::map<std::string, std::vector<uint64_t>> expected;
+
+        // the tables are empty: the lists are written with bulk cursors,
+        // unless the keywords are hashed
+        index->search("0");
+        sse::insecure::ExternalSorter::Stats stats = wt_index->bulk_load(
+            bulk_load_source(0, n_entries, &expected), options);
+
+        EXPECT_EQ(stats.entry_count, n_entries);
+        EXPECT_EQ(stats.keyword_count, expected.size());
+        EXPECT_GT(stats.run_count, 1u);
+        EXPECT_FALSE(utility::exists(path + "/bulk_load"));
+
+        for (const auto& list : expected) {
+            EXPECT_EQ(index->search(list.first), list.second);
+        }
+
+        // the second load appends to the existing lists
+        index->insert("0", 3 * n_entries);
+        expected["0"].push_back(3 * n_entries);
+
+        wt_index->bulk_load(
+            bulk_load_source(n_entries, 2 * n_entries, &expected), options);
+
+        for (const auto& list : expected) {
+            EXPECT_EQ(index->search(list.first), list.second);
+        }
+
+        index.reset(nullptr);
+        utility::remove_directory(path);
+    }
+}
+
 struct IndexPrintToStringParamName
 {
     template<class ParamType>
@@ -84,8 +1557,40 @@ INSTANTIATE_TEST_SUITE_P(
     IndexTest,
     ::testing::Values(
         std::make_pair(&create_std_multimap, "StdMultimap"),
+        std::make_pair(&create_hash_multimap, "HashMultimap"),
+        std::make_pair(&create_concurrent_hash_multimap,
+                       "ConcurrentHashMultimap"),
         std::make_pair(&create_rocksdb_multimap, "RocksDBMultimap"),
+        std::make_pair(&create_rocksdb_chunked_multimap,
+                       "RocksDBChunkedMultimap"),
+        std::make_pair(&create_rocksdb_compressed_multimap,
+                       "RocksDBCompressedMultimap"),
+        std::make_pair(&create_rocksdb_hashed_multimap,
+                       "RocksDBHashedMultimap"),
         std::make_pair(&create_rocksdb_merge_multimap, "RocksDBMergeMultimap"),
-        std::make_pair(&create_wiredtiger_multimap, "WiredTigerMultimap")),
+        std::make_pair(&create_rocksdb_materialized_multimap,
+                       "RocksDBMaterializedMultimap"),
+        std::make_pair(&create_rocksdb_merge_compressed_multimap,
+                       "RocksDBMergeCompressedMultimap"),
+        std::make_pair(&create_wiredtiger_multimap, "WiredTigerMultimap"),
+        std::make_pair(&create_wiredtiger_chunked_multimap,
+                       "WiredTigerChunkedMultimap"),
+        std::make_pair(&create_wiredtiger_rows_multimap,
+                       "WiredTigerRowsMultimap"),
+        std::make_pair(&create_wiredtiger_hashed_multimap,
+                       "WiredTigerHashedMultimap"),
+        std::make_pair(&create_wiredtiger_rewrite_multimap,
+                       "WiredTigerRewriteMultimap"),
+        std::make_pair(&create_wiredtiger_compressed_multimap,
+                       "WiredTigerCompressedMultimap"),
+        std::make_pair(&create_cached_rocksdb_multimap,
+                       "CachedRocksDBMultimap"),
+        std::make_pair(&create_buffered_rocksdb_multimap,
+                       "BufferedRocksDBMultimap"),
+        std::make_pair(&create_sharded_rocksdb_multimap,
+                       "ShardedRocksDBMultimap"),
+        std::make_pair(&create_sharded_wiredtiger_multimap,
+                       "ShardedWiredTigerMultimap"),
+        std::make_pair(&create_segmented_index, "SegmentedIndex")),
     IndexPrintToStringParamName());
 } // namespace sse
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "keyword_dictionary.hpp"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+
+using insecure::KeywordDictionary;
+
+TEST(KeywordDictionary, interning)
+{
+    KeywordDictionary dictionary;
+
+    EXPECT_EQ(dictionary.find("missing"), KeywordDictionary::kNotFound);
+
+    // the identifiers are dense, in insertion order
+    EXPECT_EQ(dictionary.intern("a"), 0u);
+    EXPECT_EQ(dictionary.intern("b"), 1u);
+    EXPECT_EQ(dictionary.intern("a"), 0u);
+    EXPECT_EQ(dictionary.intern(""), 2u);
+
+    // the keywords are compared with their length
+    const std::string with_null("a\0b", 3);
+    EXPECT_EQ(dictionary.find(with_null), KeywordDictionary::kNotFound);
+    EXPECT_EQ(dictionary.intern(with_null), 3u);
+    EXPECT_EQ(dictionary.keyword(3), with_null);
+
+    EXPECT_EQ(dictionary.size(), 4u);
+    EXPECT_EQ(dictionary.find(""), 2u);
+    EXPECT_EQ(dictionary.keyword(2), "");
+    EXPECT_EQ(dictionary.find("b"), 1u);
+
+    // a full table only grows when a new keyword is added
+    while (dictionary.size() < 12) {
+        dictionary.intern("kw_" + std::to_string(dictionary.size()));
+    }
+    const size_t memory_usage = dictionary.memory_usage();
+    EXPECT_EQ(dictionary.intern("a"), 0u);
+    EXPECT_EQ(dictionary.memory_usage(), memory_usage);
+    EXPECT_EQ(dictionary.intern("c"), 12u);
+    EXPECT_GT(dictionary.memory_usage(), memory_usage);
+    EXPECT_EQ(dictionary.find("kw_4"), 4u);
+}
+
+TEST(KeywordDictionary, stable_keywords)
+{
+    // small blocks, so that the arena allocates many of them, and keywords
+    // longer than a block
+    KeywordDictionary::Options options;
+    options.arena_block_size = 64;
+
+    KeywordDictionary dictionary(options);
+
+    const size_t             n_keywords = 10000;
+    std::vector<std::string> keywords;
+    std::vector<const char*> data;
+    for (size_t i = 0; i < n_keywords; i++) {
+        keywords.push_back("keyword_" + std::to_string(i));
+        if (i % 100 == 0) {
+            keywords.back().append(200, 'x');
+        }
+
+        ASSERT_EQ(dictionary.intern(keywords.back()), i);
+        data.push_back(dictionary.data(i));
+    }
+
+    // the table was grown several times, and the keywords were not moved
+    for (size_t i = 0; i < n_keywords; i++) {
+        EXPECT_EQ(dictionary.find(keywords[i]), i);
+        EXPECT_EQ(dictionary.data(i), data[i]);
+        EXPECT_EQ(dictionary.keyword(i), keywords[i]);
+    }
+    EXPECT_EQ(dictionary.find("keyword_"), KeywordDictionary::kNotFound);
+
+    size_t keyword_bytes = 0;
+    for (const auto& keyword : keywords) {
+        keyword_bytes += keyword.size();
+    }
+    EXPECT_GE(dictionary.memory_usage(), keyword_bytes);
+
+    // reserving keeps the identifiers
+    dictionary.reserve(4 * n_keywords);
+    EXPECT_EQ(dictionary.find(keywords[42]), 42u);
+}
+
+} // namespace sse
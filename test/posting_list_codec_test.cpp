@@ -0,0 +1,147 @@
+#include "posting_list_codec.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+
+using insecure::PostingListCodec;
+using insecure::PostingListCodecType;
+
+class PostingListCodecTest
+    : public ::testing::TestWithParam<PostingListCodecType>
+{
+protected:
+    const PostingListCodec& codec() const
+    {
+        return insecure::posting_list_codec(GetParam());
+    }
+
+    std::vector<uint64_t> round_trip(const std::vector<uint64_t>& list) const
+    {
+        std::string encoded;
+        codec().encode(list.data(), list.size(), &encoded);
+
+        std::vector<uint64_t> decoded;
+        EXPECT_TRUE(codec().decode(encoded.data(), encoded.size(), &decoded));
+        return decoded;
+    }
+};
+
+TEST_P(PostingListCodecTest, round_trip)
+{
+    std::mt19937_64 gen(0x5eed);
+
+    for (size_t n : {0, 1, 2, 127, 128, 129, 256, 1000}) {
+        // dense and sorted
+        std::vector<uint64_t> sorted(n);
+        std::iota(sorted.begin(), sorted.end(), 1000);
+        EXPECT_EQ(round_trip(sorted), sorted);
+
+        // unsorted, spanning the whole range
+        std::vector<uint64_t> random(n);
+        for (auto& doc : random) {
+            doc = gen();
+        }
+        random.push_back(0);
+        random.push_back(~uint64_t(0));
+        EXPECT_EQ(round_trip(random), random);
+    }
+}
+
+TEST_P(PostingListCodecTest, compression)
+{
+    if (GetParam() == PostingListCodecType::Raw) {
+        return;
+    }
+
+    std::vector<uint64_t> list(1024);
+    std::iota(list.begin(), list.end(), 1u << 20);
+
+    std::string encoded;
+    codec().encode(list.data(), list.size(), &encoded);
+
+    EXPECT_LE(4 * encoded.size(), list.size() * sizeof(uint64_t));
+}
+
+TEST_P(PostingListCodecTest, concatenation)
+{
+    std::vector<uint64_t> first(300), second(50);
+    std::iota(first.begin(), first.end(), 10);
+    std::iota(second.begin(), second.end(), 3);
+
+    std::string encoded;
+    codec().encode(first.data(), first.size(), &encoded);
+    codec().encode(second.data(), second.size(), &encoded);
+
+    std::vector<uint64_t> expected(first);
+    expected.insert(expected.end(), second.begin(), second.end());
+
+    std::vector<uint64_t> decoded;
+    EXPECT_TRUE(codec().decode(encoded.data(), encoded.size(), &decoded));
+    EXPECT_EQ(decoded, expected);
+
+    // appending to an encoded list
+    uint64_t doc = 42;
+    EXPECT_TRUE(codec().append(&doc, 1, &encoded));
+    expected.push_back(doc);
+
+    std::vector<uint64_t> visited;
+    EXPECT_TRUE(codec().visit(encoded.data(),
+                              encoded.size(),
+                              [&visited](const uint64_t* docs, size_t n) {
+                                  visited.insert(
+                                      visited.end(), docs, docs + n);
+                              }));
+    EXPECT_EQ(visited, expected);
+}
+
+TEST_P(PostingListCodecTest, empty)
+{
+    // an empty list can come without any data
+    std::vector<uint64_t> decoded = {1, 2};
+    EXPECT_TRUE(codec().decode(nullptr, 0, &decoded));
+    EXPECT_EQ(decoded, std::vector<uint64_t>({1, 2}));
+}
+
+TEST_P(PostingListCodecTest, truncated)
+{
+    std::vector<uint64_t> list(200);
+    std::iota(list.begin(), list.end(), 1u << 30);
+
+    std::string encoded;
+    codec().encode(list.data(), list.size(), &encoded);
+
+    std::vector<uint64_t> decoded;
+    EXPECT_FALSE(
+        codec().decode(encoded.data(), encoded.size() - 1, &decoded));
+}
+
+TEST(PostingListCodec, names)
+{
+    for (PostingListCodecType type : {PostingListCodecType::Raw,
+                                      PostingListCodecType::DeltaVarint,
+                                      PostingListCodecType::BitPacked}) {
+        const PostingListCodec& codec = insecure::posting_list_codec(type);
+
+        PostingListCodecType parsed;
+        EXPECT_TRUE(insecure::parse_posting_list_codec(codec.name(), &parsed));
+        EXPECT_EQ(parsed, type);
+        EXPECT_EQ(codec.type(), type);
+    }
+
+    PostingListCodecType parsed;
+    EXPECT_FALSE(insecure::parse_posting_list_codec("unknown", &parsed));
+}
+
+INSTANTIATE_TEST_SUITE_P(Codecs,
+                         PostingListCodecTest,
+                         ::testing::Values(PostingListCodecType::Raw,
+                                           PostingListCodecType::DeltaVarint,
+                                           PostingListCodecType::BitPacked));
+} // namespace sse
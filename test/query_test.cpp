@@ -0,0 +1,188 @@
+#include "query.hpp"
+#include "std_multimap.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+
+using insecure::Query;
+
+namespace {
+using DocumentSet = std::set<insecure::Index::document_type>;
+
+// Build an index whose keyword "k<i>" matches the documents multiple of
+// (i+1), plus a few random ones, inserted in a random order
+class QueryTest : public ::testing::Test
+{
+protected:
+    static constexpr size_t   kKeywords  = 6;
+    static constexpr uint64_t kDocuments = 5000;
+
+    void SetUp() override
+    {
+        std::mt19937_64 gen(0xC0FFEE);
+
+        for (size_t i = 0; i < kKeywords; i++) {
+            const std::string kw = "k" + std::to_string(i);
+
+            std::vector<uint64_t> docs;
+            for (uint64_t doc = 0; doc < kDocuments; doc += i + 1) {
+                docs.push_back(doc);
+            }
+            for (size_t j = 0; j < 50; j++) {
+                docs.push_back(gen() % (2 * kDocuments));
+            }
+            std::shuffle(docs.begin(), docs.end(), gen);
+
+            for (uint64_t doc : docs) {
+                index_.insert(kw, doc);
+                expected_[kw].insert(doc);
+            }
+        }
+    }
+
+    const DocumentSet& expected(size_t i)
+    {
+        return expected_["k" + std::to_string(i)];
+    }
+
+    static Query kw(size_t i)
+    {
+        return Query::keyword("k" + std::to_string(i));
+    }
+
+    std::vector<uint64_t> execute(const Query& query) const
+    {
+        return insecure::QueryEngine(index_).execute(query);
+    }
+
+    static std::vector<uint64_t> intersection(const DocumentSet& a,
+                                              const DocumentSet& b)
+    {
+        std::vector<uint64_t> result;
+        std::set_intersection(
+            a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+
+    insecure::StdMultiMap              index_;
+    std::map<std::string, DocumentSet> expected_;
+};
+} // namespace
+
+TEST_F(QueryTest, keyword)
+{
+    const DocumentSet& docs = expected(2);
+
+    EXPECT_EQ(execute(kw(2)), std::vector<uint64_t>(docs.begin(), docs.end()));
+    EXPECT_TRUE(execute(Query::keyword("missing")).empty());
+}
+
+TEST_F(QueryTest, conjunction)
+{
+    EXPECT_EQ(execute(Query::conjunction({kw(1), kw(2)})),
+              intersection(expected(1), expected(2)));
+
+    // three lists, and a missing one
+    std::vector<uint64_t> three = intersection(expected(1), expected(2));
+    DocumentSet           three_set(three.begin(), three.end());
+    EXPECT_EQ(execute(Query::conjunction({kw(2), kw(4), kw(1)})),
+              intersection(three_set, expected(4)));
+
+    EXPECT_TRUE(
+        execute(Query::conjunction({kw(1), Query::keyword("missing")}))
+            .empty());
+}
+
+TEST_F(QueryTest, disjunction)
+{
+    DocumentSet expected_union(expected(3));
+    expected_union.insert(expected(4).begin(), expected(4).end());
+
+    EXPECT_EQ(execute(Query::disjunction({kw(3), kw(4)})),
+              std::vector<uint64_t>(expected_union.begin(),
+                                    expected_union.end()));
+}
+
+TEST_F(QueryTest, negation)
+{
+    // k0 AND k1 AND NOT k2
+    std::vector<uint64_t> expected_result;
+    for (uint64_t doc : intersection(expected(0), expected(1))) {
+        if (expected(2).count(doc) == 0) {
+            expected_result.push_back(doc);
+        }
+    }
+
+    EXPECT_EQ(execute(Query::conjunction(
+                  {kw(0), kw(1), Query::negation(kw(2))})),
+              expected_result);
+
+    EXPECT_THROW(execute(Query::negation(kw(0))), std::invalid_argument);
+    EXPECT_THROW(execute(Query::conjunction({Query::negation(kw(0))})),
+                 std::invalid_argument);
+}
+
+TEST_F(QueryTest, nested)
+{
+    // (k1 OR k2) AND k3 AND NOT (k4 OR k5)
+    Query query = Query::conjunction(
+        {Query::disjunction({kw(1), kw(2)}),
+         kw(3),
+         Query::negation(Query::disjunction({kw(4), kw(5)}))});
+
+    std::vector<uint64_t> expected_result;
+    for (uint64_t doc : expected(3)) {
+        bool positive = expected(1).count(doc) || expected(2).count(doc);
+        bool negative = expected(4).count(doc) || expected(5).count(doc);
+        if (positive && !negative) {
+            expected_result.push_back(doc);
+        }
+    }
+    EXPECT_EQ(execute(query), expected_result);
+}
+
+TEST(QueryKernel, intersect_sorted_lists)
+{
+    std::mt19937_64 gen(42);
+
+    // from similar sizes to very different ones, to use every kernel
+    for (size_t n_large : {10, 100, 1000, 100000}) {
+        std::vector<uint64_t> small, large;
+        for (size_t i = 0; i < 100; i++) {
+            small.push_back(gen() % 200000);
+        }
+        for (size_t i = 0; i < n_large; i++) {
+            large.push_back(gen() % 200000);
+        }
+        small.push_back(large.front());
+
+        for (auto* list : {&small, &large}) {
+            std::sort(list->begin(), list->end());
+            list->erase(std::unique(list->begin(), list->end()), list->end());
+        }
+
+        std::vector<uint64_t> expected;
+        std::set_intersection(small.begin(),
+                              small.end(),
+                              large.begin(),
+                              large.end(),
+                              std::back_inserter(expected));
+
+        std::vector<uint64_t> result(std::min(small.size(), large.size()));
+        result.resize(insecure::intersect_sorted_lists(small.data(),
+                                                       small.size(),
+                                                       large.data(),
+                                                       large.size(),
+                                                       result.data()));
+        EXPECT_EQ(result, expected);
+    }
+}
+} // namespace sse